@@ -0,0 +1,1311 @@
+/*
+ * bench-mock.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <dbus/dbus-glib-lowlevel.h>
+#include <glib/gstdio.h>
+#include <telepathy-glib/svc-account.h>
+#include <telepathy-glib/svc-account-manager.h>
+
+#include <sys/resource.h>
+
+#include <string.h>
+
+#include "pui-master.h"
+
+#include "bench-mock.h"
+
+#define BENCH_ACCOUNT_PATH_FMT \
+  TP_ACCOUNT_OBJECT_PATH_BASE BENCH_MOCK_CM_NAME "/" BENCH_MOCK_PROTOCOL \
+  "/account%u"
+
+/* ------------------------------------------------------------------------ */
+/* Protocol and connection manager */
+
+typedef struct
+{
+  TpBaseProtocol parent;
+} BenchProtocol;
+
+typedef struct
+{
+  TpBaseProtocolClass parent_class;
+} BenchProtocolClass;
+
+GType bench_protocol_get_type(void);
+
+G_DEFINE_TYPE(BenchProtocol, bench_protocol, TP_TYPE_BASE_PROTOCOL);
+
+static const TpCMParamSpec bench_protocol_params[] =
+{
+  { "account", "s", G_TYPE_STRING, TP_CONN_MGR_PARAM_FLAG_REQUIRED },
+  { NULL }
+};
+
+static const TpPresenceStatusSpec bench_protocol_statuses[] =
+{
+  { "available", TP_CONNECTION_PRESENCE_TYPE_AVAILABLE, TRUE, NULL },
+  { "away", TP_CONNECTION_PRESENCE_TYPE_AWAY, TRUE, NULL },
+  { "dnd", TP_CONNECTION_PRESENCE_TYPE_BUSY, TRUE, NULL },
+  { "offline", TP_CONNECTION_PRESENCE_TYPE_OFFLINE, TRUE, NULL },
+  { NULL }
+};
+
+static const TpCMParamSpec *
+bench_protocol_get_parameters(TpBaseProtocol *self)
+{
+  return bench_protocol_params;
+}
+
+static TpBaseConnection *
+bench_protocol_new_connection(TpBaseProtocol *self, GHashTable *asv,
+                              GError **error)
+{
+  g_set_error(error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED,
+              "Benchmark protocol never connects");
+
+  return NULL;
+}
+
+static GPtrArray *
+bench_protocol_get_interfaces_array(TpBaseProtocol *self)
+{
+  GPtrArray *interfaces = TP_BASE_PROTOCOL_CLASS(
+      bench_protocol_parent_class)->get_interfaces_array(self);
+  guint i;
+
+  for (i = 0; i < interfaces->len; i++)
+  {
+    if (!strcmp(g_ptr_array_index(interfaces, i),
+                TP_IFACE_PROTOCOL_INTERFACE_PRESENCE))
+    {
+      return interfaces;
+    }
+  }
+
+  g_ptr_array_add(interfaces, TP_IFACE_PROTOCOL_INTERFACE_PRESENCE);
+
+  return interfaces;
+}
+
+static void
+bench_protocol_get_connection_details(TpBaseProtocol *self,
+                                      GStrv *connection_interfaces,
+                                      GType **channel_managers,
+                                      gchar **icon_name, gchar **english_name,
+                                      gchar **vcard_field)
+{
+  if (connection_interfaces)
+    *connection_interfaces = g_new0(gchar *, 1);
+
+  if (channel_managers)
+    *channel_managers = g_new0(GType, 1);
+
+  if (icon_name)
+    *icon_name = g_strdup("im-jabber");
+
+  if (english_name)
+    *english_name = g_strdup("Jabber");
+
+  if (vcard_field)
+    *vcard_field = g_strdup("x-jabber");
+}
+
+static const TpPresenceStatusSpec *
+bench_protocol_get_statuses(TpBaseProtocol *self)
+{
+  return bench_protocol_statuses;
+}
+
+static void
+bench_protocol_class_init(BenchProtocolClass *klass)
+{
+  TpBaseProtocolClass *protocol_class = TP_BASE_PROTOCOL_CLASS(klass);
+
+  protocol_class->get_parameters = bench_protocol_get_parameters;
+  protocol_class->new_connection = bench_protocol_new_connection;
+  protocol_class->get_interfaces_array = bench_protocol_get_interfaces_array;
+  protocol_class->get_connection_details =
+    bench_protocol_get_connection_details;
+  protocol_class->get_statuses = bench_protocol_get_statuses;
+}
+
+static void
+bench_protocol_init(BenchProtocol *self)
+{
+}
+
+typedef struct
+{
+  TpBaseConnectionManager parent;
+} BenchConnectionManager;
+
+typedef struct
+{
+  TpBaseConnectionManagerClass parent_class;
+} BenchConnectionManagerClass;
+
+GType bench_connection_manager_get_type(void);
+
+G_DEFINE_TYPE(BenchConnectionManager, bench_connection_manager,
+              TP_TYPE_BASE_CONNECTION_MANAGER);
+
+static void
+bench_connection_manager_constructed(GObject *object)
+{
+  TpBaseConnectionManager *cm = TP_BASE_CONNECTION_MANAGER(object);
+  TpBaseProtocol *protocol;
+
+  G_OBJECT_CLASS(bench_connection_manager_parent_class)->constructed(object);
+
+  protocol = g_object_new(bench_protocol_get_type(),
+                          "name", BENCH_MOCK_PROTOCOL,
+                          NULL);
+  tp_base_connection_manager_add_protocol(cm, protocol);
+  g_object_unref(protocol);
+}
+
+static void
+bench_connection_manager_class_init(BenchConnectionManagerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  TpBaseConnectionManagerClass *cm_class =
+    TP_BASE_CONNECTION_MANAGER_CLASS(klass);
+
+  object_class->constructed = bench_connection_manager_constructed;
+  cm_class->cm_dbus_name = BENCH_MOCK_CM_NAME;
+}
+
+static void
+bench_connection_manager_init(BenchConnectionManager *self)
+{
+}
+
+/* ------------------------------------------------------------------------ */
+/* Account */
+
+typedef struct
+{
+  GObject parent;
+  BenchMock *mock;
+  gchar *object_path;
+  guint idx;
+  TpConnectionStatus connection_status;
+  TpConnectionStatusReason status_reason;
+  TpConnectionPresenceType presence_type;
+  gchar *presence_status;
+  gchar *presence_message;
+  TpConnectionPresenceType requested_type;
+  gchar *requested_status;
+  gchar *requested_message;
+  gboolean valid;
+  gboolean enabled;
+  gboolean has_been_online;
+  guint apply_id;
+} BenchAccount;
+
+typedef struct
+{
+  GObjectClass parent_class;
+  TpDBusPropertiesMixinClass dbus_props_class;
+} BenchAccountClass;
+
+GType bench_account_get_type(void);
+
+G_DEFINE_TYPE_WITH_CODE(
+  BenchAccount,
+  bench_account,
+  G_TYPE_OBJECT,
+  G_IMPLEMENT_INTERFACE(TP_TYPE_SVC_ACCOUNT, NULL);
+  G_IMPLEMENT_INTERFACE(TP_TYPE_SVC_ACCOUNT_INTERFACE_AVATAR, NULL);
+  G_IMPLEMENT_INTERFACE(TP_TYPE_SVC_DBUS_PROPERTIES,
+                        tp_dbus_properties_mixin_iface_init);
+);
+
+struct _BenchMock
+{
+  TpDBusDaemon *dbus;
+  TpBaseConnectionManager *cm;
+  GObject *am;
+  GPtrArray *accounts;
+  guint next_id;
+  GArray *avatar;
+  gchar *avatar_mime_type;
+  guint restart_id;
+  gboolean am_released;
+  gboolean cm_released;
+};
+
+static GValueArray *
+presence_build(TpConnectionPresenceType type, const gchar *status,
+               const gchar *message)
+{
+  return tp_value_array_build(3,
+                              G_TYPE_UINT, type,
+                              G_TYPE_STRING, status,
+                              G_TYPE_STRING, message ? message : "",
+                              G_TYPE_INVALID);
+}
+
+static void
+bench_account_emit_status(BenchAccount *self)
+{
+  GHashTable *changed = tp_asv_new(
+      "ConnectionStatus", G_TYPE_UINT, self->connection_status,
+      "ConnectionStatusReason", G_TYPE_UINT, self->status_reason,
+      "ChangingPresence", G_TYPE_BOOLEAN, FALSE,
+      NULL);
+
+  tp_asv_take_boxed(changed, "CurrentPresence", TP_STRUCT_TYPE_SIMPLE_PRESENCE,
+                    presence_build(self->presence_type, self->presence_status,
+                                   self->presence_message));
+  tp_svc_account_emit_account_property_changed(self, changed);
+  g_hash_table_unref(changed);
+}
+
+static void
+bench_account_set_presence(BenchAccount *self, TpConnectionPresenceType type,
+                           const gchar *status, const gchar *message)
+{
+  self->presence_type = type;
+  g_free(self->presence_status);
+  self->presence_status = g_strdup(status);
+  g_free(self->presence_message);
+  self->presence_message = g_strdup(message);
+}
+
+static gboolean
+bench_account_apply_requested(gpointer user_data)
+{
+  BenchAccount *self = user_data;
+
+  self->apply_id = 0;
+
+  if (self->requested_type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE)
+  {
+    self->connection_status = TP_CONNECTION_STATUS_DISCONNECTED;
+    self->status_reason = TP_CONNECTION_STATUS_REASON_REQUESTED;
+  }
+  else
+  {
+    self->connection_status = TP_CONNECTION_STATUS_CONNECTED;
+    self->status_reason = TP_CONNECTION_STATUS_REASON_REQUESTED;
+  }
+
+  bench_account_set_presence(self, self->requested_type,
+                             self->requested_status, self->requested_message);
+  bench_account_emit_status(self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+bench_account_get_property(GObject *object, GQuark iface, GQuark name,
+                           GValue *value, gpointer getter_data)
+{
+  BenchAccount *self = (BenchAccount *)object;
+  const gchar *prop = g_quark_to_string(name);
+
+  if (!strcmp(prop, "Interfaces"))
+  {
+    static const gchar *interfaces[] =
+    {
+      TP_IFACE_ACCOUNT_INTERFACE_AVATAR,
+      NULL
+    };
+
+    g_value_set_boxed(value, interfaces);
+  }
+  else if (!strcmp(prop, "DisplayName"))
+    g_value_take_string(value, g_strdup_printf("Bench %u", self->idx));
+  else if (!strcmp(prop, "Icon"))
+    g_value_set_string(value, "im-jabber");
+  else if (!strcmp(prop, "Valid"))
+    g_value_set_boolean(value, self->valid);
+  else if (!strcmp(prop, "Enabled"))
+    g_value_set_boolean(value, self->enabled);
+  else if (!strcmp(prop, "HasBeenOnline"))
+    g_value_set_boolean(value, self->has_been_online);
+  else if (!strcmp(prop, "ConnectAutomatically"))
+    g_value_set_boolean(value, TRUE);
+  else if (!strcmp(prop, "ChangingPresence"))
+    g_value_set_boolean(value, FALSE);
+  else if (!strcmp(prop, "Nickname"))
+    g_value_take_string(value, g_strdup_printf("bench%u", self->idx));
+  else if (!strcmp(prop, "NormalizedName"))
+    g_value_take_string(value, g_strdup_printf("bench%u@bench", self->idx));
+  else if (!strcmp(prop, "Service"))
+    g_value_set_string(value, BENCH_MOCK_PROTOCOL);
+  else if (!strcmp(prop, "Parameters"))
+  {
+    GHashTable *parameters = tp_asv_new(NULL, NULL);
+
+    tp_asv_take_string(parameters, "account",
+                       g_strdup_printf("bench%u@bench", self->idx));
+    g_value_take_boxed(value, parameters);
+  }
+  else if (!strcmp(prop, "Connection"))
+    g_value_set_boxed(value, "/");
+  else if (!strcmp(prop, "ConnectionStatus"))
+    g_value_set_uint(value, self->connection_status);
+  else if (!strcmp(prop, "ConnectionStatusReason"))
+    g_value_set_uint(value, self->status_reason);
+  else if (!strcmp(prop, "CurrentPresence"))
+  {
+    g_value_take_boxed(value, presence_build(self->presence_type,
+                                             self->presence_status,
+                                             self->presence_message));
+  }
+  else if (!strcmp(prop, "RequestedPresence"))
+  {
+    g_value_take_boxed(value, presence_build(self->requested_type,
+                                             self->requested_status,
+                                             self->requested_message));
+  }
+  else if (!strcmp(prop, "AutomaticPresence"))
+  {
+    g_value_take_boxed(value, presence_build(
+                         TP_CONNECTION_PRESENCE_TYPE_AVAILABLE, "available",
+                         ""));
+  }
+  else if (!strcmp(prop, "Avatar"))
+  {
+    GArray *avatar = self->mock->avatar;
+
+    if (!avatar)
+      avatar = g_array_new(FALSE, FALSE, sizeof(guchar));
+    else
+      g_array_ref(avatar);
+
+    g_value_take_boxed(value, tp_value_array_build(
+                         2,
+                         DBUS_TYPE_G_UCHAR_ARRAY, avatar,
+                         G_TYPE_STRING, self->mock->avatar_mime_type ?
+                         self->mock->avatar_mime_type : "",
+                         G_TYPE_INVALID));
+    g_array_unref(avatar);
+  }
+}
+
+static gboolean
+bench_account_set_requested_presence(GObject *object, GQuark iface,
+                                     GQuark name, const GValue *value,
+                                     gpointer setter_data, GError **error)
+{
+  BenchAccount *self = (BenchAccount *)object;
+  GHashTable *changed;
+  guint type;
+  const gchar *status;
+  const gchar *message;
+
+  tp_value_array_unpack(g_value_get_boxed(value), 3, &type, &status, &message);
+
+  self->requested_type = type;
+  g_free(self->requested_status);
+  self->requested_status = g_strdup(status);
+  g_free(self->requested_message);
+  self->requested_message = g_strdup(message);
+
+  changed = tp_asv_new(NULL, NULL);
+  tp_asv_take_boxed(changed, "RequestedPresence",
+                    TP_STRUCT_TYPE_SIMPLE_PRESENCE,
+                    presence_build(type, status, message));
+  tp_svc_account_emit_account_property_changed(self, changed);
+  g_hash_table_unref(changed);
+
+  if (!self->apply_id)
+    self->apply_id = g_idle_add(bench_account_apply_requested, self);
+
+  return TRUE;
+}
+
+static void
+bench_account_finalize(GObject *object)
+{
+  BenchAccount *self = (BenchAccount *)object;
+
+  if (self->apply_id)
+    g_source_remove(self->apply_id);
+
+  g_free(self->object_path);
+  g_free(self->presence_status);
+  g_free(self->presence_message);
+  g_free(self->requested_status);
+  g_free(self->requested_message);
+
+  G_OBJECT_CLASS(bench_account_parent_class)->finalize(object);
+}
+
+static void
+bench_account_class_init(BenchAccountClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  static TpDBusPropertiesMixinPropImpl account_props[] =
+  {
+    { "Interfaces", NULL, NULL },
+    { "DisplayName", NULL, NULL },
+    { "Icon", NULL, NULL },
+    { "Valid", NULL, NULL },
+    { "Enabled", NULL, NULL },
+    { "Nickname", NULL, NULL },
+    { "Service", NULL, NULL },
+    { "Parameters", NULL, NULL },
+    { "AutomaticPresence", NULL, NULL },
+    { "ConnectAutomatically", NULL, NULL },
+    { "Connection", NULL, NULL },
+    { "ConnectionStatus", NULL, NULL },
+    { "ConnectionStatusReason", NULL, NULL },
+    { "CurrentPresence", NULL, NULL },
+    { "RequestedPresence", NULL, NULL },
+    { "ChangingPresence", NULL, NULL },
+    { "NormalizedName", NULL, NULL },
+    { "HasBeenOnline", NULL, NULL },
+    { NULL }
+  };
+  static TpDBusPropertiesMixinPropImpl avatar_props[] =
+  {
+    { "Avatar", NULL, NULL },
+    { NULL }
+  };
+  static TpDBusPropertiesMixinIfaceImpl prop_interfaces[] =
+  {
+    {
+      TP_IFACE_ACCOUNT,
+      bench_account_get_property,
+      bench_account_set_requested_presence,
+      account_props
+    },
+    {
+      TP_IFACE_ACCOUNT_INTERFACE_AVATAR,
+      bench_account_get_property,
+      NULL,
+      avatar_props
+    },
+    { NULL }
+  };
+
+  object_class->finalize = bench_account_finalize;
+
+  klass->dbus_props_class.interfaces = prop_interfaces;
+  tp_dbus_properties_mixin_class_init(
+    object_class, G_STRUCT_OFFSET(BenchAccountClass, dbus_props_class));
+}
+
+static void
+bench_account_init(BenchAccount *self)
+{
+  self->connection_status = TP_CONNECTION_STATUS_DISCONNECTED;
+  self->status_reason = TP_CONNECTION_STATUS_REASON_REQUESTED;
+  self->presence_type = TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
+  self->presence_status = g_strdup("offline");
+  self->requested_type = TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
+  self->requested_status = g_strdup("offline");
+  self->valid = TRUE;
+  self->enabled = TRUE;
+  self->has_been_online = TRUE;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Account manager */
+
+typedef struct
+{
+  GObject parent;
+  BenchMock *mock;
+} BenchAccountManager;
+
+typedef struct
+{
+  GObjectClass parent_class;
+  TpDBusPropertiesMixinClass dbus_props_class;
+} BenchAccountManagerClass;
+
+GType bench_account_manager_get_type(void);
+
+G_DEFINE_TYPE_WITH_CODE(
+  BenchAccountManager,
+  bench_account_manager,
+  G_TYPE_OBJECT,
+  G_IMPLEMENT_INTERFACE(TP_TYPE_SVC_ACCOUNT_MANAGER, NULL);
+  G_IMPLEMENT_INTERFACE(TP_TYPE_SVC_DBUS_PROPERTIES,
+                        tp_dbus_properties_mixin_iface_init);
+);
+
+static void
+bench_account_manager_get_property(GObject *object, GQuark iface, GQuark name,
+                                   GValue *value, gpointer getter_data)
+{
+  BenchAccountManager *self = (BenchAccountManager *)object;
+  const gchar *prop = g_quark_to_string(name);
+
+  if (!strcmp(prop, "ValidAccounts") || !strcmp(prop, "InvalidAccounts"))
+  {
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    gboolean valid = !strcmp(prop, "ValidAccounts");
+    guint i;
+
+    for (i = 0; i < self->mock->accounts->len; i++)
+    {
+      BenchAccount *account = g_ptr_array_index(self->mock->accounts, i);
+
+      if (account && (!account->valid == !valid))
+        g_ptr_array_add(paths, g_strdup(account->object_path));
+    }
+
+    g_value_take_boxed(value, paths);
+  }
+  else if (!strcmp(prop, "Interfaces") ||
+           !strcmp(prop, "SupportedAccountProperties"))
+  {
+    g_value_take_boxed(value, g_new0(gchar *, 1));
+  }
+}
+
+static void
+bench_account_manager_class_init(BenchAccountManagerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  static TpDBusPropertiesMixinPropImpl am_props[] =
+  {
+    { "Interfaces", NULL, NULL },
+    { "ValidAccounts", NULL, NULL },
+    { "InvalidAccounts", NULL, NULL },
+    { "SupportedAccountProperties", NULL, NULL },
+    { NULL }
+  };
+  static TpDBusPropertiesMixinIfaceImpl prop_interfaces[] =
+  {
+    {
+      TP_IFACE_ACCOUNT_MANAGER,
+      bench_account_manager_get_property,
+      NULL,
+      am_props
+    },
+    { NULL }
+  };
+
+  klass->dbus_props_class.interfaces = prop_interfaces;
+  tp_dbus_properties_mixin_class_init(
+    object_class, G_STRUCT_OFFSET(BenchAccountManagerClass, dbus_props_class));
+}
+
+static void
+bench_account_manager_init(BenchAccountManager *self)
+{
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* removed accounts leave a NULL slot, so indexes stay stable */
+static void
+bench_mock_account_free(gpointer data)
+{
+  BenchAccount *account = data;
+
+  if (account)
+  {
+    tp_dbus_daemon_unregister_object(account->mock->dbus, account);
+    g_object_unref(account);
+  }
+}
+
+static BenchAccount *
+bench_mock_get_account(BenchMock *mock, guint idx)
+{
+  g_return_val_if_fail(idx < mock->accounts->len, NULL);
+
+  return g_ptr_array_index(mock->accounts, idx);
+}
+
+gchar *
+bench_mock_isolate_home(void)
+{
+  gchar *home = g_dir_make_tmp("pui-bench-XXXXXX", NULL);
+  gchar *osso;
+
+  g_return_val_if_fail(home != NULL, NULL);
+
+  osso = g_build_filename(home, ".osso", NULL);
+  g_mkdir_with_parents(osso, 0700);
+  g_free(osso);
+
+  g_setenv("HOME", home, TRUE);
+
+  return home;
+}
+
+static void
+remove_tree(const gchar *path)
+{
+  GDir *dir = g_dir_open(path, 0, NULL);
+
+  if (dir)
+  {
+    const gchar *name;
+
+    while ((name = g_dir_read_name(dir)))
+    {
+      gchar *child = g_build_filename(path, name, NULL);
+
+      if (g_file_test(child, G_FILE_TEST_IS_DIR) &&
+          !g_file_test(child, G_FILE_TEST_IS_SYMLINK))
+      {
+        remove_tree(child);
+      }
+      else
+        g_remove(child);
+
+      g_free(child);
+    }
+
+    g_dir_close(dir);
+  }
+
+  g_remove(path);
+}
+
+void
+bench_mock_remove_home(gchar *home)
+{
+  if (!home)
+    return;
+
+  remove_tree(home);
+  g_free(home);
+}
+
+gint
+bench_mock_count_accounts(GtkTreeModel *model)
+{
+  GtkTreeIter iter;
+  gint n = 0;
+
+  if (gtk_tree_model_get_iter_first(model, &iter))
+  {
+    do
+    {
+      TpAccount *account;
+
+      gtk_tree_model_get(model, &iter, COLUMN_ACCOUNT, &account, -1);
+
+      if (account)
+      {
+        n++;
+        g_object_unref(account);
+      }
+    }
+    while (gtk_tree_model_iter_next(model, &iter));
+  }
+
+  return n;
+}
+
+BenchMock *
+bench_mock_new(GError **error)
+{
+  BenchMock *mock;
+  DBusGConnection *connection;
+  DBusError dbus_error;
+
+  connection = dbus_g_connection_open(g_getenv("DBUS_SESSION_BUS_ADDRESS"),
+                                      error);
+
+  if (!connection)
+    return NULL;
+
+  dbus_error_init(&dbus_error);
+
+  if (!dbus_bus_register(dbus_g_connection_get_connection(connection),
+                         &dbus_error))
+  {
+    g_set_error(error, TP_ERROR, TP_ERROR_DISCONNECTED, "%s",
+                dbus_error.message);
+    dbus_error_free(&dbus_error);
+    dbus_g_connection_unref(connection);
+    return NULL;
+  }
+
+  mock = g_slice_new0(BenchMock);
+  mock->dbus = tp_dbus_daemon_new(connection);
+  dbus_g_connection_unref(connection);
+  mock->accounts = g_ptr_array_new_with_free_func(bench_mock_account_free);
+
+  mock->cm = g_object_new(bench_connection_manager_get_type(),
+                          "dbus-daemon", mock->dbus,
+                          NULL);
+
+  if (!tp_base_connection_manager_register(mock->cm))
+  {
+    g_set_error(error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+                "Unable to register connection manager");
+    bench_mock_free(mock);
+    return NULL;
+  }
+
+  mock->am = g_object_new(bench_account_manager_get_type(), NULL);
+  ((BenchAccountManager *)mock->am)->mock = mock;
+  tp_dbus_daemon_register_object(mock->dbus, TP_ACCOUNT_MANAGER_OBJECT_PATH,
+                                 mock->am);
+
+  if (!tp_dbus_daemon_request_name(mock->dbus, TP_ACCOUNT_MANAGER_BUS_NAME,
+                                   FALSE, error))
+  {
+    bench_mock_free(mock);
+    return NULL;
+  }
+
+  return mock;
+}
+
+void
+bench_mock_free(BenchMock *mock)
+{
+  if (mock->restart_id)
+    g_source_remove(mock->restart_id);
+
+  if (mock->am)
+  {
+    tp_dbus_daemon_release_name(mock->dbus, TP_ACCOUNT_MANAGER_BUS_NAME, NULL);
+    tp_dbus_daemon_unregister_object(mock->dbus, mock->am);
+    g_object_unref(mock->am);
+  }
+
+  g_ptr_array_unref(mock->accounts);
+  g_clear_object(&mock->cm);
+
+  if (mock->avatar)
+    g_array_unref(mock->avatar);
+
+  g_free(mock->avatar_mime_type);
+  g_object_unref(mock->dbus);
+  g_slice_free(BenchMock, mock);
+}
+
+guint
+bench_mock_add_account(BenchMock *mock)
+{
+  BenchAccount *account = g_object_new(bench_account_get_type(), NULL);
+
+  account->mock = mock;
+  account->idx = mock->next_id++;
+  account->object_path = g_strdup_printf(BENCH_ACCOUNT_PATH_FMT,
+                                         account->idx);
+  tp_dbus_daemon_register_object(mock->dbus, account->object_path, account);
+  g_ptr_array_add(mock->accounts, account);
+
+  tp_svc_account_manager_emit_account_validity_changed(
+    mock->am, account->object_path, TRUE);
+
+  return mock->accounts->len - 1;
+}
+
+void
+bench_mock_remove_account(BenchMock *mock, guint idx)
+{
+  BenchAccount *account = bench_mock_get_account(mock, idx);
+
+  g_return_if_fail(account != NULL);
+
+  tp_svc_account_emit_removed(account);
+  g_ptr_array_index(mock->accounts, idx) = NULL;
+  bench_mock_account_free(account);
+}
+
+guint
+bench_mock_get_n_accounts(BenchMock *mock)
+{
+  return mock->accounts->len;
+}
+
+const gchar *
+bench_mock_get_account_path(BenchMock *mock, guint idx)
+{
+  BenchAccount *account = bench_mock_get_account(mock, idx);
+
+  return account ? account->object_path : NULL;
+}
+
+void
+bench_mock_set_connection_status(BenchMock *mock, guint idx,
+                                 TpConnectionStatus status,
+                                 TpConnectionStatusReason reason)
+{
+  BenchAccount *account = bench_mock_get_account(mock, idx);
+
+  g_return_if_fail(account != NULL);
+
+  account->connection_status = status;
+  account->status_reason = reason;
+
+  if (status == TP_CONNECTION_STATUS_DISCONNECTED)
+  {
+    bench_account_set_presence(account, TP_CONNECTION_PRESENCE_TYPE_OFFLINE,
+                               "offline", NULL);
+  }
+  else if (status == TP_CONNECTION_STATUS_CONNECTED)
+  {
+    bench_account_set_presence(account, account->requested_type,
+                               account->requested_status,
+                               account->requested_message);
+  }
+
+  bench_account_emit_status(account);
+}
+
+void
+bench_mock_set_presence(BenchMock *mock, guint idx,
+                        TpConnectionPresenceType type, const gchar *status,
+                        const gchar *message)
+{
+  BenchAccount *account = bench_mock_get_account(mock, idx);
+
+  g_return_if_fail(account != NULL);
+
+  bench_account_set_presence(account, type, status, message);
+  bench_account_emit_status(account);
+}
+
+void
+bench_mock_set_avatar_data(BenchMock *mock, const guchar *data, gsize len,
+                           const gchar *mime_type)
+{
+  if (mock->avatar)
+    g_array_unref(mock->avatar);
+
+  mock->avatar = g_array_sized_new(FALSE, FALSE, sizeof(guchar), len);
+  g_array_append_vals(mock->avatar, data, len);
+  g_free(mock->avatar_mime_type);
+  mock->avatar_mime_type = g_strdup(mime_type);
+}
+
+void
+bench_mock_avatar_changed(BenchMock *mock, guint idx)
+{
+  BenchAccount *account = bench_mock_get_account(mock, idx);
+
+  g_return_if_fail(account != NULL);
+
+  tp_svc_account_interface_avatar_emit_avatar_changed(account);
+}
+
+void
+bench_mock_set_account_property(BenchMock *mock, guint idx,
+                                const gchar *property, gboolean value)
+{
+  BenchAccount *account = bench_mock_get_account(mock, idx);
+  GHashTable *changed;
+
+  g_return_if_fail(account != NULL);
+
+  if (!strcmp(property, "valid"))
+  {
+    account->valid = value;
+    changed = tp_asv_new("Valid", G_TYPE_BOOLEAN, value, NULL);
+  }
+  else if (!strcmp(property, "enabled"))
+  {
+    account->enabled = value;
+    changed = tp_asv_new("Enabled", G_TYPE_BOOLEAN, value, NULL);
+  }
+  else if (!strcmp(property, "has-been-online"))
+  {
+    account->has_been_online = value;
+    changed = tp_asv_new("HasBeenOnline", G_TYPE_BOOLEAN, value, NULL);
+  }
+  else
+    g_return_if_reached();
+
+  tp_svc_account_emit_account_property_changed(account, changed);
+  g_hash_table_unref(changed);
+
+  /* mission-control announces validity on the AM as well */
+  if (!strcmp(property, "valid"))
+  {
+    tp_svc_account_manager_emit_account_validity_changed(
+      mock->am, account->object_path, value);
+  }
+}
+
+static void
+take_name(BenchMock *mock, const gchar *name)
+{
+  GError *error = NULL;
+
+  if (!tp_dbus_daemon_request_name(mock->dbus, name, FALSE, &error))
+  {
+    g_warning("Unable to take back %s: %s", name, error->message);
+    g_error_free(error);
+  }
+}
+
+static gboolean
+restart_idle(gpointer user_data)
+{
+  BenchMock *mock = user_data;
+
+  mock->restart_id = 0;
+
+  if (mock->am_released)
+    take_name(mock, TP_ACCOUNT_MANAGER_BUS_NAME);
+
+  if (mock->cm_released)
+    take_name(mock, TP_CM_BUS_NAME_BASE BENCH_MOCK_CM_NAME);
+
+  mock->am_released = FALSE;
+  mock->cm_released = FALSE;
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+bench_mock_restart_account_manager(BenchMock *mock)
+{
+  g_return_if_fail(!mock->am_released);
+
+  tp_dbus_daemon_release_name(mock->dbus, TP_ACCOUNT_MANAGER_BUS_NAME, NULL);
+  mock->am_released = TRUE;
+
+  if (!mock->restart_id)
+    mock->restart_id = g_idle_add(restart_idle, mock);
+}
+
+void
+bench_mock_restart_connection_manager(BenchMock *mock)
+{
+  g_return_if_fail(!mock->cm_released);
+
+  tp_dbus_daemon_release_name(mock->dbus,
+                              TP_CM_BUS_NAME_BASE BENCH_MOCK_CM_NAME, NULL);
+  mock->cm_released = TRUE;
+
+  if (!mock->restart_id)
+    mock->restart_id = g_idle_add(restart_idle, mock);
+}
+
+guint
+bench_mock_add_online_account(BenchMock *mock)
+{
+  guint idx = bench_mock_add_account(mock);
+
+  bench_mock_set_presence(mock, idx, TP_CONNECTION_PRESENCE_TYPE_AVAILABLE,
+                          "available", NULL);
+  bench_mock_set_connection_status(mock, idx, TP_CONNECTION_STATUS_CONNECTED,
+                                   TP_CONNECTION_STATUS_REASON_REQUESTED);
+
+  return idx;
+}
+
+void
+bench_mock_use_test_avatar(BenchMock *mock)
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, 96, 96);
+  gchar *buffer;
+  gsize len;
+
+  gdk_pixbuf_fill(pixbuf, 0x3070c0ff);
+
+  if (gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &len, "png", NULL, NULL))
+  {
+    bench_mock_set_avatar_data(mock, (const guchar *)buffer, len, "image/png");
+    g_free(buffer);
+  }
+
+  g_object_unref(pixbuf);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Environment */
+
+static gint
+env_setup(BenchEnv *env, int *argc, char ***argv, gboolean gtk)
+{
+  GError *error = NULL;
+
+  memset(env, 0, sizeof(*env));
+  env->home = bench_mock_isolate_home();
+
+  env->test_dbus = g_test_dbus_new(G_TEST_DBUS_NONE);
+  g_test_dbus_up(env->test_dbus);
+
+  if (gtk && !gtk_init_check(argc, argv))
+  {
+    g_printerr("No display, skipping\n");
+    bench_env_teardown(env);
+    return 77;
+  }
+
+  env->mock = bench_mock_new(&error);
+
+  if (!env->mock)
+  {
+    g_printerr("Unable to start fake services: %s\n", error->message);
+    g_error_free(error);
+    bench_env_teardown(env);
+    return 1;
+  }
+
+  return 0;
+}
+
+gint
+bench_env_setup(BenchEnv *env, int *argc, char ***argv)
+{
+  return env_setup(env, argc, argv, TRUE);
+}
+
+gint
+bench_env_setup_headless(BenchEnv *env)
+{
+  return env_setup(env, NULL, NULL, FALSE);
+}
+
+void
+bench_env_teardown(BenchEnv *env)
+{
+  if (env->mock)
+  {
+    bench_mock_free(env->mock);
+    env->mock = NULL;
+  }
+
+  if (env->test_dbus)
+  {
+    g_test_dbus_down(env->test_dbus);
+    g_object_unref(env->test_dbus);
+    env->test_dbus = NULL;
+  }
+
+  bench_mock_remove_home(env->home);
+  env->home = NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Settling */
+
+void
+bench_settle_init(BenchSettle *settle, guint quiet_ms)
+{
+  memset(settle, 0, sizeof(*settle));
+  settle->loop = g_main_loop_new(NULL, FALSE);
+  settle->quiet_ms = quiet_ms;
+}
+
+static void
+settle_row_changed_cb(GtkTreeModel *model, GtkTreePath *path,
+                      GtkTreeIter *iter, BenchSettle *settle)
+{
+  settle->model_writes++;
+  bench_settle_activity(settle);
+}
+
+static void
+settle_row_deleted_cb(GtkTreeModel *model, GtkTreePath *path,
+                      BenchSettle *settle)
+{
+  settle->model_writes++;
+  bench_settle_activity(settle);
+}
+
+static void
+settle_accounts_row_cb(PuiAccounts *accounts, PuiAccountsRow *row,
+                       BenchSettle *settle)
+{
+  settle->model_writes++;
+  bench_settle_activity(settle);
+}
+
+static void
+settle_accounts_row_changed_cb(PuiAccounts *accounts, PuiAccountsRow *row,
+                               guint changed, BenchSettle *settle)
+{
+  settle->model_writes++;
+  bench_settle_activity(settle);
+}
+
+void
+bench_settle_clear(BenchSettle *settle)
+{
+  if (settle->model)
+  {
+    g_signal_handlers_disconnect_by_data(settle->model, settle);
+    g_object_unref(settle->model);
+    settle->model = NULL;
+  }
+
+  if (settle->accounts)
+  {
+    g_signal_handlers_disconnect_by_data(settle->accounts, settle);
+    g_object_unref(settle->accounts);
+    settle->accounts = NULL;
+  }
+
+  if (settle->loop)
+  {
+    g_main_loop_unref(settle->loop);
+    settle->loop = NULL;
+  }
+}
+
+static gboolean
+settle_quiet_cb(gpointer user_data)
+{
+  BenchSettle *settle = user_data;
+
+  settle->quiet_id = 0;
+  g_main_loop_quit(settle->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+settle_deadline_cb(gpointer user_data)
+{
+  BenchSettle *settle = user_data;
+
+  settle->deadline_id = 0;
+  settle->timed_out = TRUE;
+  g_main_loop_quit(settle->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+bench_settle_activity(BenchSettle *settle)
+{
+  settle->last = g_get_monotonic_time();
+
+  if (!settle->first)
+    settle->first = settle->last;
+
+  /* only counts while the loop waits for quiet */
+  if (settle->quiet_id)
+  {
+    g_source_remove(settle->quiet_id);
+    settle->quiet_id = g_timeout_add(settle->quiet_ms, settle_quiet_cb,
+                                     settle);
+  }
+}
+
+void
+bench_settle_watch_model(BenchSettle *settle, GtkTreeModel *model)
+{
+  g_return_if_fail(settle->model == NULL);
+
+  settle->model = g_object_ref(model);
+  g_signal_connect(model, "row-changed", G_CALLBACK(settle_row_changed_cb),
+                   settle);
+  g_signal_connect(model, "row-inserted", G_CALLBACK(settle_row_changed_cb),
+                   settle);
+  g_signal_connect(model, "row-deleted", G_CALLBACK(settle_row_deleted_cb),
+                   settle);
+}
+
+void
+bench_settle_watch_accounts(BenchSettle *settle, PuiAccounts *accounts)
+{
+  g_return_if_fail(settle->accounts == NULL);
+
+  settle->accounts = g_object_ref(accounts);
+  g_signal_connect(accounts, "row-changed",
+                   G_CALLBACK(settle_accounts_row_changed_cb), settle);
+  g_signal_connect(accounts, "row-inserted",
+                   G_CALLBACK(settle_accounts_row_cb), settle);
+  g_signal_connect(accounts, "row-deleted",
+                   G_CALLBACK(settle_accounts_row_cb), settle);
+}
+
+gboolean
+bench_settle_run(BenchSettle *settle, guint timeout)
+{
+  settle->timed_out = FALSE;
+  settle->quiet_id = g_timeout_add(settle->quiet_ms, settle_quiet_cb, settle);
+  settle->deadline_id = g_timeout_add_seconds(timeout, settle_deadline_cb,
+                                              settle);
+
+  g_main_loop_run(settle->loop);
+
+  if (settle->quiet_id)
+  {
+    g_source_remove(settle->quiet_id);
+    settle->quiet_id = 0;
+  }
+
+  if (settle->deadline_id)
+  {
+    g_source_remove(settle->deadline_id);
+    settle->deadline_id = 0;
+  }
+
+  return !settle->timed_out;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Measurements */
+
+gint64
+bench_cpu_time(void)
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+
+  return (gint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+         G_USEC_PER_SEC + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+gint
+bench_cmp_gint64(gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *)a;
+  gint64 y = *(const gint64 *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static DBusHandlerResult
+count_filter(DBusConnection *connection, DBusMessage *message,
+             void *user_data)
+{
+  guint *counter = user_data;
+
+  (*counter)++;
+
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static DBusConnection *
+dbus_get_connection(TpDBusDaemon *dbus)
+{
+  return dbus_g_connection_get_connection(tp_proxy_get_dbus_connection(dbus));
+}
+
+void
+bench_dbus_count_start(TpDBusDaemon *dbus, guint *counter)
+{
+  dbus_connection_add_filter(dbus_get_connection(dbus), count_filter,
+                             counter, NULL);
+}
+
+void
+bench_dbus_count_stop(TpDBusDaemon *dbus, guint *counter)
+{
+  dbus_connection_remove_filter(dbus_get_connection(dbus), count_filter,
+                                counter);
+}
@@ -0,0 +1,201 @@
+/*
+ * bench-mock.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __BENCH_MOCK_H_INCLUDED__
+#define __BENCH_MOCK_H_INCLUDED__
+
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "pui-accounts.h"
+
+G_BEGIN_DECLS
+
+/* Fake AccountManager and ConnectionManager, living on their own private
+ * connection to the session bus, so PuiMaster in the same process talks to
+ * them over D-Bus exactly like it talks to mission-control.
+ *
+ * Accounts behave like mission-control would: a RequestedPresence change is
+ * applied on the next main loop iteration, going online puts the account
+ * CONNECTED, going offline DISCONNECTED. */
+
+#define BENCH_MOCK_CM_NAME "bench"
+#define BENCH_MOCK_PROTOCOL "jabber"
+
+typedef struct _BenchMock BenchMock;
+
+/* Points HOME at a new temporary directory, so PuiMaster neither reads nor
+ * overwrites the user's config. Returns the directory. */
+gchar *
+bench_mock_isolate_home(void);
+
+/* Removes the directory bench_mock_isolate_home() made, with everything
+ * PuiMaster wrote there, and frees home. */
+void
+bench_mock_remove_home(gchar *home);
+
+/* Rows of a PuiMaster model that hold an account, the NULL account row and
+ * any other row without one are not counted. */
+gint
+bench_mock_count_accounts(GtkTreeModel *model);
+
+BenchMock *
+bench_mock_new(GError **error);
+
+void
+bench_mock_free(BenchMock *mock);
+
+/* returns index of the new account */
+guint
+bench_mock_add_account(BenchMock *mock);
+
+void
+bench_mock_remove_account(BenchMock *mock, guint idx);
+
+guint
+bench_mock_get_n_accounts(BenchMock *mock);
+
+const gchar *
+bench_mock_get_account_path(BenchMock *mock, guint idx);
+
+void
+bench_mock_set_connection_status(BenchMock *mock, guint idx,
+                                 TpConnectionStatus status,
+                                 TpConnectionStatusReason reason);
+
+void
+bench_mock_set_presence(BenchMock *mock, guint idx,
+                        TpConnectionPresenceType type, const gchar *status,
+                        const gchar *message);
+
+/* data is copied, used by every account */
+void
+bench_mock_set_avatar_data(BenchMock *mock, const guchar *data, gsize len,
+                           const gchar *mime_type);
+
+void
+bench_mock_avatar_changed(BenchMock *mock, guint idx);
+
+/* property is the TpAccount property name: "valid", "enabled" or
+ * "has-been-online" */
+void
+bench_mock_set_account_property(BenchMock *mock, guint idx,
+                                const gchar *property, gboolean value);
+
+/* drops AM bus name and takes it again, like mission-control restart */
+void
+bench_mock_restart_account_manager(BenchMock *mock);
+
+/* same for the CM bus name, like a CM crash and reactivation */
+void
+bench_mock_restart_connection_manager(BenchMock *mock);
+
+/* adds an account that is available and connected, returns its index */
+guint
+bench_mock_add_online_account(BenchMock *mock);
+
+/* gives every account a 96x96 PNG avatar */
+void
+bench_mock_use_test_avatar(BenchMock *mock);
+
+/* What every benchmark runs in: HOME isolated, a private session bus, GTK
+ * and the fake services on that bus. */
+struct _BenchEnv
+{
+  gchar *home;
+  GTestDBus *test_dbus;
+  BenchMock *mock;
+};
+
+typedef struct _BenchEnv BenchEnv;
+
+/* Returns 0 when env is ready, otherwise what main() should return, 77 if
+ * there is no display and 1 on error, with everything torn down already.
+ * Must be called before anything connects to the session bus. */
+gint
+bench_env_setup(BenchEnv *env, int *argc, char ***argv);
+
+/* Same without GTK, for benchmarks that drive PuiAccounts directly, so
+ * never 77 */
+gint
+bench_env_setup_headless(BenchEnv *env);
+
+void
+bench_env_teardown(BenchEnv *env);
+
+/* Runs the main loop until PuiMaster has been quiet for a while. Anything
+ * the benchmark sees PuiMaster do should call bench_settle_activity(). */
+struct _BenchSettle
+{
+  GMainLoop *loop;
+  guint quiet_ms;
+  guint quiet_id;
+  guint deadline_id;
+  gboolean timed_out;
+  GtkTreeModel *model;
+  PuiAccounts *accounts;
+  /* first and last activity and model rows inserted, changed or deleted,
+   * the benchmark resets them as it sees fit */
+  gint64 first;
+  gint64 last;
+  guint model_writes;
+};
+
+typedef struct _BenchSettle BenchSettle;
+
+void
+bench_settle_init(BenchSettle *settle, guint quiet_ms);
+
+void
+bench_settle_clear(BenchSettle *settle);
+
+void
+bench_settle_activity(BenchSettle *settle);
+
+/* every write to model is activity, until bench_settle_clear() */
+void
+bench_settle_watch_model(BenchSettle *settle, GtkTreeModel *model);
+
+/* same for rows of accounts, every row signal counts as a model write */
+void
+bench_settle_watch_accounts(BenchSettle *settle, PuiAccounts *accounts);
+
+/* returns FALSE if timeout seconds passed before quiet_ms without activity */
+gboolean
+bench_settle_run(BenchSettle *settle, guint timeout);
+
+/* user and system CPU time of the process, in us */
+gint64
+bench_cpu_time(void);
+
+/* for qsort() of gint64 samples */
+gint
+bench_cmp_gint64(gconstpointer a, gconstpointer b);
+
+/* counts messages the connection of dbus receives into counter */
+void
+bench_dbus_count_start(TpDBusDaemon *dbus, guint *counter);
+
+void
+bench_dbus_count_stop(TpDBusDaemon *dbus, guint *counter);
+
+G_END_DECLS
+
+#endif /* __BENCH_MOCK_H_INCLUDED__ */
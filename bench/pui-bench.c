@@ -0,0 +1,311 @@
+/*
+ * pui-bench.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* End-to-end load benchmark: PuiMaster against fake AM and CM on a private
+ * dbus-daemon. Every scenario injects churn on the fake side and runs the
+ * main loop until PuiMaster has been quiet for --settle ms. Results are
+ * printed one scenario per line as key=value pairs. scenario=startup is
+ * the initial account ingestion, to compare two revisions build both and run
+ * them with the same --accounts.
+ *
+ * Fake services run in this process on their own bus connection, so
+ * dbus_messages only counts what PuiMaster's connection receives, while
+ * cpu_us includes the fake side too. */
+
+#include "config.h"
+
+#include "pui-master.h"
+
+#include "bench-mock.h"
+
+typedef struct
+{
+  BenchMock *mock;
+  PuiMaster *master;
+  BenchSettle settle;
+  gint64 start;
+  guint recomputes;
+  guint dbus_messages;
+} Bench;
+
+typedef void (*BenchChurnFunc)(Bench *bench, guint iteration);
+
+static gint n_accounts = 100;
+static gint n_iterations = 10;
+static gint settle_ms = 100;
+
+static GOptionEntry entries[] =
+{
+  {
+    "accounts", 'a', 0, G_OPTION_ARG_INT, &n_accounts,
+    "Number of fake accounts (100)", "N"
+  },
+  {
+    "iterations", 'i', 0, G_OPTION_ARG_INT, &n_iterations,
+    "Iterations per scenario (10)", "N"
+  },
+  {
+    "settle", 's', 0, G_OPTION_ARG_INT, &settle_ms,
+    "Quiet time in ms after which PuiMaster is considered settled (100)", "MS"
+  },
+  { NULL }
+};
+
+static void
+presence_changed_cb(PuiMaster *master, guint presence_type,
+                    const gchar *status_message, guint status, Bench *bench)
+{
+  bench->recomputes++;
+  bench_settle_activity(&bench->settle);
+}
+
+static void
+churn_flap(Bench *bench, guint iteration)
+{
+  guint idx = iteration % bench_mock_get_n_accounts(bench->mock);
+
+  bench_mock_set_connection_status(bench->mock, idx,
+                                   TP_CONNECTION_STATUS_DISCONNECTED,
+                                   TP_CONNECTION_STATUS_REASON_NETWORK_ERROR);
+  bench_mock_set_connection_status(bench->mock, idx,
+                                   TP_CONNECTION_STATUS_CONNECTING,
+                                   TP_CONNECTION_STATUS_REASON_REQUESTED);
+  bench_mock_set_connection_status(bench->mock, idx,
+                                   TP_CONNECTION_STATUS_CONNECTED,
+                                   TP_CONNECTION_STATUS_REASON_REQUESTED);
+}
+
+static void
+churn_storm(Bench *bench, guint iteration)
+{
+  guint n = bench_mock_get_n_accounts(bench->mock);
+  guint i;
+
+  for (i = 0; i < n; i++)
+  {
+    bench_mock_set_connection_status(
+      bench->mock, i, TP_CONNECTION_STATUS_DISCONNECTED,
+      TP_CONNECTION_STATUS_REASON_NETWORK_ERROR);
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    bench_mock_set_connection_status(bench->mock, i,
+                                     TP_CONNECTION_STATUS_CONNECTING,
+                                     TP_CONNECTION_STATUS_REASON_REQUESTED);
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    bench_mock_set_connection_status(bench->mock, i,
+                                     TP_CONNECTION_STATUS_CONNECTED,
+                                     TP_CONNECTION_STATUS_REASON_REQUESTED);
+  }
+}
+
+static void
+churn_presence(Bench *bench, guint iteration)
+{
+  guint n = bench_mock_get_n_accounts(bench->mock);
+  guint i;
+
+  for (i = 0; i < n; i++)
+  {
+    if (iteration & 1)
+    {
+      bench_mock_set_presence(bench->mock, i,
+                              TP_CONNECTION_PRESENCE_TYPE_AVAILABLE,
+                              "available", NULL);
+    }
+    else
+    {
+      bench_mock_set_presence(bench->mock, i, TP_CONNECTION_PRESENCE_TYPE_AWAY,
+                              "away", "bench");
+    }
+  }
+}
+
+static void
+churn_avatar(Bench *bench, guint iteration)
+{
+  guint n = bench_mock_get_n_accounts(bench->mock);
+  guint i;
+
+  for (i = 0; i < n; i++)
+    bench_mock_avatar_changed(bench->mock, i);
+}
+
+static void
+bench_reset(Bench *bench)
+{
+  bench->settle.first = 0;
+  bench->settle.last = 0;
+  bench->settle.model_writes = 0;
+  bench->recomputes = 0;
+  bench->dbus_messages = 0;
+  bench->start = g_get_monotonic_time();
+}
+
+static void
+run_scenario(Bench *bench, const gchar *name, BenchChurnFunc churn)
+{
+  BenchSettle *settle = &bench->settle;
+  gint64 *first = g_new(gint64, n_iterations);
+  gint64 *last = g_new(gint64, n_iterations);
+  gint64 first_sum = 0;
+  gint64 last_sum = 0;
+  guint recomputes = 0;
+  guint model_writes = 0;
+  guint dbus_messages = 0;
+  guint timeouts = 0;
+  gint64 cpu;
+  gint i;
+
+  cpu = bench_cpu_time();
+
+  for (i = 0; i < n_iterations; i++)
+  {
+    bench_reset(bench);
+    churn(bench, i);
+
+    if (!bench_settle_run(settle, 30))
+      timeouts++;
+
+    /* quiet period is not part of the latency */
+    first[i] = settle->first ? settle->first - bench->start : 0;
+    last[i] = settle->last ? settle->last - bench->start : 0;
+    first_sum += first[i];
+    last_sum += last[i];
+    recomputes += bench->recomputes;
+    model_writes += settle->model_writes;
+    dbus_messages += bench->dbus_messages;
+  }
+
+  cpu = bench_cpu_time() - cpu;
+
+  qsort(first, n_iterations, sizeof(gint64), bench_cmp_gint64);
+  qsort(last, n_iterations, sizeof(gint64), bench_cmp_gint64);
+
+  g_print("scenario=%s accounts=%d iterations=%d "
+          "first_us_mean=%" G_GINT64_FORMAT " "
+          "first_us_p50=%" G_GINT64_FORMAT " "
+          "settle_us_mean=%" G_GINT64_FORMAT " "
+          "settle_us_p50=%" G_GINT64_FORMAT " "
+          "settle_us_p95=%" G_GINT64_FORMAT " "
+          "recomputes=%u model_writes=%u dbus_messages=%u "
+          "cpu_us=%" G_GINT64_FORMAT " timeouts=%u\n",
+          name, n_accounts, n_iterations,
+          first_sum / n_iterations, first[n_iterations / 2],
+          last_sum / n_iterations, last[n_iterations / 2],
+          last[(n_iterations * 95) / 100],
+          recomputes, model_writes, dbus_messages,
+          cpu, timeouts);
+
+  g_free(first);
+  g_free(last);
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  BenchEnv env;
+  TpDBusDaemon *dbus;
+  GtkTreeModel *model;
+  Bench bench = { 0 };
+  int ret;
+  gint i;
+
+  context = g_option_context_new("- PuiMaster load benchmark");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if ((n_accounts < 1) || (n_iterations < 1) || (settle_ms < 1))
+  {
+    g_printerr("accounts, iterations and settle must be positive\n");
+    return 1;
+  }
+
+  ret = bench_env_setup(&env, &argc, &argv);
+
+  if (ret)
+    return ret;
+
+  bench.mock = env.mock;
+  bench_mock_use_test_avatar(bench.mock);
+
+  for (i = 0; i < n_accounts; i++)
+    bench_mock_add_online_account(bench.mock);
+
+  bench_settle_init(&bench.settle, settle_ms);
+
+  dbus = tp_dbus_daemon_dup(NULL);
+  bench_dbus_count_start(dbus, &bench.dbus_messages);
+
+  bench_reset(&bench);
+  bench.master = pui_master_new(dbus);
+  model = GTK_TREE_MODEL(pui_master_get_model(bench.master));
+
+  g_signal_connect(bench.master, "presence-changed",
+                   G_CALLBACK(presence_changed_cb), &bench);
+  bench_settle_watch_model(&bench.settle, model);
+
+  while (bench_mock_count_accounts(model) < n_accounts)
+  {
+    if (!bench_settle_run(&bench.settle, 60))
+    {
+      g_printerr("Timed out waiting for %d accounts, got %d\n", n_accounts,
+                 bench_mock_count_accounts(model));
+      ret = 1;
+      break;
+    }
+  }
+
+  if (!ret)
+  {
+    bench_settle_run(&bench.settle, 60);
+
+    g_print("scenario=startup accounts=%d settle_us=%" G_GINT64_FORMAT " "
+            "recomputes=%u model_writes=%u dbus_messages=%u\n",
+            n_accounts, bench.settle.last - bench.start, bench.recomputes,
+            bench.settle.model_writes, bench.dbus_messages);
+
+    run_scenario(&bench, "flap", churn_flap);
+    run_scenario(&bench, "storm", churn_storm);
+    run_scenario(&bench, "presence", churn_presence);
+    run_scenario(&bench, "avatar", churn_avatar);
+  }
+
+  bench_dbus_count_stop(dbus, &bench.dbus_messages);
+  bench_settle_clear(&bench.settle);
+  g_object_unref(bench.master);
+  g_object_unref(dbus);
+  bench_env_teardown(&env);
+
+  return ret;
+}
@@ -0,0 +1,270 @@
+/*
+ * pui-memory.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Memory footprint of a long PuiMaster session against the fake AM and CM.
+ * Every cycle adds and removes accounts, changes avatars, creates and
+ * deletes a profile and, every --restart-every cycles, restarts the AM.
+ * After each cycle the heap held by every PuiMaster subsystem is printed as
+ * a key=value line, and the last line has the growth per cycle, measured
+ * after the first cycle, which warms up the icon caches.
+ *
+ * Live TpAccount instances, including the ones PuiMaster no longer knows
+ * about, are counted with GOBJECT_DEBUG=instance-count, so the benchmark
+ * re-executes itself with it set. */
+
+#include "config.h"
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include "pui-master.h"
+
+#include "bench-mock.h"
+
+typedef struct
+{
+  gint64 heap;
+  gint tp_accounts;
+  PuiMasterMemory memory;
+} Sample;
+
+static gint n_accounts = 20;
+static gint n_cycles = 50;
+static gint restart_every = 5;
+
+static GOptionEntry entries[] =
+{
+  {
+    "accounts", 'a', 0, G_OPTION_ARG_INT, &n_accounts,
+    "Number of fake accounts (20)", "N"
+  },
+  {
+    "cycles", 'c', 0, G_OPTION_ARG_INT, &n_cycles,
+    "Number of churn cycles (50)", "N"
+  },
+  {
+    "restart-every", 'r', 0, G_OPTION_ARG_INT, &restart_every,
+    "Restart the AM every N cycles, 0 never (5)", "N"
+  },
+  { NULL }
+};
+
+static gint64
+heap_in_use(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 info = mallinfo2();
+
+  return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+  struct mallinfo info = mallinfo();
+
+  return (guint)info.uordblks + (guint)info.hblkhd;
+#else
+  return -1;
+#endif
+}
+
+static void
+sample_take(Sample *sample, PuiMaster *master)
+{
+#ifdef __GLIBC__
+  /* return what can be returned, so freed memory is not counted */
+  malloc_trim(0);
+#endif
+  sample->heap = heap_in_use();
+  sample->tp_accounts = g_type_get_instance_count(TP_TYPE_ACCOUNT);
+  _pui_master_get_memory(master, &sample->memory);
+}
+
+static void
+sample_print(Sample *sample, gint cycle)
+{
+  PuiMasterMemory *m = &sample->memory;
+
+  g_print("cycle=%d heap=%" G_GINT64_FORMAT " "
+          "icons=%" G_GSIZE_FORMAT " n_icons=%u "
+          "avatars=%" G_GSIZE_FORMAT " n_avatars=%u "
+          "profiles=%" G_GSIZE_FORMAT " n_profiles=%u "
+          "model_rows=%" G_GSIZE_FORMAT " n_rows=%u "
+          "tp_proxies=%" G_GSIZE_FORMAT " n_tp_proxies=%u "
+          "tp_accounts_alive=%d signal_handlers=%u bindings=%u "
+          "live_bindings=%u\n",
+          cycle, sample->heap, m->icons, m->n_icons, m->avatars, m->n_avatars,
+          m->profiles, m->n_profiles, m->model_rows, m->n_rows, m->tp_proxies,
+          m->n_tp_proxies, sample->tp_accounts, m->signal_handlers,
+          m->n_bindings, _pui_master_get_live_bindings());
+}
+
+static gdouble
+growth(gint64 first, gint64 last, gint cycles)
+{
+  return cycles > 0 ? (gdouble)(last - first) / cycles : 0;
+}
+
+/* the fakes and PuiMaster talk over D-Bus, give them time to finish */
+static void
+wait_quiet(BenchSettle *settle)
+{
+  if (!bench_settle_run(settle, 60))
+    g_printerr("PuiMaster did not settle in 60 s\n");
+}
+
+static void
+cycle_run(BenchMock *mock, PuiMaster *master, GArray *live, gint cycle,
+          BenchSettle *settle)
+{
+  PuiProfile *profile;
+  guint i;
+
+  /* replace a quarter of the accounts */
+  for (i = 0; i < MAX(1, live->len / 4); i++)
+  {
+    guint idx = g_array_index(live, guint, 0);
+
+    g_array_remove_index(live, 0);
+    bench_mock_remove_account(mock, idx);
+    idx = bench_mock_add_online_account(mock);
+    g_array_append_val(live, idx);
+  }
+
+  wait_quiet(settle);
+
+  for (i = 0; i < live->len; i++)
+    bench_mock_avatar_changed(mock, g_array_index(live, guint, i));
+
+  wait_quiet(settle);
+
+  profile = g_slice_new0(PuiProfile);
+  profile->name = g_strdup_printf("bench%d", cycle);
+  profile->icon = g_strdup("general_presence_busy");
+  profile->icon_error = g_strdup("general_presence_busy_error");
+  profile->default_presence = g_strdup("away");
+  pui_master_save_profile(master, profile);
+  pui_master_delete_profile(master, profile);
+
+  if (restart_every && !((cycle + 1) % restart_every))
+  {
+    bench_mock_restart_account_manager(mock);
+    wait_quiet(settle);
+  }
+
+  wait_quiet(settle);
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  BenchEnv env;
+  TpDBusDaemon *dbus;
+  BenchMock *mock;
+  PuiMaster *master;
+  BenchSettle settle;
+  GArray *live;
+  Sample first;
+  Sample last;
+  int ret;
+  gint i;
+
+  if (!g_getenv("GOBJECT_DEBUG"))
+  {
+    g_setenv("GOBJECT_DEBUG", "instance-count", TRUE);
+    execv("/proc/self/exe", argv);
+    g_printerr("Unable to re-execute, TpAccount instances not counted\n");
+  }
+
+  context = g_option_context_new("- PuiMaster memory footprint");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if ((n_accounts < 1) || (n_cycles < 2) || (restart_every < 0))
+  {
+    g_printerr("need at least 1 account and 2 cycles\n");
+    return 1;
+  }
+
+  ret = bench_env_setup(&env, &argc, &argv);
+
+  if (ret)
+    return ret;
+
+  mock = env.mock;
+  bench_mock_use_test_avatar(mock);
+  live = g_array_new(FALSE, FALSE, sizeof(guint));
+
+  for (i = 0; i < n_accounts; i++)
+  {
+    guint idx = bench_mock_add_online_account(mock);
+
+    g_array_append_val(live, idx);
+  }
+
+  bench_settle_init(&settle, 300);
+  dbus = tp_dbus_daemon_dup(NULL);
+  master = pui_master_new(dbus);
+  bench_settle_watch_model(&settle,
+                           GTK_TREE_MODEL(pui_master_get_model(master)));
+  wait_quiet(&settle);
+
+  for (i = 0; i < n_cycles; i++)
+  {
+    cycle_run(mock, master, live, i, &settle);
+    sample_take(&last, master);
+    sample_print(&last, i);
+
+    if (i == 0)
+      first = last;
+  }
+
+  g_print("summary cycles=%d accounts=%d "
+          "heap_per_cycle=%.1f icons_per_cycle=%.1f avatars_per_cycle=%.1f "
+          "profiles_per_cycle=%.1f model_rows_per_cycle=%.1f "
+          "tp_proxies_per_cycle=%.1f tp_accounts_alive_per_cycle=%.2f "
+          "signal_handlers_per_cycle=%.2f\n",
+          n_cycles, n_accounts,
+          growth(first.heap, last.heap, n_cycles - 1),
+          growth(first.memory.icons, last.memory.icons, n_cycles - 1),
+          growth(first.memory.avatars, last.memory.avatars, n_cycles - 1),
+          growth(first.memory.profiles, last.memory.profiles, n_cycles - 1),
+          growth(first.memory.model_rows, last.memory.model_rows,
+                 n_cycles - 1),
+          growth(first.memory.tp_proxies, last.memory.tp_proxies,
+                 n_cycles - 1),
+          growth(first.tp_accounts, last.tp_accounts, n_cycles - 1),
+          growth(first.memory.signal_handlers, last.memory.signal_handlers,
+                 n_cycles - 1));
+
+  bench_settle_clear(&settle);
+  g_object_unref(master);
+  g_object_unref(dbus);
+  g_array_unref(live);
+  bench_env_teardown(&env);
+
+  return 0;
+}
@@ -0,0 +1,302 @@
+/*
+ * pui-microbench.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Microbenchmarks of the presence aggregation hot path on models of 1, 10,
+ * 100 and 1000 accounts. Accounts and their protocol come from the fake
+ * AM and CM, then everything is called synchronously with a fixed number
+ * of operations. One line per function and model size is printed as
+ * key=value pairs.
+ *
+ * Allocations are counted by interposing malloc, which only works with
+ * glibc; elsewhere allocs_per_op is reported as -1. */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include "pui-master.h"
+
+#include "bench-mock.h"
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static gint allocs;
+static gboolean count_allocs;
+
+void *
+malloc(size_t size)
+{
+  if (count_allocs)
+    g_atomic_int_inc(&allocs);
+
+  return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+  if (count_allocs)
+    g_atomic_int_inc(&allocs);
+
+  return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+  if (count_allocs)
+    g_atomic_int_inc(&allocs);
+
+  return __libc_realloc(ptr, size);
+}
+
+#define ALLOCS_START() \
+  G_STMT_START { g_atomic_int_set(&allocs, 0); count_allocs = TRUE; } G_STMT_END
+#define ALLOCS_STOP() \
+  (count_allocs = FALSE, g_atomic_int_get(&allocs))
+#else
+#define ALLOCS_START() G_STMT_START { } G_STMT_END
+#define ALLOCS_STOP() (-1)
+#endif
+
+typedef struct
+{
+  PuiMaster *master;
+  GtkTreeModel *model;
+  BenchSettle settle;
+  GPtrArray *accounts;
+  GArray *iters;
+  PuiProfile *profile;
+} Micro;
+
+typedef void (*MicroFunc)(Micro *micro, guint op);
+
+static const guint sizes[] = { 1000, 100, 10, 1 };
+
+/* runs the main loop until the model has n account rows and is quiet */
+static gboolean
+micro_wait_for(Micro *micro, guint n)
+{
+  gint64 deadline = g_get_monotonic_time() + 120 * G_USEC_PER_SEC;
+
+  do
+  {
+    if (!bench_settle_run(&micro->settle, 120) ||
+        (g_get_monotonic_time() > deadline))
+    {
+      return FALSE;
+    }
+  }
+  while (bench_mock_count_accounts(micro->model) != (gint)n);
+
+  return TRUE;
+}
+
+static void
+micro_collect(Micro *micro)
+{
+  GtkTreeIter iter;
+
+  g_ptr_array_set_size(micro->accounts, 0);
+  g_array_set_size(micro->iters, 0);
+
+  if (micro->profile)
+    pui_profile_free(micro->profile);
+
+  micro->profile = g_slice_new0(PuiProfile);
+  micro->profile->name = g_strdup("bench");
+  micro->profile->icon = g_strdup("general_presence_busy");
+  micro->profile->icon_error = g_strdup("general_presence_busy_error");
+  micro->profile->default_presence = g_strdup("available");
+
+  if (!gtk_tree_model_get_iter_first(micro->model, &iter))
+    return;
+
+  do
+  {
+    TpAccount *account;
+
+    gtk_tree_model_get(micro->model, &iter, COLUMN_ACCOUNT, &account, -1);
+
+    if (!account)
+      continue;
+
+    g_ptr_array_add(micro->accounts, account);
+    g_array_append_val(micro->iters, iter);
+    pui_profile_set_account_presence(micro->profile, account,
+                                     g_strdup("away"));
+  }
+  while (gtk_tree_model_iter_next(micro->model, &iter));
+}
+
+static void
+op_compute(Micro *micro, guint op)
+{
+  _pui_master_compute_global_presence(micro->master);
+}
+
+static void
+op_scan_profile(Micro *micro, guint op)
+{
+  TpConnectionPresenceType presence;
+  gboolean no_sip;
+
+  pui_master_scan_profile(micro->master, micro->profile, &no_sip, &presence);
+}
+
+/* all profiles in one walk, cached calls in between are lookups */
+static void
+op_scan_profiles(Micro *micro, guint op)
+{
+  _pui_master_invalidate_profile_scans(micro->master);
+  pui_master_scan_profiles(micro->master, NULL);
+}
+
+static void
+op_sort_cmp(Micro *micro, guint op)
+{
+  guint n = micro->iters->len;
+
+  _pui_master_accounts_sort_cmp(
+    micro->master,
+    &g_array_index(micro->iters, GtkTreeIter, op % n),
+    &g_array_index(micro->iters, GtkTreeIter, (op + 1) % n));
+}
+
+static void
+op_profile_get_presence(Micro *micro, guint op)
+{
+  pui_profile_get_presence(
+    micro->profile, g_ptr_array_index(micro->accounts,
+                                      op % micro->accounts->len));
+}
+
+static void
+op_get_presence_type(Micro *micro, guint op)
+{
+  pui_master_get_presence_type(
+    micro->master,
+    g_ptr_array_index(micro->accounts, op % micro->accounts->len), "away");
+}
+
+static void
+micro_run(Micro *micro, const gchar *name, MicroFunc func, guint ops)
+{
+  gint64 start;
+  gint64 elapsed;
+  gint n_allocs;
+  guint op;
+
+  /* warm up icon caches and protocol lookups */
+  for (op = 0; op < MIN(ops, 16); op++)
+    func(micro, op);
+
+  ALLOCS_START();
+  start = g_get_monotonic_time();
+
+  for (op = 0; op < ops; op++)
+    func(micro, op);
+
+  elapsed = g_get_monotonic_time() - start;
+  n_allocs = ALLOCS_STOP();
+
+  g_print("bench=%s accounts=%u ops=%u ns_per_op=%.1f allocs_per_op=%.2f\n",
+          name, micro->accounts->len, ops, (elapsed * 1000.0) / ops,
+          n_allocs < 0 ? -1.0 : (gdouble)n_allocs / ops);
+}
+
+int
+main(int argc, char **argv)
+{
+  BenchEnv env;
+  TpDBusDaemon *dbus;
+  BenchMock *mock;
+  Micro micro = { 0 };
+  int ret;
+  guint n;
+  guint i;
+
+  /* make g_slice visible to the malloc counter */
+  g_setenv("G_SLICE", "always-malloc", TRUE);
+  ret = bench_env_setup(&env, &argc, &argv);
+
+  if (ret)
+    return ret;
+
+  mock = env.mock;
+
+  for (i = 0; i < sizes[0]; i++)
+    bench_mock_add_online_account(mock);
+
+  bench_settle_init(&micro.settle, 200);
+  micro.accounts = g_ptr_array_new_with_free_func(g_object_unref);
+  micro.iters = g_array_new(FALSE, FALSE, sizeof(GtkTreeIter));
+
+  dbus = tp_dbus_daemon_dup(NULL);
+  micro.master = pui_master_new(dbus);
+  micro.model = GTK_TREE_MODEL(pui_master_get_model(micro.master));
+  bench_settle_watch_model(&micro.settle, micro.model);
+
+  /* sizes go down, so each step only removes accounts */
+  n = sizes[0];
+
+  for (i = 0; i < G_N_ELEMENTS(sizes); i++)
+  {
+    for (; n > sizes[i]; n--)
+      bench_mock_remove_account(mock, n - 1);
+
+    if (!micro_wait_for(&micro, sizes[i]))
+    {
+      g_printerr("Timed out waiting for %u accounts\n", sizes[i]);
+      ret = 1;
+      break;
+    }
+
+    micro_collect(&micro);
+
+    micro_run(&micro, "compute_global_presence", op_compute,
+              MAX(10, 20000 / sizes[i]));
+    micro_run(&micro, "scan_profile", op_scan_profile,
+              MAX(10, 20000 / sizes[i]));
+    micro_run(&micro, "scan_profiles", op_scan_profiles,
+              MAX(10, 20000 / sizes[i]));
+    micro_run(&micro, "accounts_sort_cmp", op_sort_cmp, 100000);
+    micro_run(&micro, "profile_get_presence", op_profile_get_presence,
+              100000);
+    micro_run(&micro, "get_presence_type", op_get_presence_type, 100000);
+
+    /* let the idles queued by compute run before the model changes */
+    micro_wait_for(&micro, sizes[i]);
+  }
+
+  if (micro.profile)
+    pui_profile_free(micro.profile);
+
+  g_ptr_array_unref(micro.accounts);
+  g_array_unref(micro.iters);
+  bench_settle_clear(&micro.settle);
+  g_object_unref(micro.master);
+  g_object_unref(dbus);
+  bench_env_teardown(&env);
+
+  return ret;
+}
@@ -0,0 +1,454 @@
+/*
+ * pui-replay.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Replays a trace recorded with PUI_TRACE=<file> against PuiAccounts and the
+ * fake AM and CM, without GTK, so it needs no display. Every account in the
+ * trace gets a fake account, in order of first appearance, and events are
+ * injected on the fake side with their original spacing divided by --speed.
+ * Results are printed as key=value pairs, like pui-bench, model_writes
+ * counts row signals of PuiAccounts.
+ *
+ * Every CM in the trace is replayed as the single fake CM. Name owner changes
+ * are replayed as a restart, which takes the name back by itself, so events
+ * for the name coming back are counted as skipped. */
+
+#include "config.h"
+
+#include <dbus/dbus-glib.h>
+
+#include "pui-accounts.h"
+#include "pui-trace.h"
+
+#include "bench-mock.h"
+
+typedef struct
+{
+  BenchMock *mock;
+  PuiCore *core;
+  PuiAccounts *pui_accounts;
+  DBusGProxy *bus_proxy;
+  BenchSettle settle;
+  GArray *events;
+  GHashTable *accounts;
+  guint next;
+  gint64 start;
+  gint64 injected;
+  GArray *latencies;
+  guint applied;
+  guint skipped;
+  guint recomputes;
+  guint dbus_messages;
+} Replay;
+
+static gdouble speed = 1.0;
+
+static GOptionEntry entries[] =
+{
+  {
+    "speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed,
+    "Time compression factor, 0 replays as fast as possible (1)", "FACTOR"
+  },
+  { NULL }
+};
+
+static void
+presence_changed_cb(PuiAccounts *accounts, guint presence_type,
+                    const gchar *status_message, guint status, Replay *replay)
+{
+  replay->recomputes++;
+
+  /* latency from the oldest event not yet reflected in global presence */
+  if (replay->injected)
+  {
+    gint64 latency = g_get_monotonic_time() - replay->injected;
+
+    g_array_append_val(replay->latencies, latency);
+    replay->injected = 0;
+  }
+
+  bench_settle_activity(&replay->settle);
+}
+
+/* what PuiMaster forwards from its D-Bus filter */
+static void
+name_owner_changed_cb(DBusGProxy *proxy, const gchar *name,
+                      const gchar *old_owner, const gchar *new_owner,
+                      Replay *replay)
+{
+  pui_accounts_name_owner_changed(replay->pui_accounts, name, old_owner,
+                                  new_owner);
+}
+
+/* fake accounts start valid, enabled and online before, a property whose
+ * first notification sets it TRUE must have been FALSE */
+static void
+replay_init_properties(Replay *replay, guint first, guint idx)
+{
+  static const gchar *properties[] = { "valid", "enabled", "has-been-online" };
+  const gchar *name = g_array_index(replay->events, PuiTraceEvent, first).name;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(properties); i++)
+  {
+    guint j;
+
+    for (j = first; j < replay->events->len; j++)
+    {
+      PuiTraceEvent *ev = &g_array_index(replay->events, PuiTraceEvent, j);
+
+      if ((ev->type == PUI_TRACE_NOTIFY) && !g_strcmp0(ev->name, name) &&
+          !g_strcmp0(ev->str1, properties[i]))
+      {
+        if (ev->args[0])
+        {
+          bench_mock_set_account_property(replay->mock, idx, properties[i],
+                                          FALSE);
+        }
+
+        break;
+      }
+    }
+  }
+}
+
+/* creates fake accounts for every account in the trace, in the state they
+ * had before their first recorded status change and property notifications */
+static void
+replay_create_accounts(Replay *replay)
+{
+  guint i;
+
+  for (i = 0; i < replay->events->len; i++)
+  {
+    PuiTraceEvent *ev = &g_array_index(replay->events, PuiTraceEvent, i);
+    TpConnectionStatus status = TP_CONNECTION_STATUS_CONNECTED;
+    guint idx;
+    guint j;
+
+    if ((ev->type == PUI_TRACE_AM_OWNER_CHANGED) ||
+        (ev->type == PUI_TRACE_CM_OWNER_CHANGED) ||
+        g_hash_table_contains(replay->accounts, ev->name))
+    {
+      continue;
+    }
+
+    idx = bench_mock_add_account(replay->mock);
+    g_hash_table_insert(replay->accounts, (gpointer)ev->name,
+                        GUINT_TO_POINTER(idx));
+
+    for (j = i; j < replay->events->len; j++)
+    {
+      PuiTraceEvent *next = &g_array_index(replay->events, PuiTraceEvent, j);
+
+      if ((next->type == PUI_TRACE_STATUS_CHANGED) &&
+          !g_strcmp0(next->name, ev->name))
+      {
+        status = next->args[0];
+        break;
+      }
+    }
+
+    if (status == TP_CONNECTION_STATUS_DISCONNECTED)
+    {
+      bench_mock_set_presence(replay->mock, idx,
+                              TP_CONNECTION_PRESENCE_TYPE_OFFLINE, "offline",
+                              NULL);
+    }
+    else
+    {
+      bench_mock_set_presence(replay->mock, idx,
+                              TP_CONNECTION_PRESENCE_TYPE_AVAILABLE,
+                              "available", NULL);
+    }
+
+    bench_mock_set_connection_status(replay->mock, idx, status,
+                                     TP_CONNECTION_STATUS_REASON_REQUESTED);
+    replay_init_properties(replay, i, idx);
+  }
+}
+
+static void
+replay_apply(Replay *replay, PuiTraceEvent *ev)
+{
+  guint idx = GPOINTER_TO_UINT(g_hash_table_lookup(replay->accounts,
+                                                   ev->name));
+
+  switch (ev->type)
+  {
+    case PUI_TRACE_PRESENCE_CHANGED:
+    {
+      bench_mock_set_presence(replay->mock, idx, ev->args[0], ev->str1,
+                              ev->str2);
+      break;
+    }
+    case PUI_TRACE_STATUS_CHANGED:
+    {
+      bench_mock_set_connection_status(replay->mock, idx, ev->args[1],
+                                       ev->args[2]);
+      break;
+    }
+    case PUI_TRACE_NOTIFY:
+    {
+      bench_mock_set_account_property(replay->mock, idx, ev->str1,
+                                      ev->args[0]);
+      break;
+    }
+    case PUI_TRACE_AVATAR_CHANGED:
+    {
+      bench_mock_avatar_changed(replay->mock, idx);
+      break;
+    }
+    case PUI_TRACE_AM_OWNER_CHANGED:
+    {
+      /* restart takes the name back, so only the loss is replayed */
+      if (ev->args[1])
+      {
+        replay->skipped++;
+        return;
+      }
+
+      bench_mock_restart_account_manager(replay->mock);
+      break;
+    }
+    case PUI_TRACE_CM_OWNER_CHANGED:
+    {
+      /* a lost or a replaced owner, not the first one */
+      if (!ev->args[0])
+      {
+        replay->skipped++;
+        return;
+      }
+
+      bench_mock_restart_connection_manager(replay->mock);
+      break;
+    }
+    default:
+    {
+      replay->skipped++;
+      return;
+    }
+  }
+
+  replay->applied++;
+
+  if (!replay->injected)
+    replay->injected = g_get_monotonic_time();
+}
+
+static gboolean
+replay_next_cb(gpointer user_data)
+{
+  Replay *replay = user_data;
+  gint64 now = g_get_monotonic_time();
+
+  /* inject everything that is due, timeouts have ms granularity */
+  while (replay->next < replay->events->len)
+  {
+    PuiTraceEvent *ev =
+      &g_array_index(replay->events, PuiTraceEvent, replay->next);
+
+    if ((speed > 0) && (replay->start + ev->timestamp / speed > now))
+    {
+      gint64 delay = replay->start + ev->timestamp / speed - now;
+
+      g_timeout_add(delay / 1000, replay_next_cb, replay);
+      return G_SOURCE_REMOVE;
+    }
+
+    replay_apply(replay, ev);
+    replay->next++;
+
+    if (speed <= 0)
+    {
+      g_idle_add(replay_next_cb, replay);
+      return G_SOURCE_REMOVE;
+    }
+  }
+
+  bench_settle_activity(&replay->settle);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+replay_load(Replay *replay, const gchar *filename, GError **error)
+{
+  PuiTraceReader *reader = pui_trace_reader_new(filename, error);
+  PuiTraceEvent ev;
+  gint64 first = -1;
+
+  if (!reader)
+    return FALSE;
+
+  while (pui_trace_reader_next(reader, &ev, error))
+  {
+    if (first < 0)
+      first = ev.timestamp;
+
+    /* the trace starts with PuiAccounts, not with the first event */
+    ev.timestamp -= first;
+    ev.name = g_intern_string(ev.name);
+    ev.str1 = g_intern_string(ev.str1);
+    ev.str2 = g_intern_string(ev.str2);
+    g_array_append_val(replay->events, ev);
+  }
+
+  pui_trace_reader_free(reader);
+
+  /* a truncated record at the end is expected after a crash */
+  if (error && *error)
+  {
+    g_printerr("%s, replaying %u events\n", (*error)->message,
+               replay->events->len);
+    g_clear_error(error);
+  }
+
+  return TRUE;
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  BenchEnv env;
+  TpDBusDaemon *dbus;
+  Replay replay = { 0 };
+  gint64 wall;
+  gint64 cpu;
+  gint64 *latencies;
+  guint n_latencies;
+  int ret;
+
+  context = g_option_context_new("TRACE - replay a PuiAccounts event trace");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if ((argc != 2) || (speed < 0))
+  {
+    g_printerr("Usage: %s [--speed FACTOR] TRACE\n", argv[0]);
+    return 1;
+  }
+
+  replay.events = g_array_new(FALSE, FALSE, sizeof(PuiTraceEvent));
+  replay.latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+  replay.accounts = g_hash_table_new(g_str_hash, g_str_equal);
+
+  if (!replay_load(&replay, argv[1], &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  /* do not record the replay over the trace being replayed */
+  g_unsetenv(PUI_TRACE_ENV);
+  ret = bench_env_setup_headless(&env);
+
+  if (ret)
+  {
+    g_hash_table_destroy(replay.accounts);
+    g_array_unref(replay.events);
+    g_array_unref(replay.latencies);
+    return ret;
+  }
+
+  replay.mock = env.mock;
+  replay_create_accounts(&replay);
+  bench_settle_init(&replay.settle, 200);
+
+  dbus = tp_dbus_daemon_dup(NULL);
+
+  replay.core = pui_core_new(NULL);
+  pui_core_load_config(replay.core);
+  replay.pui_accounts = pui_accounts_new(dbus, replay.core);
+  g_signal_connect(replay.pui_accounts, "presence-changed",
+                   G_CALLBACK(presence_changed_cb), &replay);
+  bench_settle_watch_accounts(&replay.settle, replay.pui_accounts);
+
+  replay.bus_proxy = dbus_g_proxy_new_for_name(
+      tp_proxy_get_dbus_connection(dbus), DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+      DBUS_INTERFACE_DBUS);
+  dbus_g_proxy_add_signal(replay.bus_proxy, "NameOwnerChanged", G_TYPE_STRING,
+                          G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INVALID);
+  dbus_g_proxy_connect_signal(replay.bus_proxy, "NameOwnerChanged",
+                              G_CALLBACK(name_owner_changed_cb), &replay,
+                              NULL);
+  pui_accounts_start(replay.pui_accounts);
+
+  /* let PuiAccounts load all the accounts before measuring */
+  bench_settle_run(&replay.settle, 60);
+
+  replay.recomputes = 0;
+  replay.settle.model_writes = 0;
+  g_array_set_size(replay.latencies, 0);
+  bench_dbus_count_start(dbus, &replay.dbus_messages);
+
+  cpu = bench_cpu_time();
+  replay.start = g_get_monotonic_time();
+  g_idle_add(replay_next_cb, &replay);
+
+  /* gaps in the trace are not the end of the replay */
+  do
+  {
+    bench_settle_run(&replay.settle, 60);
+  }
+  while (replay.next < replay.events->len);
+
+  /* the final quiet period is not part of the replay */
+  wall = replay.settle.last - replay.start;
+  cpu = bench_cpu_time() - cpu;
+
+  latencies = (gint64 *)replay.latencies->data;
+  n_latencies = replay.latencies->len;
+  qsort(latencies, n_latencies, sizeof(gint64), bench_cmp_gint64);
+
+  g_print("trace=%s events=%u accounts=%u applied=%u skipped=%u "
+          "speed=%.2f wall_us=%" G_GINT64_FORMAT " "
+          "cpu_us=%" G_GINT64_FORMAT " "
+          "recomputes=%u model_writes=%u dbus_messages=%u "
+          "latency_us_p50=%" G_GINT64_FORMAT " "
+          "latency_us_p95=%" G_GINT64_FORMAT "\n",
+          argv[1], replay.events->len, g_hash_table_size(replay.accounts),
+          replay.applied, replay.skipped, speed, wall, cpu,
+          replay.recomputes, replay.settle.model_writes, replay.dbus_messages,
+          n_latencies ? latencies[n_latencies / 2] : 0,
+          n_latencies ? latencies[(n_latencies * 95) / 100] : 0);
+
+  bench_dbus_count_stop(dbus, &replay.dbus_messages);
+  bench_settle_clear(&replay.settle);
+  g_object_unref(replay.bus_proxy);
+  g_object_unref(replay.pui_accounts);
+  pui_core_free(replay.core);
+  g_object_unref(dbus);
+  g_hash_table_destroy(replay.accounts);
+  g_array_unref(replay.events);
+  g_array_unref(replay.latencies);
+  bench_env_teardown(&env);
+
+  return 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * pui-startup.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Cold start benchmark of the status menu plugin. The plugin is loaded and
+ * instantiated the same way src/pui.c does it, against the fake AM and CM,
+ * and the time from module load to the first presence-changed, the first
+ * status area icon and the end of every PuiMaster startup phase is printed
+ * as key=value pairs. Then the main view is opened like a tap on the menu
+ * item does and the time to its first frame is printed too, with --cold-view
+ * the view is not built in advance. Startup happens once per process, run it
+ * several times for statistics. */
+
+#include "config.h"
+
+#include <libhildondesktop/hd-plugin-module.h>
+
+#include "pui-main-view.h"
+#include "pui-master.h"
+#include "pui-module.h"
+
+#include "bench-mock.h"
+
+typedef struct
+{
+  GMainLoop *loop;
+  PuiMaster *master;
+  gint64 first_presence_changed;
+  gint64 first_icon;
+  gint64 view_open;
+  gint64 view_first_frame;
+  gboolean timed_out;
+} Startup;
+
+static gint n_accounts = 10;
+static gchar *module_path = NULL;
+static gboolean cold_view = FALSE;
+
+static GOptionEntry entries[] =
+{
+  {
+    "accounts", 'a', 0, G_OPTION_ARG_INT, &n_accounts,
+    "Number of fake accounts (10)", "N"
+  },
+  {
+    "module", 'm', 0, G_OPTION_ARG_FILENAME, &module_path,
+    "Plugin to load (the one in the build tree)", "PATH"
+  },
+  {
+    "cold-view", 'c', 0, G_OPTION_ARG_NONE, &cold_view,
+    "Do not build the main view before it is opened", NULL
+  },
+  { NULL }
+};
+
+static const gchar *phase_names[PUI_MASTER_STARTUP_N_PHASES] =
+{
+  "config_load",
+  "am_prepare",
+  "cm_listing",
+  "account_append",
+  "first_recompute"
+};
+
+static gboolean
+deadline_cb(gpointer user_data)
+{
+  Startup *startup = user_data;
+
+  startup->timed_out = TRUE;
+  g_main_loop_quit(startup->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+startup_done(Startup *startup)
+{
+  const gint64 *times = _pui_master_get_startup_times(startup->master);
+
+  return startup->first_icon && times[PUI_MASTER_STARTUP_FIRST_RECOMPUTE];
+}
+
+static void
+presence_changed_cb(PuiMaster *master, guint presence_type,
+                    const gchar *status_message, guint status,
+                    Startup *startup)
+{
+  if (!startup->first_presence_changed)
+    startup->first_presence_changed = g_get_monotonic_time();
+
+  if (startup_done(startup))
+    g_main_loop_quit(startup->loop);
+}
+
+static void
+icon_notify_cb(GtkImage *image, GParamSpec *pspec, Startup *startup)
+{
+  if (!startup->first_icon && gtk_image_get_pixbuf(image))
+    startup->first_icon = g_get_monotonic_time();
+
+  if (startup->master && startup_done(startup))
+    g_main_loop_quit(startup->loop);
+}
+
+static gboolean
+close_view_idle(gpointer user_data)
+{
+  gtk_dialog_response(GTK_DIALOG(user_data), GTK_RESPONSE_CANCEL);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+view_expose_hook(GSignalInvocationHint *ihint, guint n_param_values,
+                 const GValue *param_values, gpointer user_data)
+{
+  Startup *startup = user_data;
+  GObject *object = g_value_get_object(&param_values[0]);
+
+  if (PUI_IS_MAIN_VIEW(object) && !startup->view_first_frame)
+  {
+    startup->view_first_frame = g_get_monotonic_time();
+    g_idle_add(close_view_idle, object);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+view_deadline_cb(gpointer user_data)
+{
+  Startup *startup = user_data;
+
+  startup->timed_out = TRUE;
+  gtk_dialog_response(GTK_DIALOG(pui_main_view_get(startup->master)),
+                      GTK_RESPONSE_CANCEL);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* runs after the low priority idle the menu item prepares the view in */
+static gboolean
+open_view_idle(gpointer user_data)
+{
+  Startup *startup = user_data;
+  guint deadline_id;
+  gulong hook_id;
+
+  if (cold_view)
+    pui_main_view_release(startup->master);
+
+  hook_id = g_signal_add_emission_hook(
+      g_signal_lookup("expose-event", GTK_TYPE_WIDGET), 0, view_expose_hook,
+      startup, NULL);
+  deadline_id = g_timeout_add_seconds(10, view_deadline_cb, startup);
+
+  /* returns when the view is closed from its first frame */
+  startup->view_open = g_get_monotonic_time();
+  pui_main_view_open(startup->master);
+
+  if (!startup->timed_out)
+    g_source_remove(deadline_id);
+
+  g_signal_remove_emission_hook(
+      g_signal_lookup("expose-event", GTK_TYPE_WIDGET), hook_id);
+  g_main_loop_quit(startup->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  BenchEnv env;
+  TpDBusDaemon *dbus;
+  HDPluginModule *module;
+  PuiMaster *master;
+  GtkWidget *status_area;
+  GtkWidget *menu_item;
+  Startup startup = { 0 };
+  const gint64 *times;
+  gint64 start;
+  gint64 loaded;
+  gint64 prev;
+  guint deadline_id;
+  int ret;
+  int i;
+
+  context = g_option_context_new("- status menu plugin startup benchmark");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  g_option_context_free(context);
+
+  if (n_accounts < 0)
+  {
+    g_printerr("accounts must not be negative\n");
+    return 1;
+  }
+
+  ret = bench_env_setup(&env, &argc, &argv);
+
+  if (ret)
+    return ret;
+
+  for (i = 0; i < n_accounts; i++)
+    bench_mock_add_online_account(env.mock);
+
+  startup.loop = g_main_loop_new(NULL, FALSE);
+  status_area = g_object_ref_sink(gtk_image_new());
+  g_signal_connect(status_area, "notify::pixbuf",
+                   G_CALLBACK(icon_notify_cb), &startup);
+
+  start = g_get_monotonic_time();
+
+  module = hd_plugin_module_new(module_path ? module_path : BENCH_PLUGIN);
+  g_type_module_use(G_TYPE_MODULE(module));
+
+  loaded = g_get_monotonic_time();
+
+  dbus = tp_dbus_daemon_dup(NULL);
+  master = pui_master_new(dbus);
+  startup.master = master;
+  g_signal_connect(master, "presence-changed",
+                   G_CALLBACK(presence_changed_cb), &startup);
+
+  menu_item = g_object_ref_sink(g_object_new(PUI_TYPE_MENU_ITEM,
+                                             "master", master,
+                                             "status-area", status_area,
+                                             NULL));
+
+  deadline_id = g_timeout_add_seconds(60, deadline_cb, &startup);
+
+  if (!startup_done(&startup))
+    g_main_loop_run(startup.loop);
+
+  if (!startup.timed_out)
+  {
+    g_source_remove(deadline_id);
+    g_idle_add_full(G_PRIORITY_LOW + 1, open_view_idle, &startup, NULL);
+    g_main_loop_run(startup.loop);
+  }
+
+  times = _pui_master_get_startup_times(master);
+
+  g_print("scenario=startup accounts=%d module_load_us=%" G_GINT64_FORMAT,
+          n_accounts, loaded - start);
+
+  /* every phase is measured from the end of the previous one */
+  prev = loaded;
+
+  for (i = 0; i < PUI_MASTER_STARTUP_N_PHASES; i++)
+  {
+    if (times[i])
+    {
+      g_print(" %s_us=%" G_GINT64_FORMAT, phase_names[i], times[i] - prev);
+      prev = times[i];
+    }
+    else
+      g_print(" %s_us=-1", phase_names[i]);
+  }
+
+  g_print(" first_presence_changed_us=%" G_GINT64_FORMAT
+          " first_icon_us=%" G_GINT64_FORMAT
+          " total_us=%" G_GINT64_FORMAT
+          " cold_view=%d main_view_first_frame_us=%" G_GINT64_FORMAT
+          " timeout=%d\n",
+          startup.first_presence_changed ?
+          startup.first_presence_changed - start : -1,
+          startup.first_icon ? startup.first_icon - start : -1,
+          prev - start, cold_view,
+          startup.view_first_frame ?
+          startup.view_first_frame - startup.view_open : -1,
+          startup.timed_out);
+
+  gtk_widget_destroy(menu_item);
+  g_object_unref(menu_item);
+  g_object_unref(master);
+  g_object_unref(dbus);
+  g_type_module_unuse(G_TYPE_MODULE(module));
+  g_object_unref(status_area);
+  g_main_loop_unref(startup.loop);
+  bench_env_teardown(&env);
+
+  return startup.timed_out;
+}
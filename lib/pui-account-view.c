@@ -21,6 +21,8 @@
 
 #include <glib/gi18n-lib.h>
 
+#include <string.h>
+
 #include "pui-master.h"
 
 #include "pui-account-view.h"
@@ -29,9 +31,7 @@ struct _PuiAccountViewPrivate
 {
   PuiMaster *master;
   GtkTreeViewColumn *presence_icon_col;
-  guint timer_id;
-  gboolean is_connecting : 1;
-  gboolean show_offline_icon : 1;
+  GHashTable *rows;
 };
 
 typedef struct _PuiAccountViewPrivate PuiAccountViewPrivate;
@@ -51,79 +51,62 @@ enum
   PROP_MASTER = 1
 };
 
-static gboolean
-refresh_connection_status_cb(PuiAccountView *view)
+/* What account_data_func() renders for an account, rebuilt only when one of
+ * its inputs or the style changes, so redraws format nothing and parse no
+ * markup. */
+struct _PuiAccountViewRow
 {
-  PuiAccountViewPrivate *priv = PRIVATE(view);
-  GtkTreeModel *model = GTK_TREE_MODEL(pui_master_get_model(priv->master));
-  GtkTreeIter it;
-  gboolean has_connecting_account = FALSE;
+  gchar *display_name;
+  gchar *status_message;
+  TpConnectionStatusReason status_reason;
+  gchar *text;
+  PangoAttrList *attrs;
+};
 
-  if (gtk_tree_model_get_iter_first(model, &it))
-  {
-    do
-    {
-      TpConnectionStatus connection_status;
-
-      gtk_tree_model_get(model, &it,
-                         COLUMN_CONNECTION_STATUS, &connection_status,
-                         -1);
-
-      if (connection_status == TP_CONNECTION_STATUS_CONNECTING)
-      {
-        GtkTreePath *path = gtk_tree_model_get_path(model, &it);
-        GdkRectangle r;
-
-        gtk_tree_view_get_cell_area(&view->parent,
-                                    path,
-                                    priv->presence_icon_col,
-                                    &r);
-        gtk_tree_path_free(path);
-        gtk_widget_queue_draw_area(&view->parent.parent.widget, r.x, r.y,
-                                   r.width, r.height);
-        has_connecting_account = TRUE;
-      }
-    }
-    while (gtk_tree_model_iter_next(model, &it));
-  }
+typedef struct _PuiAccountViewRow PuiAccountViewRow;
 
-  priv->show_offline_icon = !priv->show_offline_icon;
+static void
+row_free(gpointer data)
+{
+  PuiAccountViewRow *row = data;
 
-  if (!has_connecting_account)
-  {
-    priv->timer_id = 0;
-    priv->is_connecting = FALSE;
-  }
+  g_free(row->display_name);
+  g_free(row->status_message);
+  g_free(row->text);
+
+  if (row->attrs)
+    pango_attr_list_unref(row->attrs);
 
-  return has_connecting_account;
+  g_slice_free(PuiAccountViewRow, row);
 }
 
 static void
-on_screen_state_changed(PuiMaster *master, gboolean is_on,
-                        PuiAccountView *view)
+row_clear(PuiAccountView *view)
 {
-  PuiAccountViewPrivate *priv = PRIVATE(view);
+  g_hash_table_remove_all(PRIVATE(view)->rows);
+}
 
-  if (priv->is_connecting)
-  {
-    if (is_on)
-    {
-      if (!priv->timer_id)
-      {
-        priv->timer_id = g_timeout_add_seconds(
-            1, (GSourceFunc)refresh_connection_status_cb, view);
-        priv->show_offline_icon = FALSE;
-      }
-    }
-    else
-    {
-      if (priv->timer_id)
-      {
-        g_source_remove(priv->timer_id);
-        priv->timer_id = 0;
-      }
-    }
-  }
+static void
+invalidate_presence_cell(PuiMaster *master, GtkTreeIter *iter,
+                         gpointer user_data)
+{
+  PuiAccountView *view = user_data;
+  GtkTreeModel *model = GTK_TREE_MODEL(pui_master_get_model(master));
+  GtkTreePath *path = gtk_tree_model_get_path(model, iter);
+  GdkRectangle r;
+
+  gtk_tree_view_get_cell_area(&view->parent, path,
+                              PRIVATE(view)->presence_icon_col, &r);
+  gtk_tree_path_free(path);
+  gtk_widget_queue_draw_area(&view->parent.parent.widget, r.x, r.y,
+                             r.width, r.height);
+}
+
+/* only the connecting rows change with the blink phase */
+static void
+on_blink(PuiMaster *master, gboolean phase, PuiAccountView *view)
+{
+  pui_master_foreach_connecting(master, invalidate_presence_cell, view);
 }
 
 static void
@@ -131,17 +114,15 @@ pui_account_view_dispose(GObject *object)
 {
   PuiAccountViewPrivate *priv = PRIVATE(object);
 
-  if (priv->timer_id)
-  {
-    g_source_remove(priv->timer_id);
-    priv->timer_id = 0;
-  }
-
   if (priv->master)
   {
     g_signal_handlers_disconnect_matched(
       priv->master, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
-      on_screen_state_changed, object);
+      on_blink, object);
+    g_signal_handlers_disconnect_matched(
+      pui_master_get_model(priv->master),
+      G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_FUNC, 0, 0, NULL, row_clear,
+      object);
     g_object_unref(priv->master);
     priv->master = NULL;
   }
@@ -149,6 +130,14 @@ pui_account_view_dispose(GObject *object)
   G_OBJECT_CLASS(pui_account_view_parent_class)->dispose(object);
 }
 
+static void
+pui_account_view_finalize(GObject *object)
+{
+  g_hash_table_destroy(PRIVATE(object)->rows);
+
+  G_OBJECT_CLASS(pui_account_view_parent_class)->finalize(object);
+}
+
 static void
 pui_account_view_set_property(GObject *object, guint property_id,
                               const GValue *value, GParamSpec *pspec)
@@ -166,8 +155,10 @@ pui_account_view_set_property(GObject *object, guint property_id,
       gtk_tree_view_set_model(
         GTK_TREE_VIEW(view),
         GTK_TREE_MODEL(pui_master_get_model(priv->master)));
-      g_signal_connect(priv->master, "screen-state-changed",
-                       G_CALLBACK(on_screen_state_changed), view);
+      g_signal_connect(priv->master, "blink", G_CALLBACK(on_blink), view);
+      /* rows are keyed by account, forget the ones that may be gone */
+      g_signal_connect_swapped(pui_master_get_model(priv->master),
+                               "row-deleted", G_CALLBACK(row_clear), view);
       break;
     }
     default:
@@ -186,15 +177,27 @@ pui_account_view_size_request(GtkWidget *widget, GtkRequisition *requisition)
   requisition->width = 20;
 }
 
+static void
+pui_account_view_style_set(GtkWidget *widget, GtkStyle *previous_style)
+{
+  GTK_WIDGET_CLASS(pui_account_view_parent_class)->style_set(
+    widget, previous_style);
+
+  /* status message colours come from the style */
+  row_clear(PUI_ACCOUNT_VIEW(widget));
+}
+
 static void
 pui_account_view_class_init(PuiAccountViewClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
 
   object_class->dispose = pui_account_view_dispose;
+  object_class->finalize = pui_account_view_finalize;
   object_class->set_property = pui_account_view_set_property;
 
   GTK_WIDGET_CLASS(klass)->size_request = pui_account_view_size_request;
+  GTK_WIDGET_CLASS(klass)->style_set = pui_account_view_style_set;
 
   g_object_class_install_property(
     object_class, PROP_MASTER,
@@ -203,11 +206,100 @@ pui_account_view_class_init(PuiAccountViewClass *klass)
       PUI_TYPE_MASTER, G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
 }
 
+static void
+row_build(PuiAccountViewRow *row, GtkWidget *widget)
+{
+  const gchar *name = row->display_name ? row->display_name : "";
+  GtkStyle *style;
+  PangoAttribute *attr;
+  guint start;
+
+  g_free(row->text);
+  row->text = NULL;
+
+  if (row->attrs)
+  {
+    pango_attr_list_unref(row->attrs);
+    row->attrs = NULL;
+  }
+
+  if (!row->status_message)
+  {
+    row->text = g_strdup(name);
+    return;
+  }
+
+  row->text = g_strconcat(name, "\n", row->status_message, NULL);
+  row->attrs = pango_attr_list_new();
+  start = strlen(name) + 1;
+
+  style = gtk_widget_get_style(widget);
+
+  if (style)
+  {
+    const char *color_name;
+    GdkColor color;
+
+    if (row->status_reason == 'r')
+      color_name = "SecondaryTextColor";
+    else
+      color_name = "AttentionColor";
+
+    if (!gtk_style_lookup_color(style, color_name, &color))
+    {
+      color.green = 0xFFFF;
+      color.red = 0xFFFF;
+      color.blue = 0xFFFF;
+    }
+
+    attr = pango_attr_foreground_new(color.red, color.green, color.blue);
+    attr->start_index = start;
+    attr->end_index = G_MAXUINT;
+    pango_attr_list_insert(row->attrs, attr);
+  }
+
+  attr = pango_attr_scale_new(PANGO_SCALE_X_SMALL);
+  attr->start_index = start;
+  attr->end_index = G_MAXUINT;
+  pango_attr_list_insert(row->attrs, attr);
+}
+
+static PuiAccountViewRow *
+row_get(PuiAccountView *view, TpAccount *account, gchar *status_message,
+        TpConnectionStatusReason status_reason)
+{
+  PuiAccountViewPrivate *priv = PRIVATE(view);
+  PuiAccountViewRow *row = g_hash_table_lookup(priv->rows, account);
+  const gchar *display_name =
+    pui_master_get_account_display_name(priv->master, account);
+
+  if (!row)
+  {
+    row = g_slice_new0(PuiAccountViewRow);
+    g_hash_table_insert(priv->rows, account, row);
+  }
+  else if (!g_strcmp0(row->display_name, display_name) &&
+           !g_strcmp0(row->status_message, status_message) &&
+           (row->status_reason == status_reason))
+  {
+    g_free(status_message);
+    return row;
+  }
+
+  g_free(row->display_name);
+  row->display_name = g_strdup(display_name);
+  g_free(row->status_message);
+  row->status_message = status_message;
+  row->status_reason = status_reason;
+  row_build(row, GTK_WIDGET(view));
+
+  return row;
+}
+
 static void
 account_data_func(GtkTreeViewColumn *tree_column, GtkCellRenderer *cell,
                   GtkTreeModel *tree_model, GtkTreeIter *iter, gpointer data)
 {
-  PuiAccountView *view = data;
   TpConnectionStatusReason status_reason;
   gchar *status_message;
   TpAccount *account;
@@ -220,61 +312,30 @@ account_data_func(GtkTreeViewColumn *tree_column, GtkCellRenderer *cell,
 
   if (account)
   {
-    PuiAccountViewPrivate *priv = PRIVATE(view);
-    const gchar *markup =
-      pui_master_get_account_display_name(priv->master, account);
-    gchar *s = NULL;
-
-    if (status_message)
-    {
-      GtkStyle *style = gtk_widget_get_style(
-          gtk_tree_view_column_get_tree_view(tree_column));
-      const char *color_name;
-      gchar *fgcolor;
-
-      if (status_reason == 'r')
-        color_name = "SecondaryTextColor";
-      else
-        color_name = "AttentionColor";
-
-      if (style)
-      {
-        GdkColor color;
-
-        if (!gtk_style_lookup_color(style, color_name, &color))
-        {
-          color.green = 0xFFFF;
-          color.red = 0xFFFF;
-          color.blue = 0xFFFF;
-        }
-
-        fgcolor = g_strdup_printf(
-            "foreground=\"#%02x%02x%02x\"",
-            color.red >> 8, color.green >> 8, color.blue >> 8);
-      }
-      else
-        fgcolor = g_strdup("");
-
-      s = g_strdup_printf("%s\n<span %s size=\"x-small\">%s</span>",
-                          markup, fgcolor, status_message);
-      g_free(status_message);
-      g_free(fgcolor);
-      markup = s;
-    }
-
-    g_object_set(cell, "markup", markup, NULL);
+    /* takes status_message */
+    PuiAccountViewRow *row =
+      row_get(data, account, status_message, status_reason);
+
+    g_object_set(cell,
+                 "text", row->text,
+                 "attributes", row->attrs,
+                 NULL);
     g_object_unref(account);
-    g_free(s);
   }
   else
-    g_object_set(cell, "text", _("pres_fi_accounts"), NULL);
+  {
+    g_free(status_message);
+    g_object_set(cell,
+                 "text", _("pres_fi_accounts"),
+                 "attributes", NULL,
+                 NULL);
+  }
 }
 
 static void
 presence_data_func(GtkTreeViewColumn *tree_column, GtkCellRenderer *cell,
                    GtkTreeModel *tree_model, GtkTreeIter *it, gpointer data)
 {
-  PuiAccountView *view = data;
   PuiAccountViewPrivate *priv = PRIVATE(data);
   GdkPixbuf *presence_icon;
   TpConnectionStatus connection_status;
@@ -286,29 +347,14 @@ presence_data_func(GtkTreeViewColumn *tree_column, GtkCellRenderer *cell,
 
   if (presence_icon)
   {
-    if (connection_status == TP_CONNECTION_STATUS_CONNECTING)
+    if ((connection_status == TP_CONNECTION_STATUS_CONNECTING) &&
+        pui_master_get_blink_phase(priv->master))
     {
-      priv->is_connecting = TRUE;
-
-      if (pui_master_get_display_on(priv->master))
-      {
-        if (!priv->timer_id)
-        {
-          priv->timer_id = g_timeout_add_seconds(
-              1, (GSourceFunc)refresh_connection_status_cb, view);
-          priv->show_offline_icon = FALSE;
-          priv->timer_id = priv->timer_id;
-        }
-      }
-
-      if (priv->show_offline_icon)
-      {
-        g_object_unref(presence_icon);
-        presence_icon = pui_master_get_icon(priv->master,
-                                            "general_presence_offline",
-                                            ICON_SIZE_MID);
-        g_object_ref(presence_icon);
-      }
+      g_object_unref(presence_icon);
+      presence_icon = pui_master_get_icon(priv->master,
+                                          "general_presence_offline",
+                                          ICON_SIZE_MID);
+      g_object_ref(presence_icon);
     }
 
     g_object_set(cell, "pixbuf", presence_icon, NULL);
@@ -325,6 +371,9 @@ pui_account_view_init(PuiAccountView *view)
   GtkCellRenderer *renderer;
   GtkTreeViewColumn *col;
 
+  priv->rows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                     row_free);
+
   gtk_tree_selection_set_mode(gtk_tree_view_get_selection(GTK_TREE_VIEW(view)),
                               GTK_SELECTION_NONE);
 
@@ -0,0 +1,2241 @@
+/*
+ * pui-accounts.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "pui-marshal.h"
+#include "pui-trace.h"
+#include "pui-wakeup.h"
+
+#include "pui-accounts.h"
+
+/* seconds to wait for telepathy to confirm a projected presence */
+#define PUI_PROVISIONAL_TIMEOUT 30
+
+/* avatars requested per idle callback during bulk account ingestion */
+#define PUI_AVATAR_BATCH 4
+
+struct _PuiAccountsPrivate
+{
+  TpDBusDaemon *dbus_daemon;
+  TpAccountManager *manager;
+  PuiCore *core;
+  PuiTrace *trace;
+  PuiSpans *spans;
+  gboolean started;
+  gboolean accounts_added;
+  gboolean disposed;
+  PuiAccountsWatchdogBeginFunc watchdog_begin;
+  PuiAccountsWatchdogEndFunc watchdog_end;
+  gpointer watchdog_data;
+  gchar *status_message;
+  int flags;
+  TpConnectionPresenceType global_presence_type;
+  guint global_status;
+  guint presence_supported_count;
+  GHashTable *bindings;
+  GQueue *rows;
+  GHashTable *connecting;
+  GHashTable *disconnected_accounts;
+  gboolean has_disconnected_account;
+  GHashTable *provisional;
+  guint provisional_timeout_id;
+  guint compute_global_presence_id;
+  guint64 recompute_span_id;
+  guint set_presence_id;
+  guint64 set_presence_span_id;
+  guint cms_list_idle_tag;
+  GQueue *avatar_queue;
+  guint avatar_queue_id;
+  gint64 tp_init_time;
+  gint64 startup_times[PUI_ACCOUNTS_STARTUP_N_PHASES];
+  PuiAccountsStats stats;
+  GHashTable *latencies;
+  PuiHistogram settle;
+  gint64 profile_change_time;
+  guint pending_requests;
+  /* pui_accounts_scan_profiles() results and the index + 1 of each profile
+   * in them */
+  GArray *profile_scans;
+  GHashTable *profile_scan_index;
+  gboolean profile_scans_valid;
+};
+
+typedef struct _PuiAccountsPrivate PuiAccountsPrivate;
+
+#define PRIVATE(self) \
+  ((PuiAccountsPrivate *) \
+   pui_accounts_get_instance_private((PuiAccounts *)(self)))
+
+G_DEFINE_TYPE_WITH_PRIVATE(
+  PuiAccounts,
+  pui_accounts,
+  G_TYPE_OBJECT
+);
+
+enum
+{
+  ROW_INSERTED,
+  ROW_CHANGED,
+  ROW_DELETED,
+  AVATAR_CHANGED,
+  PRESENCE_CHANGED,
+  PRESENCE_SUPPORT,
+  ACCOUNT_CONNECTED,
+  ACCOUNT_DISCONNECTED,
+  ACCOUNT_DISABLED,
+  CONNECTION_ERROR,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
+enum
+{
+  PROP_DBUS_DAEMON = 1
+};
+
+static void
+compute_global_presence_delayed(PuiAccounts *accounts);
+
+static void
+accounts_restart(PuiAccounts *accounts);
+
+struct _PuiWatchedCallback
+{
+  PuiAccounts *accounts;
+  const gchar *name;
+  GSourceFunc func;
+  gint64 start;
+};
+
+typedef struct _PuiWatchedCallback PuiWatchedCallback;
+
+static void
+watched_callback_free(gpointer data, GClosure *closure)
+{
+  g_slice_free(PuiWatchedCallback, data);
+}
+
+static gboolean
+watched_source_dispatch(gpointer user_data)
+{
+  PuiWatchedCallback *watched = user_data;
+  PuiAccountsPrivate *priv = PRIVATE(watched->accounts);
+  gint64 start = pui_wakeup_enter();
+  gboolean rv = watched->func(watched->accounts);
+
+  pui_wakeup_leave(watched->name, start);
+
+  if (priv->watchdog_end)
+    priv->watchdog_end(priv->watchdog_data, watched->name, start);
+
+  return rv;
+}
+
+static void
+watched_source_free(gpointer data)
+{
+  watched_callback_free(data, NULL);
+}
+
+/* Attaches source with func(accounts) as callback. All main loop sources of
+ * PuiAccounts go through here, so wakeup accounting and the watchdog see
+ * them. */
+static guint
+accounts_source_add(PuiAccounts *accounts, GSource *source, gint priority,
+                    const gchar *name, GSourceFunc func)
+{
+  PuiWatchedCallback *watched = g_slice_new0(PuiWatchedCallback);
+  guint id;
+
+  g_source_set_name(source, name);
+  g_source_set_priority(source, priority);
+
+  watched->accounts = accounts;
+  watched->name = name;
+  watched->func = func;
+  g_source_set_callback(source, watched_source_dispatch, watched,
+                        watched_source_free);
+
+  id = g_source_attach(source, NULL);
+  g_source_unref(source);
+
+  return id;
+}
+
+static guint
+accounts_idle_add(PuiAccounts *accounts, gint priority, const gchar *name,
+                  GSourceFunc func)
+{
+  return accounts_source_add(accounts, g_idle_source_new(), priority, name,
+                             func);
+}
+
+static guint
+accounts_timeout_add_seconds(PuiAccounts *accounts, guint interval,
+                             const gchar *name, GSourceFunc func)
+{
+  return accounts_source_add(accounts, g_timeout_source_new_seconds(interval),
+                             G_PRIORITY_DEFAULT, name, func);
+}
+
+static void
+watched_signal_pre(gpointer data, GClosure *closure)
+{
+  PuiWatchedCallback *watched = data;
+  PuiAccountsPrivate *priv = PRIVATE(watched->accounts);
+
+  watched->start = priv->watchdog_begin(priv->watchdog_data);
+}
+
+static void
+watched_signal_post(gpointer data, GClosure *closure)
+{
+  PuiWatchedCallback *watched = data;
+  PuiAccountsPrivate *priv = PRIVATE(watched->accounts);
+
+  priv->watchdog_end(priv->watchdog_data, watched->name, watched->start);
+}
+
+/* g_signal_connect() with accounts as user data, timed by the watchdog */
+static gulong
+accounts_signal_connect(PuiAccounts *accounts, gpointer instance,
+                        const gchar *signal, GCallback callback)
+{
+  PuiWatchedCallback *watched;
+  GClosure *closure;
+
+  if (!PRIVATE(accounts)->watchdog_begin)
+    return g_signal_connect(instance, signal, callback, accounts);
+
+  watched = g_slice_new0(PuiWatchedCallback);
+  watched->accounts = accounts;
+  watched->name = signal;
+
+  closure = g_cclosure_new(callback, accounts, NULL);
+  g_closure_add_marshal_guards(closure, watched, watched_signal_pre, watched,
+                               watched_signal_post);
+  g_closure_add_finalize_notifier(closure, watched, watched_callback_free);
+
+  return g_signal_connect_closure(instance, signal, closure, FALSE);
+}
+
+/* Everything PuiAccounts has on a TpAccount: the signal handlers, connected
+ * once no matter how many times the account gets enabled or the AM comes
+ * back, the row while the account is visible and the presence request in
+ * flight. The row comes first, so a binding is its row. */
+struct _PuiAccountBinding
+{
+  PuiAccountsRow row;
+  PuiAccounts *accounts;
+  gchar *id;
+  gulong handlers[6];
+  /* the link in priv->rows while the account is visible */
+  GList *link;
+  gint64 request_time;
+  gint64 activation_time;
+  TpConnectionPresenceType requested_type;
+  /* connected when the request started, only the presence tells it is done */
+  gboolean was_connected;
+};
+
+typedef struct _PuiAccountBinding PuiAccountBinding;
+
+static gint live_bindings = 0;
+
+static PuiAccountBinding *
+binding_lookup(PuiAccounts *accounts, const gchar *account_id)
+{
+  return g_hash_table_lookup(PRIVATE(accounts)->bindings, account_id);
+}
+
+static PuiAccountBinding *
+row_get_by_id(PuiAccounts *accounts, const char *account_id)
+{
+  PuiAccountBinding *binding = binding_lookup(accounts, account_id);
+
+  if (!binding || !binding->link)
+    return NULL;
+
+  return binding;
+}
+
+static PuiAccountBinding *
+row_get(PuiAccounts *accounts, TpAccount *account)
+{
+  PuiAccountBinding *binding =
+    binding_lookup(accounts, tp_account_get_path_suffix(account));
+
+  if (!binding || (binding->row.account != account) || !binding->link)
+    return NULL;
+
+  return binding;
+}
+
+static void
+row_changed(PuiAccounts *accounts, PuiAccountBinding *binding, guint changed)
+{
+  g_signal_emit(accounts, signals[ROW_CHANGED], 0, &binding->row, changed);
+}
+
+/* Keeps the set of rows in TP_CONNECTION_STATUS_CONNECTING in sync with
+ * their connection_status, so views can redraw just those. */
+static void
+connecting_set_update(PuiAccounts *accounts, PuiAccountBinding *binding,
+                      TpConnectionStatus status)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  if (status == TP_CONNECTION_STATUS_CONNECTING)
+    g_hash_table_add(priv->connecting, binding);
+  else
+    g_hash_table_remove(priv->connecting, binding);
+}
+
+struct _PuiAccountsLatency
+{
+  PuiHistogram activation;
+  PuiHistogram request;
+};
+
+typedef struct _PuiAccountsLatency PuiAccountsLatency;
+
+static void
+latency_free(gpointer data)
+{
+  g_slice_free(PuiAccountsLatency, data);
+}
+
+static PuiAccountsLatency *
+latency_get(PuiAccounts *accounts, TpAccount *account)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  const gchar *protocol = tp_account_get_protocol_name(account);
+  PuiAccountsLatency *latency = g_hash_table_lookup(priv->latencies, protocol);
+
+  if (!latency)
+  {
+    latency = g_slice_new0(PuiAccountsLatency);
+    g_hash_table_insert(priv->latencies, g_strdup(protocol), latency);
+  }
+
+  return latency;
+}
+
+static gboolean
+presence_type_is_offline(TpConnectionPresenceType type)
+{
+  return (type == TP_CONNECTION_PRESENCE_TYPE_UNSET) ||
+         (type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE);
+}
+
+static void
+request_start(PuiAccounts *accounts, TpAccount *account,
+              TpConnectionPresenceType type, gboolean activation)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiAccountBinding *binding =
+    binding_lookup(accounts, tp_account_get_path_suffix(account));
+
+  if (!binding || (binding->row.account != account))
+    return;
+
+  /* a new request supersedes the one in flight */
+  if (!binding->request_time)
+    priv->pending_requests++;
+
+  binding->request_time = g_get_monotonic_time();
+  binding->requested_type = type;
+  binding->activation_time = activation ? priv->profile_change_time : 0;
+  binding->was_connected = (tp_account_get_connection_status(account, NULL) ==
+                            TP_CONNECTION_STATUS_CONNECTED);
+}
+
+static void
+request_done(PuiAccountBinding *binding, gboolean success)
+{
+  PuiAccounts *accounts = binding->accounts;
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiAccountsLatency *latency = latency_get(accounts, binding->row.account);
+  gint64 now = g_get_monotonic_time();
+
+  if (success)
+  {
+    guint ms = (now - binding->request_time) / 1000;
+
+    pui_histogram_add(&latency->request, ms);
+
+    if (binding->activation_time)
+    {
+      pui_histogram_add(&latency->activation,
+                        (now - binding->activation_time) / 1000);
+    }
+
+    if (binding->link)
+    {
+      binding->row.connect_time = MAX(ms, 1);
+      row_changed(accounts, binding, PUI_ACCOUNTS_ROW_CONNECT_TIME);
+    }
+  }
+  else
+  {
+    pui_histogram_add_failure(&latency->request);
+
+    if (binding->activation_time)
+      pui_histogram_add_failure(&latency->activation);
+  }
+
+  binding->request_time = 0;
+  binding->activation_time = 0;
+  priv->pending_requests--;
+
+  if (!priv->pending_requests && priv->profile_change_time)
+  {
+    pui_histogram_add(&priv->settle,
+                      (now - priv->profile_change_time) / 1000);
+    priv->profile_change_time = 0;
+  }
+}
+
+/* completes the request in flight if account reached what it asked for */
+static void
+request_check(PuiAccounts *accounts, TpAccount *account,
+              TpConnectionPresenceType presence, TpConnectionStatus status,
+              TpConnectionStatusReason reason)
+{
+  PuiAccountBinding *binding =
+    binding_lookup(accounts, tp_account_get_path_suffix(account));
+
+  if (!binding || (binding->row.account != account) || !binding->request_time)
+    return;
+
+  if (presence_type_is_offline(binding->requested_type))
+  {
+    if (presence_type_is_offline(presence) ||
+        (status == TP_CONNECTION_STATUS_DISCONNECTED))
+    {
+      request_done(binding, TRUE);
+    }
+  }
+  else if ((presence == binding->requested_type) ||
+           ((status == TP_CONNECTION_STATUS_CONNECTED) &&
+            !binding->was_connected))
+  {
+    request_done(binding, TRUE);
+  }
+  else if ((status == TP_CONNECTION_STATUS_DISCONNECTED) &&
+           (reason != TP_CONNECTION_STATUS_REASON_REQUESTED))
+  {
+    request_done(binding, FALSE);
+  }
+}
+
+static void
+provisional_clear(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  g_hash_table_remove_all(priv->provisional);
+
+  if (priv->provisional_timeout_id)
+  {
+    g_source_remove(priv->provisional_timeout_id);
+    priv->provisional_timeout_id = 0;
+  }
+}
+
+/* Returns TRUE if account still waits for its projected presence, in which
+ * case type is replaced with the projected one */
+static gboolean
+provisional_lookup(PuiAccounts *accounts, TpAccount *account,
+                   TpConnectionStatus connection_status,
+                   TpConnectionPresenceType *type)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  const gchar *id = tp_account_get_path_suffix(account);
+  gpointer expected;
+
+  if (!g_hash_table_lookup_extended(priv->provisional, id, NULL, &expected))
+    return FALSE;
+
+  if ((connection_status != TP_CONNECTION_STATUS_CONNECTING) &&
+      (GPOINTER_TO_UINT(expected) == *type))
+  {
+    g_hash_table_remove(priv->provisional, id);
+    return FALSE;
+  }
+
+  *type = GPOINTER_TO_UINT(expected);
+
+  return TRUE;
+}
+
+static void
+provisional_remove(PuiAccounts *accounts, TpAccount *account)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  if (g_hash_table_remove(priv->provisional,
+                          tp_account_get_path_suffix(account)))
+  {
+    g_debug("Projected presence of %s rolled back",
+            tp_account_get_path_suffix(account));
+    compute_global_presence_delayed(accounts);
+  }
+}
+
+static void
+startup_mark(PuiAccounts *accounts, PuiAccountsStartupPhase phase)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  if (!priv->startup_times[phase])
+    priv->startup_times[phase] = g_get_monotonic_time();
+}
+
+static void
+presence_changed_emit(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  pui_spans_record(priv->spans, PUI_SPAN_BEGIN, "presence-changed", 0, NULL);
+  g_signal_emit(accounts, signals[PRESENCE_CHANGED], 0,
+                priv->global_presence_type, priv->status_message,
+                priv->global_status);
+  pui_spans_record(priv->spans, PUI_SPAN_END, "presence-changed", 0, NULL);
+}
+
+static gboolean
+compute_global_presence_idle(gpointer user_data)
+{
+  PuiAccounts *accounts = user_data;
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiCoreAggregate aggregate;
+  GList *l;
+
+  pui_spans_record(priv->spans, PUI_SPAN_ASYNC_END, "recompute-wait",
+                   priv->recompute_span_id, NULL);
+
+  /* stopped, a thin client shows what the owner tells it */
+  if (!priv->started)
+  {
+    priv->compute_global_presence_id = 0;
+    return FALSE;
+  }
+
+  pui_spans_record(priv->spans, PUI_SPAN_BEGIN, "recompute", 0, NULL);
+
+  priv->stats.recomputes++;
+  priv->global_status = PUI_MASTER_STATUS_NONE;
+  pui_core_aggregate_init(&aggregate);
+
+  for (l = priv->rows->head; l; l = l->next)
+  {
+    PuiAccountBinding *binding = l->data;
+    PuiAccountsRow *row = &binding->row;
+    PuiCoreAccountState old_state;
+    PuiCoreAccountState state;
+    guint changed;
+    guint flags;
+
+    old_state.presence_type = row->presence_type;
+    old_state.connection_status = row->connection_status;
+    old_state.status_reason = row->status_reason;
+    old_state.is_changing_status = row->is_changing_status;
+
+    priv->global_status |= PUI_MASTER_STATUS_ACCOUNTS;
+    priv->stats.rows_evaluated++;
+    flags = pui_core_evaluate_account(priv->core, row->account,
+                                      priv->status_message, &old_state,
+                                      &state, &priv->global_status);
+
+    if (flags & PUI_CORE_ACCOUNT_CONNECTED)
+      g_signal_emit(accounts, signals[ACCOUNT_CONNECTED], 0);
+
+    if (flags & PUI_CORE_ACCOUNT_DISCONNECTED)
+      g_signal_emit(accounts, signals[ACCOUNT_DISCONNECTED], 0);
+
+    if (provisional_lookup(accounts, row->account, state.connection_status,
+                           &state.presence_type))
+    {
+      priv->global_status |= PUI_MASTER_STATUS_PROVISIONAL;
+    }
+
+    connecting_set_update(accounts, binding, state.connection_status);
+
+    if (flags & PUI_CORE_ACCOUNT_STATUS_CHANGED)
+    {
+      changed = PUI_ACCOUNTS_ROW_PRESENCE | PUI_ACCOUNTS_ROW_STATUS |
+                PUI_ACCOUNTS_ROW_MESSAGE | PUI_ACCOUNTS_ROW_CHANGING;
+      row->status_reason = state.status_reason;
+      g_free(row->status_message);
+      row->status_message = state.status_message;
+      state.status_message = NULL;
+    }
+    else if ((old_state.presence_type == state.presence_type) &&
+             (old_state.connection_status == state.connection_status) &&
+             !old_state.is_changing_status)
+    {
+      changed = 0;
+    }
+    else
+    {
+      changed = PUI_ACCOUNTS_ROW_PRESENCE | PUI_ACCOUNTS_ROW_STATUS |
+                PUI_ACCOUNTS_ROW_CHANGING;
+    }
+
+    if (changed)
+    {
+      row->presence_type = state.presence_type;
+      row->connection_status = state.connection_status;
+      row->is_changing_status = FALSE;
+      row_changed(accounts, binding, changed);
+    }
+    else
+    {
+      /* nothing changed, do not make views redraw the row */
+      priv->stats.rows_unchanged++;
+    }
+
+    pui_core_aggregate_add(
+      &aggregate, state.presence_type, state.can_change_presence,
+      (state.connection_status == TP_CONNECTION_STATUS_CONNECTED) ||
+      (state.connection_status == TP_CONNECTION_STATUS_CONNECTING));
+
+    g_free(state.status_message);
+  }
+
+  priv->global_presence_type = pui_core_aggregate_get(&aggregate);
+
+  if (!g_hash_table_size(priv->provisional))
+    provisional_clear(accounts);
+
+  presence_changed_emit(accounts);
+
+  if ((priv->global_status & PUI_MASTER_STATUS_REASON_ERROR) &&
+      priv->has_disconnected_account)
+  {
+    priv->has_disconnected_account = FALSE;
+    g_signal_emit(accounts, signals[CONNECTION_ERROR], 0);
+  }
+
+  priv->compute_global_presence_id = 0;
+
+  if (priv->accounts_added)
+    startup_mark(accounts, PUI_ACCOUNTS_STARTUP_FIRST_RECOMPUTE);
+
+  pui_spans_record(priv->spans, PUI_SPAN_END, "recompute", 0, NULL);
+
+  return FALSE;
+}
+
+static void
+compute_global_presence_delayed(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  if (!priv->compute_global_presence_id)
+  {
+    priv->recompute_span_id = pui_spans_next_id(priv->spans);
+    pui_spans_record(priv->spans, PUI_SPAN_ASYNC_BEGIN, "recompute-wait",
+                     priv->recompute_span_id, NULL);
+    priv->compute_global_presence_id =
+      accounts_idle_add(accounts, G_PRIORITY_DEFAULT_IDLE, "recompute",
+                        compute_global_presence_idle);
+  }
+}
+
+/* the rows, the profiles or the connection managers changed */
+static void
+profile_scans_invalidate(PuiAccounts *accounts)
+{
+  PRIVATE(accounts)->profile_scans_valid = FALSE;
+}
+
+static void
+row_remove(PuiAccounts *accounts, PuiAccountBinding *binding)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  if (pui_core_account_can_change_presence(priv->core, binding->row.account))
+  {
+    priv->presence_supported_count--;
+
+    if (priv->presence_supported_count == 0)
+      g_signal_emit(accounts, signals[PRESENCE_SUPPORT], 0, FALSE);
+  }
+
+  g_queue_delete_link(priv->rows, binding->link);
+  binding->link = NULL;
+  g_hash_table_remove(priv->connecting, binding);
+  profile_scans_invalidate(accounts);
+
+  g_signal_emit(accounts, signals[ROW_DELETED], 0, &binding->row);
+  compute_global_presence_delayed(accounts);
+}
+
+static void
+on_account_disabled_cb(TpAccountManager *am, TpAccount *account,
+                       PuiAccounts *accounts)
+{
+  PuiAccountBinding *binding =
+    row_get_by_id(accounts, tp_account_get_path_suffix(account));
+
+  if (binding)
+    row_remove(accounts, binding);
+
+  g_signal_emit(accounts, signals[ACCOUNT_DISABLED], 0, account);
+}
+
+static void
+get_avatar_ready_cb(TpProxy *proxy, const GValue *out_Value,
+                    const GError *error, gpointer user_data,
+                    GObject *weak_object)
+{
+  if (error)
+  {
+    g_warning("%s: Could not get new avatar data %s", __FUNCTION__,
+              error->message);
+  }
+  else if (!G_VALUE_HOLDS(out_Value, TP_STRUCT_TYPE_AVATAR))
+  {
+    g_warning("%s: Avatar had wrong type: %s", __FUNCTION__,
+              G_VALUE_TYPE_NAME(out_Value));
+  }
+  else
+  {
+    PuiAccounts *accounts = PUI_ACCOUNTS(weak_object);
+    PuiAccountBinding *binding = row_get(accounts, (TpAccount *)proxy);
+    GValueArray *array = g_value_get_boxed(out_Value);
+    const GArray *avatar;
+    const gchar *mime_type;
+
+    tp_value_array_unpack(array, 2, &avatar, &mime_type);
+
+    if (binding)
+    {
+      g_signal_emit(accounts, signals[AVATAR_CHANGED], 0, &binding->row,
+                    avatar, mime_type);
+    }
+  }
+}
+
+static void
+avatar_changed_cb(TpAccount *account, gpointer user_data)
+{
+  PRIVATE(user_data)->stats.avatar_fetches++;
+  tp_cli_dbus_properties_call_get(
+    account, -1, TP_IFACE_ACCOUNT_INTERFACE_AVATAR, "Avatar",
+    get_avatar_ready_cb, NULL, NULL, user_data);
+}
+
+static void
+on_avatar_changed(TpAccount *account, PuiAccounts *accounts)
+{
+  pui_trace_record(PRIVATE(accounts)->trace, PUI_TRACE_AVATAR_CHANGED,
+                   tp_account_get_path_suffix(account), 0, 0, 0, NULL, NULL);
+  avatar_changed_cb(account, accounts);
+}
+
+static gboolean
+avatar_queue_idle(gpointer user_data)
+{
+  PuiAccounts *accounts = user_data;
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  int i;
+
+  for (i = 0; i < PUI_AVATAR_BATCH; i++)
+  {
+    TpAccount *account = g_queue_pop_head(priv->avatar_queue);
+
+    if (!account)
+      break;
+
+    avatar_changed_cb(account, accounts);
+    g_object_unref(account);
+  }
+
+  if (g_queue_is_empty(priv->avatar_queue))
+  {
+    priv->avatar_queue_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+avatar_queue_add(PuiAccounts *accounts, TpAccount *account)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  g_queue_push_tail(priv->avatar_queue, g_object_ref(account));
+
+  if (!priv->avatar_queue_id)
+  {
+    priv->avatar_queue_id = accounts_idle_add(accounts, G_PRIORITY_LOW,
+                                              "avatar-queue",
+                                              avatar_queue_idle);
+  }
+}
+
+static void
+avatar_queue_clear(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  if (priv->avatar_queue_id)
+  {
+    g_source_remove(priv->avatar_queue_id);
+    priv->avatar_queue_id = 0;
+  }
+
+  g_queue_foreach(priv->avatar_queue, (GFunc)g_object_unref, NULL);
+  g_queue_clear(priv->avatar_queue);
+}
+
+static gboolean
+account_is_visible(TpAccount *account)
+{
+  return tp_account_is_valid(account) &&
+         tp_account_is_enabled(account) &&
+         tp_account_get_has_been_online(account);
+}
+
+/* Does not request avatar nor recompute global presence, and leaves emitting
+ * presence-support to the caller */
+static void
+row_insert(PuiAccounts *accounts, TpAccount *account)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiAccountBinding *binding;
+  PuiAccountsRow *row;
+
+  binding = binding_lookup(accounts, tp_account_get_path_suffix(account));
+  g_return_if_fail(binding != NULL);
+
+  row = &binding->row;
+  row->presence_type = TP_CONNECTION_PRESENCE_TYPE_UNSET;
+  row->connection_status = tp_account_get_connection_status(account, NULL);
+  row->status_reason = TP_CONNECTION_STATUS_REASON_REQUESTED;
+  row->is_changing_status = FALSE;
+  g_free(row->status_message);
+  row->status_message = NULL;
+  row->connect_time = 0;
+
+  g_queue_push_tail(priv->rows, binding);
+  binding->link = priv->rows->tail;
+  profile_scans_invalidate(accounts);
+  g_signal_emit(accounts, signals[ROW_INSERTED], 0, row);
+
+  if (row->connection_status == TP_CONNECTION_STATUS_CONNECTED)
+    g_signal_emit(accounts, signals[ACCOUNT_CONNECTED], 0);
+
+  if (pui_core_account_can_change_presence(priv->core, account))
+    priv->presence_supported_count++;
+}
+
+static void
+row_add(PuiAccounts *accounts, TpAccount *account, gboolean set_presence)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  guint presence_supported_count = priv->presence_supported_count;
+
+  avatar_changed_cb(account, accounts);
+  row_insert(accounts, account);
+
+  if (!presence_supported_count && priv->presence_supported_count)
+    g_signal_emit(accounts, signals[PRESENCE_SUPPORT], 0, TRUE);
+
+  if (set_presence)
+    pui_accounts_set_account_presence(accounts, account, TRUE, TRUE);
+
+  compute_global_presence_delayed(accounts);
+}
+
+static void
+presence_changed_cb(TpAccount *account, guint presence, gchar *status,
+                    gchar *status_message, PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiAccountBinding *binding;
+
+  pui_trace_record(priv->trace, PUI_TRACE_PRESENCE_CHANGED,
+                   tp_account_get_path_suffix(account), presence, 0, 0,
+                   status, status_message);
+  pui_spans_record(priv->spans, PUI_SPAN_INSTANT, "account-presence-changed",
+                   0, tp_account_get_path_suffix(account));
+  request_check(accounts, account, presence,
+                tp_account_get_connection_status(account, NULL),
+                TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED);
+
+  binding = row_get(accounts, account);
+
+  if (binding)
+  {
+    binding->row.is_changing_status = TRUE;
+    row_changed(accounts, binding, PUI_ACCOUNTS_ROW_CHANGING);
+  }
+
+  compute_global_presence_delayed(accounts);
+}
+
+static void
+on_requested_presence_changed_cb(TpAccount *account, GParamSpec *pspec,
+                                 PuiAccounts *accounts)
+{
+  if (tp_account_get_connection_status(account, NULL) ==
+      TP_CONNECTION_STATUS_CONNECTING)
+  {
+    PuiAccountBinding *binding = row_get(accounts, account);
+
+    if (binding)
+    {
+      binding->row.is_changing_status = TRUE;
+      row_changed(accounts, binding, PUI_ACCOUNTS_ROW_CHANGING);
+    }
+
+    compute_global_presence_delayed(accounts);
+  }
+}
+
+static void
+status_changed_cb(TpAccount *account, guint old_status, guint new_status,
+                  guint reason, gchar *dbus_error_name, GHashTable *details,
+                  PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiAccountBinding *binding;
+
+  pui_trace_record(priv->trace, PUI_TRACE_STATUS_CHANGED,
+                   tp_account_get_path_suffix(account), old_status,
+                   new_status, reason, dbus_error_name, NULL);
+  pui_spans_record(priv->spans, PUI_SPAN_INSTANT, "account-status-changed",
+                   0, tp_account_get_path_suffix(account));
+  request_check(accounts, account,
+                tp_account_get_current_presence(account, NULL, NULL),
+                new_status, reason);
+
+  binding = row_get(accounts, account);
+
+  if (!binding)
+    return;
+
+  binding->row.is_changing_status = TRUE;
+  row_changed(accounts, binding, PUI_ACCOUNTS_ROW_CHANGING);
+
+  if ((reason != TP_CONNECTION_STATUS_REASON_REQUESTED) &&
+      (new_status == TP_CONNECTION_STATUS_DISCONNECTED))
+  {
+    const gchar *id = tp_account_get_path_suffix(account);
+
+    if (!g_hash_table_lookup(priv->disconnected_accounts, id))
+    {
+      g_hash_table_insert(priv->disconnected_accounts, g_strdup(id),
+                          GINT_TO_POINTER(1));
+      priv->has_disconnected_account = TRUE;
+    }
+
+    provisional_remove(accounts, account);
+  }
+
+  if ((reason == TP_CONNECTION_STATUS_REASON_REQUESTED) &&
+      (new_status == TP_CONNECTION_STATUS_DISCONNECTED))
+  {
+    g_hash_table_remove_all(priv->disconnected_accounts);
+  }
+
+  compute_global_presence_delayed(accounts);
+}
+
+static void
+on_property_changed(TpAccount *account, GParamSpec *pspec,
+                    PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiAccountBinding *binding;
+
+  if (priv->trace)
+  {
+    gboolean value = FALSE;
+
+    /* valid, enabled and has-been-online are all boolean */
+    g_object_get(account, pspec->name, &value, NULL);
+    pui_trace_record(priv->trace, PUI_TRACE_NOTIFY,
+                     tp_account_get_path_suffix(account), value, 0, 0,
+                     pspec->name, NULL);
+  }
+
+  binding = row_get_by_id(accounts, tp_account_get_path_suffix(account));
+
+  if (account_is_visible(account))
+  {
+    if (!binding)
+      row_add(accounts, account, TRUE);
+  }
+  else if (binding)
+    row_remove(accounts, binding);
+}
+
+static void
+on_valid_changed(TpAccount *account, GParamSpec *pspec,
+                 PuiAccounts *accounts)
+{
+  on_requested_presence_changed_cb(account, pspec, accounts);
+  on_property_changed(account, pspec, accounts);
+}
+
+static PuiAccountBinding *
+binding_new(PuiAccounts *accounts, TpAccount *account)
+{
+  PuiAccountBinding *binding = g_slice_new0(PuiAccountBinding);
+
+  binding->accounts = accounts;
+  binding->row.account = g_object_ref(account);
+  binding->id = g_strdup(tp_account_get_path_suffix(account));
+
+  binding->handlers[0] = accounts_signal_connect(
+      accounts, account, "presence-changed", G_CALLBACK(presence_changed_cb));
+  binding->handlers[1] = accounts_signal_connect(
+      accounts, account, "status-changed", G_CALLBACK(status_changed_cb));
+  binding->handlers[2] = accounts_signal_connect(
+      accounts, account, "avatar-changed", G_CALLBACK(on_avatar_changed));
+  binding->handlers[3] = accounts_signal_connect(
+      accounts, account, "notify::valid", G_CALLBACK(on_valid_changed));
+  binding->handlers[4] = accounts_signal_connect(
+      accounts, account, "notify::enabled", G_CALLBACK(on_property_changed));
+  binding->handlers[5] = accounts_signal_connect(
+      accounts, account, "notify::has-been-online",
+      G_CALLBACK(on_property_changed));
+
+  g_atomic_int_inc(&live_bindings);
+
+  return binding;
+}
+
+static void
+binding_free(gpointer data)
+{
+  PuiAccountBinding *binding = data;
+  PuiAccountsPrivate *priv = PRIVATE(binding->accounts);
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(binding->handlers); i++)
+    g_signal_handler_disconnect(binding->row.account, binding->handlers[i]);
+
+  /* the account went away with a request in flight, it never completes */
+  if (binding->request_time)
+    priv->pending_requests--;
+
+  g_hash_table_remove(priv->connecting, binding);
+
+  g_object_unref(binding->row.account);
+  g_free(binding->row.status_message);
+  g_free(binding->id);
+  g_slice_free(PuiAccountBinding, binding);
+
+  g_atomic_int_add(&live_bindings, -1);
+}
+
+static gboolean
+account_connect(PuiAccounts *accounts, TpAccount *account)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiAccountBinding *binding;
+
+  if (!strcmp(tp_account_get_protocol_name(account), "tel"))
+    return FALSE;
+
+  binding = binding_lookup(accounts, tp_account_get_path_suffix(account));
+
+  if (binding)
+  {
+    if (binding->row.account == account)
+      return TRUE;
+
+    /* AM gave us a new proxy for the same account */
+    if (binding->link)
+      row_remove(accounts, binding);
+
+    g_hash_table_remove(priv->bindings, binding->id);
+  }
+
+  g_debug("adding account %s", tp_account_get_path_suffix(account));
+
+  binding = binding_new(accounts, account);
+  g_hash_table_insert(priv->bindings, binding->id, binding);
+
+  return TRUE;
+}
+
+static void
+account_append(PuiAccounts *accounts, TpAccount *account,
+               gboolean set_presence)
+{
+  if (account_connect(accounts, account) && account_is_visible(account))
+    row_add(accounts, account, set_presence);
+}
+
+/* Initial population of the rows, both on startup and after AM restart.
+ * Avatars are fetched from a low priority idle and global presence is
+ * recomputed once for all of them. */
+static void
+accounts_append_bulk(PuiAccounts *accounts, GList *tp_accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  guint presence_supported_count = priv->presence_supported_count;
+  gint64 start = g_get_monotonic_time();
+  guint count = 0;
+  GList *l;
+
+  for (l = tp_accounts; l; l = l->next)
+  {
+    TpAccount *account = l->data;
+
+    if (account_connect(accounts, account) && account_is_visible(account))
+    {
+      row_insert(accounts, account);
+      avatar_queue_add(accounts, account);
+      count++;
+    }
+  }
+
+  if (!presence_supported_count && priv->presence_supported_count)
+    g_signal_emit(accounts, signals[PRESENCE_SUPPORT], 0, TRUE);
+
+  compute_global_presence_delayed(accounts);
+
+  g_debug("Added %u accounts in %" G_GINT64_FORMAT " us", count,
+          g_get_monotonic_time() - start);
+}
+
+static void
+on_account_enabled_cb(TpAccountManager *am, TpAccount *account,
+                      PuiAccounts *accounts)
+{
+  if (!row_get_by_id(accounts, tp_account_get_path_suffix(account)))
+  {
+    account_append(accounts, account, TRUE);
+    compute_global_presence_delayed(accounts);
+  }
+}
+
+static void
+on_account_removed_cb(TpAccountManager *am, TpAccount *account,
+                      PuiAccounts *accounts)
+{
+  PuiAccountBinding *binding;
+
+  on_account_disabled_cb(am, account, accounts);
+
+  binding = binding_lookup(accounts, tp_account_get_path_suffix(account));
+
+  if (binding && (binding->row.account == account))
+    g_hash_table_remove(PRIVATE(accounts)->bindings, binding->id);
+}
+
+static void
+on_account_validity_changed_cb(TpAccountManager *am, TpAccount *account,
+                               gboolean valid, PuiAccounts *accounts)
+{
+  if (valid)
+    on_account_enabled_cb(am, account, accounts);
+  else
+    on_account_disabled_cb(am, account, accounts);
+}
+
+static void
+on_list_cms_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  PuiAccounts *accounts = PUI_ACCOUNTS(user_data);
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  GError *error = NULL;
+  GList *cms = tp_list_connection_managers_finish(res, &error);
+  GList *l;
+
+  startup_mark(accounts, PUI_ACCOUNTS_STARTUP_CMS_LISTED);
+
+  if (error != NULL)
+  {
+    g_warning("Error getting list of CMs: %s", error->message);
+    g_error_free(error);
+  }
+  else if (!cms)
+    g_warning("No Telepathy connection managers found");
+
+  for (l = cms; l; l = l->next)
+  {
+    const char *cm_name = tp_connection_manager_get_name(l->data);
+
+    g_debug("Adding cm %s", cm_name);
+    g_hash_table_insert(priv->core->connection_managers, g_strdup(cm_name),
+                        l->data);
+  }
+
+  g_list_free(cms);
+  profile_scans_invalidate(accounts);
+
+  if (!priv->accounts_added)
+  {
+    GList *tp_accounts = tp_account_manager_dup_valid_accounts(priv->manager);
+
+    accounts_append_bulk(accounts, tp_accounts);
+    g_list_free_full(tp_accounts, g_object_unref);
+
+    priv->accounts_added = TRUE;
+    startup_mark(accounts, PUI_ACCOUNTS_STARTUP_ACCOUNTS_APPENDED);
+  }
+}
+
+static gboolean
+cms_list_idle(gpointer user_data)
+{
+  PuiAccountsPrivate *priv = PRIVATE(user_data);
+
+  priv->cms_list_idle_tag = 0;
+
+  g_debug("Getting connecton managers...");
+
+  tp_list_connection_managers_async(tp_proxy_get_dbus_daemon(priv->manager),
+                                    on_list_cms_ready_cb, user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+on_manager_ready(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  PuiAccounts *accounts = user_data;
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  GError *error = NULL;
+
+  if (!tp_proxy_prepare_finish(object, res, &error))
+  {
+    g_warning("Error preparing AM: %s\n", error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    g_debug("Account manager ready in %" G_GINT64_FORMAT " us",
+            g_get_monotonic_time() - priv->tp_init_time);
+    startup_mark(accounts, PUI_ACCOUNTS_STARTUP_AM_READY);
+
+    priv->cms_list_idle_tag = accounts_idle_add(accounts,
+                                                G_PRIORITY_DEFAULT_IDLE,
+                                                "cms-list", cms_list_idle);
+  }
+}
+
+static void
+accounts_tp_init(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  GQuark features[] = { TP_ACCOUNT_MANAGER_FEATURE_CORE, 0 };
+
+  accounts_signal_connect(accounts, priv->manager, "account-validity-changed",
+                          G_CALLBACK(on_account_validity_changed_cb));
+  accounts_signal_connect(accounts, priv->manager, "account-removed",
+                          G_CALLBACK(on_account_removed_cb));
+  accounts_signal_connect(accounts, priv->manager, "account-enabled",
+                          G_CALLBACK(on_account_enabled_cb));
+  accounts_signal_connect(accounts, priv->manager, "account-disabled",
+                          G_CALLBACK(on_account_disabled_cb));
+
+  g_debug("Waiting for account manager to become ready.");
+
+  priv->tp_init_time = g_get_monotonic_time();
+  tp_proxy_prepare_async(priv->manager, features, on_manager_ready, accounts);
+}
+
+static void
+on_account_manager_invalidate_cb(TpProxy *self, guint domain, gint code,
+                                 gchar *message, gpointer user_data)
+{
+  g_warning("Account manager invalid: %s", message);
+
+  accounts_restart(PUI_ACCOUNTS(user_data));
+}
+
+/* Everything PuiAccounts, the main view and the profile editor use from
+ * TpAccount (status, presence, flags, names and parameters) is covered by
+ * TP_ACCOUNT_FEATURE_CORE, avatars are fetched on demand. Do not let the
+ * default factory prepare connections and their features for every account. */
+static TpAccountManager *
+create_account_manager(PuiAccounts *accounts, TpDBusDaemon *dbus)
+{
+  TpSimpleClientFactory *factory = tp_simple_client_factory_new(dbus);
+  TpAccountManager *manager;
+
+  tp_simple_client_factory_add_account_features_varargs(
+    factory, TP_ACCOUNT_FEATURE_CORE, 0);
+  manager = tp_account_manager_new_with_factory(factory);
+  g_object_unref(factory);
+
+  g_signal_connect(manager, "invalidated",
+                   G_CALLBACK(on_account_manager_invalidate_cb), accounts);
+
+  return manager;
+}
+
+static void
+accounts_clear(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiAccountBinding *binding;
+
+  g_hash_table_remove_all(priv->disconnected_accounts);
+  g_hash_table_remove_all(priv->core->connection_managers);
+  profile_scans_invalidate(accounts);
+  provisional_clear(accounts);
+  avatar_queue_clear(accounts);
+
+  priv->accounts_added = FALSE;
+
+  if (priv->cms_list_idle_tag)
+  {
+    g_source_remove(priv->cms_list_idle_tag);
+    priv->cms_list_idle_tag = 0;
+  }
+
+  if (priv->compute_global_presence_id)
+  {
+    g_source_remove(priv->compute_global_presence_id);
+    priv->compute_global_presence_id = 0;
+  }
+
+  if (priv->set_presence_id)
+  {
+    g_source_remove(priv->set_presence_id);
+    priv->set_presence_id = 0;
+  }
+
+  /* the AM will tell again what is supported */
+  priv->presence_supported_count = 0;
+
+  while ((binding = g_queue_pop_head(priv->rows)))
+  {
+    binding->link = NULL;
+    g_hash_table_remove(priv->connecting, binding);
+    g_signal_emit(accounts, signals[ROW_DELETED], 0, &binding->row);
+  }
+
+  g_hash_table_remove_all(priv->bindings);
+
+  if (priv->manager)
+  {
+    g_signal_handlers_disconnect_by_func(
+          priv->manager, on_account_manager_invalidate_cb, accounts);
+    g_object_unref(priv->manager);
+    priv->manager = NULL;
+  }
+}
+
+static void
+accounts_restart(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  accounts_clear(accounts);
+  priv->manager = create_account_manager(accounts, priv->dbus_daemon);
+  accounts_tp_init(accounts);
+  compute_global_presence_delayed(accounts);
+}
+
+void
+pui_accounts_start(PuiAccounts *accounts)
+{
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  PRIVATE(accounts)->started = TRUE;
+  accounts_restart(accounts);
+}
+
+void
+pui_accounts_stop(PuiAccounts *accounts)
+{
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  PRIVATE(accounts)->started = FALSE;
+  accounts_clear(accounts);
+}
+
+void
+pui_accounts_name_owner_changed(PuiAccounts *accounts, const gchar *name,
+                                const gchar *old_owner,
+                                const gchar *new_owner)
+{
+  PuiAccountsPrivate *priv;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  priv = PRIVATE(accounts);
+
+  if (!g_strcmp0(name, TP_ACCOUNT_MANAGER_BUS_NAME))
+  {
+    pui_trace_record(priv->trace, PUI_TRACE_AM_OWNER_CHANGED, name,
+                     !!*old_owner, !!*new_owner, 0, NULL, NULL);
+  }
+  else if (g_str_has_prefix(name, TP_CM_BUS_NAME_BASE))
+  {
+    pui_trace_record(priv->trace, PUI_TRACE_CM_OWNER_CHANGED, name,
+                     !!*old_owner, !!*new_owner, 0, NULL, NULL);
+  }
+
+  /* did we lose account manager */
+  if (!g_strcmp0(name, TP_ACCOUNT_MANAGER_BUS_NAME) && !*new_owner &&
+      priv->manager)
+  {
+    priv->stats.name_owner_handled++;
+    g_warning("Account manager disappeared.");
+    accounts_restart(accounts);
+  }
+  /* if changed or is acquired */
+  else if (g_str_has_prefix(name, TP_CM_BUS_NAME_BASE) &&
+           (!*old_owner || (*old_owner && *new_owner)) &&
+           priv->accounts_added)
+  {
+    priv->stats.name_owner_handled++;
+    g_info("%s changed.", name);
+
+    if (priv->cms_list_idle_tag)
+      g_source_remove(priv->cms_list_idle_tag);
+
+    priv->cms_list_idle_tag = accounts_idle_add(accounts,
+                                                G_PRIORITY_DEFAULT_IDLE,
+                                                "cms-list", cms_list_idle);
+  }
+}
+
+void
+pui_accounts_set_status_message(PuiAccounts *accounts,
+                                const gchar *status_message)
+{
+  PuiAccountsPrivate *priv;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  priv = PRIVATE(accounts);
+  g_free(priv->status_message);
+  priv->status_message = g_strdup(status_message);
+}
+
+static gboolean
+set_presence_idle(gpointer user_data)
+{
+  PuiAccounts *accounts = user_data;
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  gboolean presence_set = FALSE;
+  GList *l;
+
+  pui_spans_record(priv->spans, PUI_SPAN_ASYNC_END, "set-presence-wait",
+                   priv->set_presence_span_id, NULL);
+  pui_spans_record(priv->spans, PUI_SPAN_BEGIN, "set-presence", 0, NULL);
+
+  for (l = priv->rows->head; l; l = l->next)
+  {
+    PuiAccountsRow *row = l->data;
+
+    if (pui_accounts_set_account_presence(accounts, row->account,
+                                          priv->flags & 2, priv->flags & 1))
+    {
+      presence_set = TRUE;
+    }
+  }
+
+  priv->flags &= ~3u;
+
+  /* activation with no account to change has nothing to wait for */
+  if (!priv->pending_requests && priv->profile_change_time)
+  {
+    pui_histogram_add(&priv->settle,
+                      (g_get_monotonic_time() - priv->profile_change_time) /
+                      1000);
+    priv->profile_change_time = 0;
+  }
+
+  if (!presence_set)
+    compute_global_presence_delayed(accounts);
+
+  priv->set_presence_id = 0;
+  pui_spans_record(priv->spans, PUI_SPAN_END, "set-presence", 0, NULL);
+
+  return FALSE;
+}
+
+void
+pui_accounts_request_presence(PuiAccounts *accounts, gboolean activation,
+                              gboolean message_changed)
+{
+  PuiAccountsPrivate *priv;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  priv = PRIVATE(accounts);
+
+  if (activation)
+    priv->flags |= 2;
+
+  if (message_changed)
+    priv->flags |= 1;
+
+  if (!priv->set_presence_id)
+  {
+    priv->set_presence_span_id = pui_spans_next_id(priv->spans);
+    pui_spans_record(priv->spans, PUI_SPAN_ASYNC_BEGIN, "set-presence-wait",
+                     priv->set_presence_span_id, NULL);
+    priv->set_presence_id =
+      accounts_idle_add(accounts, G_PRIORITY_DEFAULT_IDLE, "set-presence",
+                        set_presence_idle);
+  }
+}
+
+struct _PuiPresenceRequest
+{
+  PuiAccounts *accounts;
+  guint64 span_id;
+};
+
+typedef struct _PuiPresenceRequest PuiPresenceRequest;
+
+static void
+request_presence_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  PuiPresenceRequest *request = user_data;
+  PuiAccounts *accounts = request->accounts;
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  TpAccount *account = TP_ACCOUNT(object);
+  GError *error = NULL;
+
+  pui_spans_record(priv->spans, PUI_SPAN_ASYNC_END, "request-presence",
+                   request->span_id, tp_account_get_path_suffix(account));
+  g_slice_free(PuiPresenceRequest, request);
+
+  if (!tp_account_request_presence_finish(account, res, &error))
+  {
+    g_warning("Error requesting presence for %s: %s",
+              tp_account_get_path_suffix(account), error->message);
+    g_error_free(error);
+
+    if (!priv->disposed)
+    {
+      PuiAccountBinding *binding =
+        binding_lookup(accounts, tp_account_get_path_suffix(account));
+
+      provisional_remove(accounts, account);
+
+      if (binding && (binding->row.account == account) &&
+          binding->request_time)
+      {
+        request_done(binding, FALSE);
+      }
+    }
+  }
+  else if (!priv->disposed)
+  {
+    /* no change will be signalled if account already is where we want it */
+    request_check(accounts, account,
+                  tp_account_get_current_presence(account, NULL, NULL),
+                  tp_account_get_connection_status(account, NULL),
+                  TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED);
+  }
+
+  g_object_unref(accounts);
+}
+
+gboolean
+pui_accounts_set_account_presence(PuiAccounts *accounts, TpAccount *account,
+                                  gboolean activation,
+                                  gboolean message_changed)
+{
+  g_return_val_if_fail(PUI_IS_ACCOUNTS(accounts), FALSE);
+  g_return_val_if_fail(TP_IS_ACCOUNT(account), FALSE);
+
+  if (message_changed || activation)
+  {
+    PuiAccountsPrivate *priv = PRIVATE(accounts);
+    const gchar *status =
+      pui_profile_get_presence(priv->core->active_profile, account);
+    TpConnectionPresenceType type =
+      pui_core_get_presence_type(priv->core, account, status);
+    PuiPresenceRequest *request = g_slice_new(PuiPresenceRequest);
+
+    request->accounts = g_object_ref(accounts);
+    request->span_id = pui_spans_next_id(priv->spans);
+    pui_spans_record(priv->spans, PUI_SPAN_ASYNC_BEGIN, "request-presence",
+                     request->span_id, tp_account_get_path_suffix(account));
+
+    request_start(accounts, account, type, activation);
+    tp_account_request_presence_async(account, type, status,
+                                      priv->status_message,
+                                      request_presence_cb, request);
+    priv->stats.presence_requests++;
+
+    if ((type == TP_CONNECTION_PRESENCE_TYPE_UNSET) ||
+        (type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE))
+    {
+      if (tp_account_get_connect_automatically(account))
+      {
+        tp_account_set_connect_automatically_async(account, FALSE, NULL, NULL);
+        priv->stats.presence_requests++;
+      }
+    }
+    else
+    {
+      tp_account_set_automatic_presence_async(account, type, status,
+                                              priv->status_message, NULL, NULL);
+      priv->stats.presence_requests++;
+
+      if (!tp_account_get_connect_automatically(account))
+      {
+        tp_account_set_connect_automatically_async(account, TRUE, NULL, NULL);
+        priv->stats.presence_requests++;
+      }
+    }
+
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+provisional_timeout_cb(gpointer user_data)
+{
+  PuiAccounts *accounts = user_data;
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  priv->provisional_timeout_id = 0;
+
+  if (g_hash_table_size(priv->provisional))
+  {
+    g_debug("Projected presence timed out, rolling back");
+    g_hash_table_remove_all(priv->provisional);
+    compute_global_presence_delayed(accounts);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Write the presence we expect after activating the active profile to the
+ * rows, so UI shows it immediately rather than after telepathy round-trips.
+ * compute_global_presence_idle() keeps the projection until real state
+ * matches it, it fails or PUI_PROVISIONAL_TIMEOUT expires. */
+static void
+provisional_project(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  PuiCoreAggregate aggregate;
+  GList *l;
+
+  provisional_clear(accounts);
+  pui_core_aggregate_init(&aggregate);
+
+  if (!priv->rows->head)
+    return;
+
+  for (l = priv->rows->head; l; l = l->next)
+  {
+    PuiAccountBinding *binding = l->data;
+    TpAccount *account = binding->row.account;
+    TpConnectionPresenceType type;
+    const gchar *presence;
+    gboolean can_change_presence;
+
+    can_change_presence =
+      pui_core_account_can_change_presence(priv->core, account);
+    presence = pui_profile_get_presence(priv->core->active_profile, account);
+    type = pui_core_get_presence_type(priv->core, account, presence);
+
+    if (!can_change_presence && (type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE))
+      type = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
+
+    if (type != binding->row.presence_type)
+    {
+      g_hash_table_insert(priv->provisional,
+                          g_strdup(tp_account_get_path_suffix(account)),
+                          GUINT_TO_POINTER(type));
+      binding->row.presence_type = type;
+      row_changed(accounts, binding, PUI_ACCOUNTS_ROW_PRESENCE);
+    }
+
+    pui_core_aggregate_add(&aggregate, type, can_change_presence,
+                           type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE);
+  }
+
+  if (!g_hash_table_size(priv->provisional))
+    return;
+
+  priv->global_presence_type = pui_core_aggregate_get(&aggregate);
+  priv->global_status &= PUI_MASTER_STATUS_CONNECTED |
+                         PUI_MASTER_STATUS_CONNECTING |
+                         PUI_MASTER_STATUS_ACCOUNTS;
+  priv->global_status |= PUI_MASTER_STATUS_PROVISIONAL;
+  priv->provisional_timeout_id =
+    accounts_timeout_add_seconds(accounts, PUI_PROVISIONAL_TIMEOUT,
+                                 "provisional-timeout",
+                                 provisional_timeout_cb);
+
+  presence_changed_emit(accounts);
+}
+
+void
+pui_accounts_profile_activated(PuiAccounts *accounts)
+{
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  PRIVATE(accounts)->profile_change_time = g_get_monotonic_time();
+  provisional_project(accounts);
+}
+
+void
+pui_accounts_recompute(PuiAccounts *accounts)
+{
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  compute_global_presence_delayed(accounts);
+}
+
+void
+pui_accounts_get_global_presence(PuiAccounts *accounts,
+                                 TpConnectionPresenceType *presence_type,
+                                 guint *status)
+{
+  PuiAccountsPrivate *priv;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  priv = PRIVATE(accounts);
+
+  if (presence_type)
+    *presence_type = priv->global_presence_type;
+
+  if (status)
+    *status = priv->global_status;
+}
+
+const GList *
+pui_accounts_get_rows(PuiAccounts *accounts)
+{
+  g_return_val_if_fail(PUI_IS_ACCOUNTS(accounts), NULL);
+
+  return PRIVATE(accounts)->rows->head;
+}
+
+void
+pui_accounts_foreach_connecting(PuiAccounts *accounts,
+                                PuiAccountsRowFunc func, gpointer user_data)
+{
+  GHashTableIter iter;
+  gpointer binding;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  g_hash_table_iter_init(&iter, PRIVATE(accounts)->connecting);
+
+  while (g_hash_table_iter_next(&iter, &binding, NULL))
+    func(&((PuiAccountBinding *)binding)->row, user_data);
+}
+
+guint
+pui_accounts_get_n_connecting(PuiAccounts *accounts)
+{
+  g_return_val_if_fail(PUI_IS_ACCOUNTS(accounts), 0);
+
+  return g_hash_table_size(PRIVATE(accounts)->connecting);
+}
+
+gboolean
+pui_accounts_is_presence_supported(PuiAccounts *accounts)
+{
+  g_return_val_if_fail(PUI_IS_ACCOUNTS(accounts), FALSE);
+
+  return PRIVATE(accounts)->presence_supported_count > 0;
+}
+
+PuiSpans *
+pui_accounts_get_spans(PuiAccounts *accounts)
+{
+  g_return_val_if_fail(PUI_IS_ACCOUNTS(accounts), NULL);
+
+  return PRIVATE(accounts)->spans;
+}
+
+void
+pui_accounts_set_watchdog(PuiAccounts *accounts,
+                          PuiAccountsWatchdogBeginFunc begin,
+                          PuiAccountsWatchdogEndFunc end,
+                          gpointer user_data)
+{
+  PuiAccountsPrivate *priv;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+  g_return_if_fail((begin == NULL) == (end == NULL));
+
+  priv = PRIVATE(accounts);
+  priv->watchdog_begin = begin;
+  priv->watchdog_end = end;
+  priv->watchdog_data = user_data;
+}
+
+static void
+profile_scans_build(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+  GList *profiles = priv->core->profiles;
+  PuiCoreAggregate *aggregates;
+  PuiAccountsProfileScan *scan;
+  GList *r;
+  GList *l;
+  guint i;
+
+  g_array_set_size(priv->profile_scans, g_list_length(profiles));
+  g_hash_table_remove_all(priv->profile_scan_index);
+  aggregates = g_new(PuiCoreAggregate, priv->profile_scans->len);
+
+  for (l = profiles, i = 0; l; l = l->next, i++)
+  {
+    scan = &g_array_index(priv->profile_scans, PuiAccountsProfileScan, i);
+    scan->profile = l->data;
+    scan->no_sip_in_profile = FALSE;
+    pui_core_aggregate_init(&aggregates[i]);
+    g_hash_table_insert(priv->profile_scan_index, l->data,
+                        GUINT_TO_POINTER(i + 1));
+  }
+
+  for (r = priv->rows->head; r; r = r->next)
+  {
+    TpAccount *account = ((PuiAccountsRow *)r->data)->account;
+    gboolean can_change_presence;
+    gboolean not_sip;
+
+    /* the same for every profile */
+    can_change_presence =
+      pui_core_account_can_change_presence(priv->core, account);
+    not_sip = pui_core_account_is_not_sip(account);
+
+    for (l = profiles, i = 0; l; l = l->next, i++)
+    {
+      TpConnectionPresenceType presence_type = pui_core_get_presence_type(
+          priv->core, account, pui_profile_get_presence(l->data, account));
+
+      scan = &g_array_index(priv->profile_scans, PuiAccountsProfileScan, i);
+
+      if (not_sip && (presence_type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE))
+        scan->no_sip_in_profile = TRUE;
+
+      pui_core_aggregate_add(
+        &aggregates[i], presence_type, can_change_presence,
+        presence_type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE);
+    }
+  }
+
+  for (i = 0; i < priv->profile_scans->len; i++)
+  {
+    scan = &g_array_index(priv->profile_scans, PuiAccountsProfileScan, i);
+    scan->aggregate_presence = pui_core_aggregate_get(&aggregates[i]);
+  }
+
+  g_free(aggregates);
+  priv->profile_scans_valid = TRUE;
+  priv->stats.profile_scans++;
+}
+
+const PuiAccountsProfileScan *
+pui_accounts_scan_profiles(PuiAccounts *accounts, guint *n_profiles)
+{
+  PuiAccountsPrivate *priv;
+
+  g_return_val_if_fail(PUI_IS_ACCOUNTS(accounts), NULL);
+
+  priv = PRIVATE(accounts);
+
+  if (!priv->profile_scans_valid)
+    profile_scans_build(accounts);
+
+  if (n_profiles)
+    *n_profiles = priv->profile_scans->len;
+
+  return (const PuiAccountsProfileScan *)priv->profile_scans->data;
+}
+
+void
+pui_accounts_invalidate_profile_scans(PuiAccounts *accounts)
+{
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  profile_scans_invalidate(accounts);
+}
+
+void
+pui_accounts_scan_profile(PuiAccounts *accounts, PuiProfile *profile,
+                          gboolean *no_sip_in_profile,
+                          TpConnectionPresenceType *aggregate_presence)
+{
+  PuiAccountsPrivate *priv;
+  PuiCoreAggregate aggregate;
+  GList *l;
+  guint idx;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  priv = PRIVATE(accounts);
+
+  pui_accounts_scan_profiles(accounts, NULL);
+  idx = GPOINTER_TO_UINT(g_hash_table_lookup(priv->profile_scan_index,
+                                             profile));
+
+  if (idx)
+  {
+    const PuiAccountsProfileScan *scan =
+      &g_array_index(priv->profile_scans, PuiAccountsProfileScan, idx - 1);
+
+    if (no_sip_in_profile)
+      *no_sip_in_profile = scan->no_sip_in_profile;
+
+    if (aggregate_presence)
+      *aggregate_presence = scan->aggregate_presence;
+
+    return;
+  }
+
+  /* not one of ours, a profile being edited for example */
+  if (no_sip_in_profile)
+    *no_sip_in_profile = FALSE;
+
+  pui_core_aggregate_init(&aggregate);
+
+  for (l = priv->rows->head; l; l = l->next)
+  {
+    TpAccount *account = ((PuiAccountsRow *)l->data)->account;
+    TpConnectionPresenceType presence_type;
+
+    presence_type = pui_core_get_presence_type(
+        priv->core, account, pui_profile_get_presence(profile, account));
+
+    if (no_sip_in_profile &&
+        (presence_type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE) &&
+        pui_core_account_is_not_sip(account))
+    {
+      *no_sip_in_profile = TRUE;
+    }
+
+    pui_core_aggregate_add(
+      &aggregate, presence_type,
+      pui_core_account_can_change_presence(priv->core, account),
+      presence_type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE);
+  }
+
+  if (aggregate_presence)
+    *aggregate_presence = pui_core_aggregate_get(&aggregate);
+}
+
+void
+pui_accounts_get_stats(PuiAccounts *accounts, PuiAccountsStats *stats)
+{
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  *stats = PRIVATE(accounts)->stats;
+}
+
+void
+pui_accounts_latency_foreach(PuiAccounts *accounts,
+                             PuiAccountsLatencyFunc func, gpointer user_data)
+{
+  PuiAccountsPrivate *priv;
+  GHashTableIter iter;
+  gpointer protocol;
+  gpointer latency;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  priv = PRIVATE(accounts);
+
+  g_hash_table_iter_init(&iter, priv->latencies);
+
+  while (g_hash_table_iter_next(&iter, &protocol, &latency))
+  {
+    func("request", protocol, &((PuiAccountsLatency *)latency)->request,
+         user_data);
+    func("activation", protocol,
+         &((PuiAccountsLatency *)latency)->activation, user_data);
+  }
+
+  func("settle", NULL, &priv->settle, user_data);
+}
+
+void
+_pui_accounts_compute_global_presence(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  priv = PRIVATE(accounts);
+
+  if (priv->compute_global_presence_id)
+    g_source_remove(priv->compute_global_presence_id);
+
+  compute_global_presence_idle(accounts);
+}
+
+const gint64 *
+_pui_accounts_get_startup_times(PuiAccounts *accounts)
+{
+  g_return_val_if_fail(PUI_IS_ACCOUNTS(accounts), NULL);
+
+  return PRIVATE(accounts)->startup_times;
+}
+
+static gsize
+type_size(GType type)
+{
+  GTypeQuery query;
+
+  g_type_query(type, &query);
+
+  return query.instance_size;
+}
+
+static guint
+count_handlers(gpointer instance, PuiAccounts *accounts)
+{
+  guint n = g_signal_handlers_block_matched(instance, G_SIGNAL_MATCH_DATA, 0,
+                                            0, NULL, NULL, accounts);
+
+  g_signal_handlers_unblock_matched(instance, G_SIGNAL_MATCH_DATA, 0, 0, NULL,
+                                    NULL, accounts);
+
+  return n;
+}
+
+void
+_pui_accounts_get_memory(PuiAccounts *accounts, PuiAccountsMemory *memory)
+{
+  PuiAccountsPrivate *priv;
+  guint n_cms;
+
+  g_return_if_fail(PUI_IS_ACCOUNTS(accounts));
+
+  priv = PRIVATE(accounts);
+  memset(memory, 0, sizeof(*memory));
+
+  if (priv->manager)
+  {
+    GList *tp_accounts = tp_account_manager_dup_valid_accounts(priv->manager);
+    GList *l;
+
+    memory->n_tp_proxies++;
+    memory->tp_proxies += type_size(G_OBJECT_TYPE(priv->manager));
+    memory->signal_handlers += count_handlers(priv->manager, accounts);
+
+    for (l = tp_accounts; l; l = l->next)
+    {
+      memory->n_tp_proxies++;
+      memory->tp_proxies += type_size(G_OBJECT_TYPE(l->data));
+      memory->signal_handlers += count_handlers(l->data, accounts);
+    }
+
+    g_list_free_full(tp_accounts, g_object_unref);
+  }
+
+  n_cms = g_hash_table_size(priv->core->connection_managers);
+  memory->n_bindings = g_hash_table_size(priv->bindings);
+  memory->n_tp_proxies += n_cms;
+  memory->tp_proxies += n_cms * type_size(TP_TYPE_CONNECTION_MANAGER);
+}
+
+guint
+_pui_accounts_get_live_bindings(void)
+{
+  return g_atomic_int_get(&live_bindings);
+}
+
+static void
+pui_accounts_set_property(GObject *object, guint property_id,
+                          const GValue *value, GParamSpec *pspec)
+{
+  switch (property_id)
+  {
+    case PROP_DBUS_DAEMON:
+    {
+      PuiAccountsPrivate *priv = PRIVATE(object);
+
+      g_assert(priv->dbus_daemon == NULL);
+
+      priv->dbus_daemon = g_value_dup_object(value);
+      break;
+    }
+    default:
+    {
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+      break;
+    }
+  }
+}
+
+static void
+pui_accounts_dispose(GObject *object)
+{
+  PuiAccountsPrivate *priv = PRIVATE(object);
+
+  if (!priv->disposed)
+  {
+    priv->disposed = TRUE;
+    pui_accounts_stop(PUI_ACCOUNTS(object));
+
+    if (priv->provisional_timeout_id)
+    {
+      g_source_remove(priv->provisional_timeout_id);
+      priv->provisional_timeout_id = 0;
+    }
+
+    if (priv->dbus_daemon)
+    {
+      g_object_unref(priv->dbus_daemon);
+      priv->dbus_daemon = NULL;
+    }
+  }
+
+  G_OBJECT_CLASS(pui_accounts_parent_class)->dispose(object);
+}
+
+static void
+pui_accounts_finalize(GObject *object)
+{
+  PuiAccountsPrivate *priv = PRIVATE(object);
+
+  pui_trace_close(priv->trace);
+  pui_spans_free(priv->spans);
+  g_free(priv->status_message);
+
+  g_hash_table_destroy(priv->provisional);
+  g_hash_table_destroy(priv->bindings);
+  g_hash_table_destroy(priv->connecting);
+  g_hash_table_destroy(priv->disconnected_accounts);
+  g_hash_table_destroy(priv->latencies);
+  g_hash_table_destroy(priv->profile_scan_index);
+  g_array_free(priv->profile_scans, TRUE);
+  g_queue_free(priv->avatar_queue);
+  g_queue_free(priv->rows);
+
+  G_OBJECT_CLASS(pui_accounts_parent_class)->finalize(object);
+}
+
+static void
+pui_accounts_class_init(PuiAccountsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->dispose = pui_accounts_dispose;
+  object_class->finalize = pui_accounts_finalize;
+  object_class->set_property = pui_accounts_set_property;
+
+  g_object_class_install_property(
+    object_class, PROP_DBUS_DAEMON,
+    g_param_spec_object(
+      "dbus-daemon", "dbus-daemon", "dbus-daemon", TP_TYPE_DBUS_DAEMON,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
+
+  signals[ROW_INSERTED] = g_signal_new(
+      "row-inserted", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL,
+      NULL, g_cclosure_marshal_VOID__POINTER, G_TYPE_NONE, 1, G_TYPE_POINTER);
+  signals[ROW_CHANGED] = g_signal_new(
+      "row-changed", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL,
+      NULL, pui_signal_marshal_VOID__POINTER_UINT, G_TYPE_NONE, 2,
+      G_TYPE_POINTER, G_TYPE_UINT);
+  signals[ROW_DELETED] = g_signal_new(
+      "row-deleted", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL,
+      NULL, g_cclosure_marshal_VOID__POINTER, G_TYPE_NONE, 1, G_TYPE_POINTER);
+  signals[AVATAR_CHANGED] = g_signal_new(
+      "avatar-changed", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL,
+      NULL, pui_signal_marshal_VOID__POINTER_POINTER_STRING, G_TYPE_NONE, 3,
+      G_TYPE_POINTER, G_TYPE_POINTER, G_TYPE_STRING);
+  signals[PRESENCE_CHANGED] = g_signal_new(
+      "presence-changed", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+      0, NULL, NULL, pui_signal_marshal_VOID__UINT_STRING_UINT, G_TYPE_NONE,
+      3, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_UINT);
+  signals[PRESENCE_SUPPORT] = g_signal_new(
+      "presence-support", G_TYPE_FROM_CLASS(klass),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+      g_cclosure_marshal_VOID__BOOLEAN, G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+  signals[ACCOUNT_CONNECTED] = g_signal_new(
+      "account-connected", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0,
+      NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+  signals[ACCOUNT_DISCONNECTED] = g_signal_new(
+      "account-disconnected", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0,
+      NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+  signals[ACCOUNT_DISABLED] = g_signal_new(
+      "account-disabled", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0,
+      NULL, NULL, g_cclosure_marshal_VOID__OBJECT, G_TYPE_NONE, 1,
+      TP_TYPE_ACCOUNT);
+  signals[CONNECTION_ERROR] = g_signal_new(
+      "connection-error", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0,
+      NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+}
+
+static void
+pui_accounts_init(PuiAccounts *accounts)
+{
+  PuiAccountsPrivate *priv = PRIVATE(accounts);
+
+  priv->global_presence_type = TP_CONNECTION_PRESENCE_TYPE_UNSET;
+  priv->flags |= 3;
+
+  priv->disconnected_accounts = g_hash_table_new_full((GHashFunc)g_str_hash,
+                                                      (GEqualFunc)g_str_equal,
+                                                      (GDestroyNotify)g_free,
+                                                      NULL);
+  priv->bindings = g_hash_table_new_full((GHashFunc)g_str_hash,
+                                         (GEqualFunc)g_str_equal,
+                                         NULL, binding_free);
+  priv->rows = g_queue_new();
+  priv->connecting = g_hash_table_new(g_direct_hash, g_direct_equal);
+  priv->profile_scans = g_array_new(FALSE, FALSE,
+                                    sizeof(PuiAccountsProfileScan));
+  priv->profile_scan_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+  priv->latencies = g_hash_table_new_full((GHashFunc)g_str_hash,
+                                         (GEqualFunc)g_str_equal,
+                                         (GDestroyNotify)g_free,
+                                         latency_free);
+  priv->provisional = g_hash_table_new_full((GHashFunc)g_str_hash,
+                                            (GEqualFunc)g_str_equal,
+                                            (GDestroyNotify)g_free,
+                                            NULL);
+  priv->avatar_queue = g_queue_new();
+
+  priv->trace = pui_trace_new_from_env();
+  priv->spans = pui_spans_new_from_env();
+}
+
+PuiAccounts *
+pui_accounts_new(TpDBusDaemon *dbus_daemon, PuiCore *core)
+{
+  PuiAccounts *accounts;
+
+  g_return_val_if_fail(core != NULL, NULL);
+
+  accounts = g_object_new(PUI_TYPE_ACCOUNTS, "dbus-daemon", dbus_daemon,
+                          NULL);
+  PRIVATE(accounts)->core = core;
+
+  return accounts;
+}
@@ -0,0 +1,285 @@
+/*
+ * pui-accounts.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PUI_ACCOUNTS_H_INCLUDED__
+#define __PUI_ACCOUNTS_H_INCLUDED__
+
+#include "pui-core.h"
+#include "pui-histogram.h"
+#include "pui-span.h"
+
+G_BEGIN_DECLS
+
+/* Tracks the accounts of the AM without GTK: keeps a row of state for every
+ * visible account, recomputes global presence from the rows and requests
+ * the presence of the active profile. PuiMaster shows the rows in its list
+ * store, anything headless follows the signals:
+ *   "row-inserted", "row-deleted" (PuiAccountsRow *row)
+ *   "row-changed" (PuiAccountsRow *row, guint PUI_ACCOUNTS_ROW_* mask)
+ *   "avatar-changed" (PuiAccountsRow *row, GArray *data, gchar *mime_type)
+ *   "presence-changed" (guint presence_type, gchar *status_message,
+ *                       guint status)
+ *   "presence-support" (gboolean supported)
+ *   "account-connected", "account-disconnected"
+ *   "account-disabled" (TpAccount *account), after its row is deleted
+ *   "connection-error", an account disconnected with an error */
+
+#define PUI_TYPE_ACCOUNTS \
+                (pui_accounts_get_type ())
+#define PUI_ACCOUNTS(obj) \
+                (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                 PUI_TYPE_ACCOUNTS, \
+                 PuiAccounts))
+#define PUI_ACCOUNTS_CLASS(cls) \
+                (G_TYPE_CHECK_CLASS_CAST ((cls), \
+                 PUI_TYPE_ACCOUNTS, \
+                 PuiAccountsClass))
+#define PUI_IS_ACCOUNTS(obj) \
+                (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                 PUI_TYPE_ACCOUNTS))
+#define PUI_IS_ACCOUNTS_CLASS(obj) \
+                (G_TYPE_CHECK_CLASS_TYPE ((obj), \
+                 PUI_TYPE_ACCOUNTS))
+#define PUI_ACCOUNTS_GET_CLASS(obj) \
+                (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+                 PUI_TYPE_ACCOUNTS, \
+                 PuiAccountsClass))
+
+struct _PuiAccounts
+{
+  GObject parent;
+};
+
+typedef struct _PuiAccounts PuiAccounts;
+
+struct _PuiAccountsClass
+{
+  GObjectClass parent_class;
+};
+
+typedef struct _PuiAccountsClass PuiAccountsClass;
+
+/* What changed in a row, see "row-changed" */
+enum
+{
+  PUI_ACCOUNTS_ROW_PRESENCE = 1 << 0,
+  PUI_ACCOUNTS_ROW_STATUS = 1 << 1,
+  /* status_reason and status_message */
+  PUI_ACCOUNTS_ROW_MESSAGE = 1 << 2,
+  PUI_ACCOUNTS_ROW_CHANGING = 1 << 3,
+  PUI_ACCOUNTS_ROW_CONNECT_TIME = 1 << 4
+};
+
+/* A visible account, valid from "row-inserted" until "row-deleted" */
+struct _PuiAccountsRow
+{
+  TpAccount *account;
+  TpConnectionPresenceType presence_type;
+  TpConnectionStatus connection_status;
+  TpConnectionStatusReason status_reason;
+  gboolean is_changing_status;
+  gchar *status_message;
+  /* ms the last presence request took to complete, 0 if none did */
+  guint connect_time;
+};
+
+typedef struct _PuiAccountsRow PuiAccountsRow;
+
+typedef void (*PuiAccountsRowFunc)(PuiAccountsRow *row, gpointer user_data);
+
+GType
+pui_accounts_get_type(void) G_GNUC_CONST;
+
+/* core is the caller's and must outlive the returned object */
+PuiAccounts *
+pui_accounts_new(TpDBusDaemon *dbus_daemon, PuiCore *core);
+
+/* (Re)creates the AM proxy and loads its accounts */
+void
+pui_accounts_start(PuiAccounts *accounts);
+
+/* Drops the AM and every account, deleting all rows */
+void
+pui_accounts_stop(PuiAccounts *accounts);
+
+/* NameOwnerChanged of the AM or a CM, restarts or relists what went away */
+void
+pui_accounts_name_owner_changed(PuiAccounts *accounts, const gchar *name,
+                                const gchar *old_owner,
+                                const gchar *new_owner);
+
+/* the message presence requests carry, NULL for none */
+void
+pui_accounts_set_status_message(PuiAccounts *accounts,
+                                const gchar *status_message);
+
+/* Requests the presence of the active profile for all accounts, from idle.
+ * activation tells the profile was just activated, message_changed that
+ * the status message was. Requests accumulate until the idle runs. */
+void
+pui_accounts_request_presence(PuiAccounts *accounts, gboolean activation,
+                              gboolean message_changed);
+
+gboolean
+pui_accounts_set_account_presence(PuiAccounts *accounts, TpAccount *account,
+                                  gboolean activation,
+                                  gboolean message_changed);
+
+/* Call after pui_core_activate_profile(), times the requests activation
+ * causes and shows the presence expected from it right away */
+void
+pui_accounts_profile_activated(PuiAccounts *accounts);
+
+/* recomputes global presence from idle */
+void
+pui_accounts_recompute(PuiAccounts *accounts);
+
+void
+pui_accounts_get_global_presence(PuiAccounts *accounts,
+                                 TpConnectionPresenceType *presence_type,
+                                 guint *status);
+
+/* the visible rows, in the order they were inserted */
+const GList *
+pui_accounts_get_rows(PuiAccounts *accounts);
+
+/* calls func for every row in TP_CONNECTION_STATUS_CONNECTING, the set is
+ * updated on recompute */
+void
+pui_accounts_foreach_connecting(PuiAccounts *accounts,
+                                PuiAccountsRowFunc func, gpointer user_data);
+
+guint
+pui_accounts_get_n_connecting(PuiAccounts *accounts);
+
+gboolean
+pui_accounts_is_presence_supported(PuiAccounts *accounts);
+
+/* NULL unless PUI_SPANS is set */
+PuiSpans *
+pui_accounts_get_spans(PuiAccounts *accounts);
+
+/* Times main loop sources and signal handlers of accounts, begin returns 0
+ * if the callback is not to be timed. See pui_master_watchdog_begin(). */
+typedef gint64 (*PuiAccountsWatchdogBeginFunc)(gpointer user_data);
+typedef void (*PuiAccountsWatchdogEndFunc)(gpointer user_data,
+                                           const gchar *name, gint64 start);
+
+void
+pui_accounts_set_watchdog(PuiAccounts *accounts,
+                          PuiAccountsWatchdogBeginFunc begin,
+                          PuiAccountsWatchdogEndFunc end,
+                          gpointer user_data);
+
+/* What pui_accounts_scan_profile() returns for a profile */
+struct _PuiAccountsProfileScan
+{
+  PuiProfile *profile;
+  TpConnectionPresenceType aggregate_presence;
+  gboolean no_sip_in_profile;
+};
+
+typedef struct _PuiAccountsProfileScan PuiAccountsProfileScan;
+
+/* Evaluates all profiles against all rows in one walk, in core profiles
+ * order. The result is owned by accounts and kept until the rows, the
+ * profiles or the connection managers change, calls in between, and
+ * pui_accounts_scan_profile() for any of those profiles, only look it up. */
+const PuiAccountsProfileScan *
+pui_accounts_scan_profiles(PuiAccounts *accounts, guint *n_profiles);
+
+void
+pui_accounts_scan_profile(PuiAccounts *accounts, PuiProfile *profile,
+                          gboolean *no_sip_in_profile,
+                          TpConnectionPresenceType *aggregate_presence);
+
+/* the profiles changed */
+void
+pui_accounts_invalidate_profile_scans(PuiAccounts *accounts);
+
+/* Counters of the work accounts did since they were created */
+struct _PuiAccountsStats
+{
+  guint recomputes;
+  guint rows_evaluated;
+  /* rows a recompute found unchanged and did not signal */
+  guint rows_unchanged;
+  guint presence_requests;
+  guint avatar_fetches;
+  guint profile_scans;
+  guint name_owner_handled;
+};
+
+typedef struct _PuiAccountsStats PuiAccountsStats;
+
+void
+pui_accounts_get_stats(PuiAccounts *accounts, PuiAccountsStats *stats);
+
+/* See PuiMasterLatencyFunc */
+typedef void (*PuiAccountsLatencyFunc)(const gchar *kind,
+                                       const gchar *protocol,
+                                       const PuiHistogram *histogram,
+                                       gpointer user_data);
+
+void
+pui_accounts_latency_foreach(PuiAccounts *accounts,
+                             PuiAccountsLatencyFunc func, gpointer user_data);
+
+/* synchronous recompute, for benchmarks only */
+void
+_pui_accounts_compute_global_presence(PuiAccounts *accounts);
+
+typedef enum
+{
+  PUI_ACCOUNTS_STARTUP_AM_READY,
+  PUI_ACCOUNTS_STARTUP_CMS_LISTED,
+  PUI_ACCOUNTS_STARTUP_ACCOUNTS_APPENDED,
+  PUI_ACCOUNTS_STARTUP_FIRST_RECOMPUTE,
+  PUI_ACCOUNTS_STARTUP_N_PHASES
+} PuiAccountsStartupPhase;
+
+/* monotonic time at which each startup phase finished, 0 if it did not
+ * finish yet, for benchmarks only */
+const gint64 *
+_pui_accounts_get_startup_times(PuiAccounts *accounts);
+
+/* Telepathy proxies accounts references and the signal handlers it has on
+ * them, see PuiMasterMemory */
+struct _PuiAccountsMemory
+{
+  gsize tp_proxies;
+  guint n_tp_proxies;
+  guint signal_handlers;
+  guint n_bindings;
+};
+
+typedef struct _PuiAccountsMemory PuiAccountsMemory;
+
+/* for benchmarks only */
+void
+_pui_accounts_get_memory(PuiAccounts *accounts, PuiAccountsMemory *memory);
+
+/* account bindings alive in all PuiAccounts instances, for benchmarks
+ * only */
+guint
+_pui_accounts_get_live_bindings(void);
+
+G_END_DECLS
+
+#endif /* __PUI_ACCOUNTS_H_INCLUDED__ */
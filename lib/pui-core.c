@@ -0,0 +1,655 @@
+/*
+ * pui-core.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <glib/gi18n-lib.h>
+
+#include <string.h>
+
+#include "pui-core.h"
+
+#define PUI_PROFILE_HEADER "Profile "
+#define PUI_ACCOUNT_HEADER "Account-"
+
+/* connecting indicators blink after 1.5 s of connecting and for a minute */
+#define PUI_BLINK_ONSET_DEFAULT 1500
+#define PUI_BLINK_LIMIT_DEFAULT 60
+
+static PuiProfile default_profiles[] =
+{
+  {
+    "pres_fi_status_online",
+    "general_presence_online",
+    "statusarea_presence_online_error",
+    TRUE,
+    NULL,
+    "available"
+  },
+  {
+    "pres_fi_status_busy",
+    "general_presence_busy",
+    "statusarea_presence_busy_error",
+    TRUE,
+    NULL,
+    "busy"
+  },
+  {
+    "pres_fi_status_offline",
+    "general_presence_offline",
+    "general_presence_offline",
+    TRUE,
+    NULL,
+    "offline"
+  }
+};
+
+PuiCore *
+pui_core_new(const gchar *config_filename)
+{
+  PuiCore *core = g_slice_new0(PuiCore);
+
+  if (config_filename)
+    core->config_filename = g_strdup(config_filename);
+  else
+  {
+    core->config_filename = g_build_filename(g_get_home_dir(), ".osso",
+                                             ".rtcom-presence-ui.cfg", NULL);
+  }
+
+  core->config = g_key_file_new();
+  core->connection_managers =
+    g_hash_table_new_full((GHashFunc)g_str_hash,
+                          (GEqualFunc)g_str_equal,
+                          (GDestroyNotify)g_free,
+                          (GDestroyNotify)g_object_unref);
+
+  return core;
+}
+
+void
+pui_core_free(PuiCore *core)
+{
+  g_return_if_fail(core != NULL);
+
+  g_key_file_free(core->config);
+  g_free(core->config_filename);
+  g_list_free_full(core->profiles, (GDestroyNotify)pui_profile_free);
+  g_free(core->presence_message);
+  g_hash_table_destroy(core->connection_managers);
+
+  g_slice_free(PuiCore, core);
+}
+
+static void
+load_profiles(PuiCore *core)
+{
+  int i;
+
+  gchar **groups;
+  gchar **group;
+
+  for (i = 0; i < G_N_ELEMENTS(default_profiles); i++)
+    core->profiles = g_list_append(core->profiles, &default_profiles[i]);
+
+  groups = g_key_file_get_groups(core->config, NULL);
+
+  for (group = groups; group && *group; group++)
+  {
+    PuiProfile *profile;
+    gchar **keys;
+    gchar **key;
+
+    if (strncmp(*group, PUI_PROFILE_HEADER, strlen(PUI_PROFILE_HEADER)))
+      continue;
+
+    profile = g_slice_new0(PuiProfile);
+    profile->name = g_strdup(*group + strlen(PUI_PROFILE_HEADER));
+    profile->icon = g_key_file_get_string(core->config, *group, "Icon", NULL);
+    profile->icon_error = g_strconcat(profile->icon, "_error", NULL);
+    profile->default_presence = g_key_file_get_string(core->config, *group,
+                                                      "DefaultPresence", NULL);
+    profile->accounts = NULL;
+    keys = g_key_file_get_keys(core->config, *group, NULL, NULL);
+
+    for (key = keys; key && *key; key++)
+    {
+      PuiAccount *account;
+
+      if (strncmp(*key, PUI_ACCOUNT_HEADER, strlen(PUI_ACCOUNT_HEADER)))
+        continue;
+
+      account = g_slice_new(PuiAccount);
+
+      account->account_id = g_strdup(*key + strlen(PUI_ACCOUNT_HEADER));
+      account->presence =
+        g_key_file_get_string(core->config, *group, *key, NULL);
+      profile->accounts = g_slist_prepend(profile->accounts, account);
+    }
+
+    g_strfreev(keys);
+    core->profiles = g_list_append(core->profiles, profile);
+  }
+
+  g_strfreev(groups);
+
+  core->active_profile = g_list_nth_data(
+      core->profiles,
+      g_key_file_get_integer(core->config, "General", "ActiveProfile", NULL));
+
+  if (!core->active_profile)
+    core->active_profile = core->profiles->data;
+}
+
+void
+pui_core_load_config(PuiCore *core)
+{
+  GError *error = NULL;
+
+  g_return_if_fail(core != NULL);
+
+  g_key_file_load_from_file(core->config, core->config_filename,
+                            G_KEY_FILE_KEEP_COMMENTS, &error);
+
+  if (error)
+  {
+    g_warning("%s error loading %s: %s", __FUNCTION__, core->config_filename,
+              error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    core->presence_message = g_key_file_get_string(
+        core->config, "General", "StatusMessage", NULL);
+  }
+
+  load_profiles(core);
+}
+
+gboolean
+pui_core_save_config(PuiCore *core)
+{
+  GError *error = NULL;
+  gchar *data;
+  gsize length;
+
+  g_return_val_if_fail(core != NULL, FALSE);
+
+  data = g_key_file_to_data(core->config, &length, &error);
+
+  if (error)
+  {
+    g_warning("%s error: %s", __FUNCTION__, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  g_file_set_contents(core->config_filename, data, length, &error);
+  g_free(data);
+
+  if (error)
+  {
+    g_warning("%s error writing %s: %s", __FUNCTION__,
+              core->config_filename, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+PuiLocationLevel
+pui_core_get_location_level(PuiCore *core)
+{
+  GError *error = NULL;
+  gint level;
+
+  g_return_val_if_fail(core != NULL, PUI_LOCATION_LEVEL_NONE);
+
+  level = g_key_file_get_integer(core->config, "General", "LocationLevel",
+                                 &error);
+
+  if (error)
+  {
+    g_error_free(error);
+    return PUI_LOCATION_LEVEL_NONE;
+  }
+
+  if ((level < 0) || (level >= PUI_LOCATION_LEVEL_LAST))
+    return PUI_LOCATION_LEVEL_NONE;
+
+  return level;
+}
+
+static guint
+get_general_uint(PuiCore *core, const gchar *key, guint default_value)
+{
+  GError *error = NULL;
+  gint value = g_key_file_get_integer(core->config, "General", key, &error);
+
+  if (error)
+  {
+    g_error_free(error);
+    return default_value;
+  }
+
+  return MAX(value, 0);
+}
+
+void
+pui_core_get_blink_policy(PuiCore *core, guint *onset_ms, guint *limit)
+{
+  g_return_if_fail(core != NULL);
+
+  if (onset_ms)
+    *onset_ms = get_general_uint(core, "BlinkOnset", PUI_BLINK_ONSET_DEFAULT);
+
+  if (limit)
+    *limit = get_general_uint(core, "BlinkLimit", PUI_BLINK_LIMIT_DEFAULT);
+}
+
+PuiProfile *
+pui_core_get_default_profile(PuiCore *core)
+{
+  return &default_profiles[0];
+}
+
+/* Returns TRUE if profile was not known before */
+gboolean
+pui_core_store_profile(PuiCore *core, PuiProfile *profile)
+{
+  gboolean created = FALSE;
+  GSList *l;
+  gchar *key;
+
+  g_return_val_if_fail(core != NULL, FALSE);
+
+  if (!g_list_find(core->profiles, profile))
+  {
+    core->profiles = g_list_append(core->profiles, profile);
+    created = TRUE;
+  }
+
+  key = g_strdup_printf("%s%s", PUI_PROFILE_HEADER, profile->name);
+
+  g_key_file_set_string(core->config,
+                        key, "Icon", profile->icon);
+  g_key_file_set_string(core->config,
+                        key, "DefaultPresence", profile->default_presence);
+
+  for (l = profile->accounts; l; l = l->next)
+  {
+    PuiAccount *account = l->data;
+    gchar *string = g_strdup_printf("%s%s", PUI_ACCOUNT_HEADER,
+                                    account->account_id);
+
+    g_key_file_set_string(core->config,
+                          key, string, account->presence);
+
+    g_free(string);
+  }
+
+  g_free(key);
+
+  return created;
+}
+
+gboolean
+pui_core_erase_profile(PuiCore *core, PuiProfile *profile)
+{
+  gboolean rv;
+  gchar *group_name;
+
+  g_return_val_if_fail(core != NULL, FALSE);
+
+  group_name = g_strdup_printf("%s%s", PUI_PROFILE_HEADER, profile->name);
+  rv = g_key_file_remove_group(core->config, group_name, NULL);
+  g_free(group_name);
+
+  return rv;
+}
+
+void
+pui_core_activate_profile(PuiCore *core, PuiProfile *profile)
+{
+  g_return_if_fail(core != NULL);
+
+  core->active_profile = profile;
+  g_key_file_set_integer(core->config, "General", "ActiveProfile",
+                         g_list_index(core->profiles, profile));
+}
+
+TpProtocol *
+pui_core_get_account_protocol(PuiCore *core, TpAccount *account)
+{
+  const gchar *cm_name;
+  const gchar *protocol_name;
+  TpConnectionManager *cm;
+
+  g_return_val_if_fail(core != NULL, NULL);
+
+  cm_name = tp_account_get_cm_name(account);
+  g_return_val_if_fail(cm_name != NULL, NULL);
+
+  cm = g_hash_table_lookup(core->connection_managers, cm_name);
+  g_return_val_if_fail(cm, NULL);
+
+  protocol_name = tp_account_get_protocol_name(account);
+  g_return_val_if_fail(protocol_name, NULL);
+
+  return tp_connection_manager_get_protocol_object(cm, protocol_name);
+}
+
+gboolean
+pui_core_account_can_change_presence(PuiCore *core, TpAccount *account)
+{
+  TpProtocol *protocol = pui_core_get_account_protocol(core, account);
+  GList *presences, *l;
+  gboolean rv = FALSE;
+
+  g_return_val_if_fail(protocol, FALSE);
+
+  if (!tp_proxy_has_interface_by_id(protocol,
+                                    TP_IFACE_QUARK_PROTOCOL_INTERFACE_PRESENCE))
+  {
+    return FALSE;
+  }
+
+  presences = tp_protocol_dup_presence_statuses(protocol);
+
+  /* assume we can if list is empty */
+  if (!presences)
+    return TRUE;
+
+  for (l = presences; l; l = l->next)
+  {
+    TpConnectionPresenceType type =
+      tp_presence_status_spec_get_presence_type(l->data);
+
+    if ((type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE) ||
+        (type == TP_CONNECTION_PRESENCE_TYPE_AVAILABLE))
+    {
+      rv = TRUE;
+      break;
+    }
+  }
+
+  g_list_free_full(presences, (GDestroyNotify)tp_presence_status_spec_free);
+
+  return rv;
+}
+
+gboolean
+pui_core_account_is_not_sip(TpAccount *account)
+{
+  const gchar *protocol_name = tp_account_get_protocol_name(account);
+
+  g_return_val_if_fail(protocol_name, TRUE);
+
+  return strcmp(protocol_name, "sip") ? TRUE : FALSE;
+}
+
+TpConnectionPresenceType
+pui_core_get_presence_type(PuiCore *core, TpAccount *account,
+                           const char *presence)
+{
+  TpConnectionPresenceType presence_type = TP_CONNECTION_PRESENCE_TYPE_BUSY;
+  TpProtocol *protocol;
+
+  if (!strcmp(presence, "offline"))
+    return TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
+
+  if (!strcmp(presence, "available"))
+    return TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
+
+  protocol = pui_core_get_account_protocol(core, account);
+
+  if (protocol)
+  {
+    GList *presence_statuses;
+    GList *l;
+
+    presence_statuses = tp_protocol_dup_presence_statuses(protocol);
+
+    for (l = presence_statuses; l; l = l->next)
+    {
+      if (!strcmp(tp_presence_status_spec_get_name(l->data), presence))
+        break;
+    }
+
+    if (l)
+    {
+      presence_type = tp_presence_status_spec_get_presence_type(l->data);
+
+      if (presence_type == TP_CONNECTION_PRESENCE_TYPE_UNSET)
+        presence_type = TP_CONNECTION_PRESENCE_TYPE_BUSY;
+    }
+
+    g_list_free_full(presence_statuses,
+                     (GDestroyNotify)tp_presence_status_spec_free);
+  }
+
+  return presence_type;
+}
+
+gint
+pui_core_get_presence_weight(TpConnectionPresenceType presence_type,
+                             const gchar *msg)
+{
+  if (presence_type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE)
+    return presence_type != TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
+
+  if (msg)
+    return 2;
+
+  return 3;
+}
+
+static const gchar *
+get_error_message(TpConnectionStatusReason reason)
+{
+  switch (reason)
+  {
+    case TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED:
+    case TP_CONNECTION_STATUS_REASON_NETWORK_ERROR:
+      return _("pres_li_network_error");
+    case TP_CONNECTION_STATUS_REASON_REQUESTED:
+      return _("pres_ib_network_error");
+    case TP_CONNECTION_STATUS_REASON_AUTHENTICATION_FAILED:
+      return _("pres_li_authentication_error");
+    case TP_CONNECTION_STATUS_REASON_ENCRYPTION_ERROR:
+      return _("pres_li_encryption_error");
+    case TP_CONNECTION_STATUS_REASON_NAME_IN_USE:
+      return _("pres_li_error_name_in_use");
+    case TP_CONNECTION_STATUS_REASON_CERT_NOT_PROVIDED:
+    case TP_CONNECTION_STATUS_REASON_CERT_UNTRUSTED:
+    case TP_CONNECTION_STATUS_REASON_CERT_EXPIRED:
+    case TP_CONNECTION_STATUS_REASON_CERT_NOT_ACTIVATED:
+    case TP_CONNECTION_STATUS_REASON_CERT_HOSTNAME_MISMATCH:
+    case TP_CONNECTION_STATUS_REASON_CERT_FINGERPRINT_MISMATCH:
+    case TP_CONNECTION_STATUS_REASON_CERT_SELF_SIGNED:
+    case TP_CONNECTION_STATUS_REASON_CERT_OTHER_ERROR:
+      return _("pres_li_error_certificate");
+    default:
+      return NULL;
+  }
+}
+
+/* Computes the current state of account against the active profile.
+ * old_state is what was last stored for the account, status_message is the
+ * global one. Caller owns state->status_message. Adds account contribution
+ * to global_status and returns PUI_CORE_ACCOUNT_* flags. */
+guint
+pui_core_evaluate_account(PuiCore *core, TpAccount *account,
+                          const gchar *status_message,
+                          const PuiCoreAccountState *old_state,
+                          PuiCoreAccountState *state, guint *global_status)
+{
+  guint rv = PUI_CORE_ACCOUNT_STATUS_CHANGED;
+  const gchar *presence;
+
+  g_return_val_if_fail(core != NULL, 0);
+
+  presence = pui_profile_get_presence(core->active_profile, account);
+
+  state->status_message = NULL;
+  state->is_changing_status = FALSE;
+  state->can_change_presence =
+    pui_core_account_can_change_presence(core, account);
+  state->connection_status =
+    tp_account_get_connection_status(account, &state->status_reason);
+
+  if (state->connection_status == TP_CONNECTION_STATUS_CONNECTING)
+  {
+    if (old_state->connection_status == TP_CONNECTION_STATUS_CONNECTED)
+      rv |= PUI_CORE_ACCOUNT_DISCONNECTED;
+
+    if (old_state->connection_status == TP_CONNECTION_STATUS_CONNECTING)
+      rv &= ~PUI_CORE_ACCOUNT_STATUS_CHANGED;
+
+    if (state->can_change_presence)
+    {
+      state->presence_type =
+        pui_core_get_presence_type(core, account, presence);
+    }
+    else
+      state->presence_type = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
+
+    *global_status |= PUI_MASTER_STATUS_CONNECTING;
+  }
+  else if (state->connection_status == TP_CONNECTION_STATUS_DISCONNECTED)
+  {
+    if (old_state->connection_status == TP_CONNECTION_STATUS_CONNECTED)
+      rv |= PUI_CORE_ACCOUNT_DISCONNECTED;
+
+    if (pui_core_get_presence_type(core, account, presence) !=
+        TP_CONNECTION_PRESENCE_TYPE_OFFLINE)
+    {
+      const gchar *err_msg = get_error_message(state->status_reason);
+
+      *global_status |= PUI_MASTER_STATUS_ERROR;
+
+      if (old_state->is_changing_status &&
+          (state->status_reason != TP_CONNECTION_STATUS_REASON_REQUESTED))
+      {
+        *global_status |= PUI_MASTER_STATUS_REASON_ERROR;
+      }
+
+      if (err_msg)
+      {
+        state->status_message =
+          g_strdup_printf(_("pres_li_account_with_error"), err_msg);
+      }
+    }
+
+    state->presence_type = TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
+  }
+  else
+  {
+    gboolean not_sip;
+    gboolean msg_diff = FALSE;
+    gchar *message = NULL;
+
+    if (old_state->connection_status != TP_CONNECTION_STATUS_CONNECTED)
+      rv |= PUI_CORE_ACCOUNT_CONNECTED;
+    else
+      rv &= ~PUI_CORE_ACCOUNT_STATUS_CHANGED;
+
+    state->presence_type =
+      tp_account_get_current_presence(account, NULL, &message);
+
+    if (!state->can_change_presence)
+      state->presence_type = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
+
+    not_sip = pui_core_account_is_not_sip(account);
+
+    if (not_sip)
+    {
+      *global_status |= PUI_MASTER_STATUS_CONNECTED;
+      msg_diff = g_strcmp0(message, status_message ? status_message : "");
+    }
+
+    if (msg_diff)
+    {
+      state->status_reason = 'r';
+      state->status_message = message;
+      *global_status |= PUI_MASTER_STATUS_MESSAGE_CHANGED;
+    }
+    else
+      g_free(message);
+
+    if ((!not_sip || msg_diff) && state->can_change_presence)
+    {
+      if (presence)
+      {
+        if (pui_core_get_presence_type(core, account, presence) !=
+            tp_account_get_current_presence(account, NULL, NULL))
+        {
+          *global_status |= PUI_MASTER_STATUS_OFFLINE;
+        }
+      }
+      else if (old_state->status_reason == 'r')
+        state->status_reason = TP_CONNECTION_STATUS_REASON_REQUESTED;
+    }
+  }
+
+  return rv;
+}
+
+void
+pui_core_aggregate_init(PuiCoreAggregate *aggregate)
+{
+  aggregate->presence_type = TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
+  aggregate->active_accounts = 0;
+}
+
+/* Folds one account into the global presence: available wins over busy,
+ * busy over offline. Accounts that cannot change presence only count when
+ * active, see pui_core_aggregate_get() */
+void
+pui_core_aggregate_add(PuiCoreAggregate *aggregate,
+                       TpConnectionPresenceType presence_type,
+                       gboolean can_change_presence, gboolean active)
+{
+  if (can_change_presence)
+  {
+    if (presence_type == TP_CONNECTION_PRESENCE_TYPE_AVAILABLE)
+      aggregate->presence_type = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
+    else if ((aggregate->presence_type !=
+              TP_CONNECTION_PRESENCE_TYPE_AVAILABLE) &&
+             (presence_type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE))
+    {
+      aggregate->presence_type = TP_CONNECTION_PRESENCE_TYPE_BUSY;
+    }
+  }
+  else if (active)
+    aggregate->active_accounts++;
+}
+
+TpConnectionPresenceType
+pui_core_aggregate_get(PuiCoreAggregate *aggregate)
+{
+  if ((aggregate->presence_type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE) &&
+      (aggregate->active_accounts > 0))
+  {
+    return TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
+  }
+
+  return aggregate->presence_type;
+}
@@ -0,0 +1,157 @@
+/*
+ * pui-core.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PUI_CORE_H_INCLUDED__
+#define __PUI_CORE_H_INCLUDED__
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "pui-location.h"
+#include "pui-profile.h"
+
+G_BEGIN_DECLS
+
+/* GTK-free part of PuiMaster: config, profiles, connection managers and the
+ * rules deciding account and global presence. PuiAccounts tracks accounts
+ * with it, PuiMaster adds the list store, icons, sounds and D-Bus. */
+
+enum
+{
+  PUI_MASTER_STATUS_NONE = 0,
+  PUI_MASTER_STATUS_ERROR = 1 << 0,
+  PUI_MASTER_STATUS_CONNECTING = 1 << 2,
+  PUI_MASTER_STATUS_MESSAGE_CHANGED = 1 << 3,
+  PUI_MASTER_STATUS_CONNECTED = 1 << 4,
+  PUI_MASTER_STATUS_OFFLINE = 1 << 5,
+  PUI_MASTER_STATUS_REASON_ERROR = 1 << 6,
+  PUI_MASTER_STATUS_PROVISIONAL = 1 << 7,
+  /* at least one account is tracked */
+  PUI_MASTER_STATUS_ACCOUNTS = 1 << 8
+};
+
+/* returned by pui_core_evaluate_account() */
+enum
+{
+  PUI_CORE_ACCOUNT_CONNECTED = 1 << 0,
+  PUI_CORE_ACCOUNT_DISCONNECTED = 1 << 1,
+  PUI_CORE_ACCOUNT_STATUS_CHANGED = 1 << 2
+};
+
+struct _PuiCore
+{
+  gchar *config_filename;
+  GKeyFile *config;
+  GList *profiles;
+  PuiProfile *active_profile;
+  gchar *presence_message;
+  GHashTable *connection_managers;
+};
+
+typedef struct _PuiCore PuiCore;
+
+struct _PuiCoreAccountState
+{
+  TpConnectionPresenceType presence_type;
+  TpConnectionStatus connection_status;
+  TpConnectionStatusReason status_reason;
+  gboolean is_changing_status;
+  gboolean can_change_presence;
+  gchar *status_message;
+};
+
+typedef struct _PuiCoreAccountState PuiCoreAccountState;
+
+struct _PuiCoreAggregate
+{
+  TpConnectionPresenceType presence_type;
+  guint active_accounts;
+};
+
+typedef struct _PuiCoreAggregate PuiCoreAggregate;
+
+PuiCore *
+pui_core_new(const gchar *config_filename);
+
+void
+pui_core_free(PuiCore *core);
+
+void
+pui_core_load_config(PuiCore *core);
+
+gboolean
+pui_core_save_config(PuiCore *core);
+
+PuiLocationLevel
+pui_core_get_location_level(PuiCore *core);
+
+/* How long, in ms, connecting must last before indicators start blinking
+ * and for how many seconds of connecting they blink at most, 0 for no
+ * limit. General/BlinkOnset and General/BlinkLimit in the config. */
+void
+pui_core_get_blink_policy(PuiCore *core, guint *onset_ms, guint *limit);
+
+PuiProfile *
+pui_core_get_default_profile(PuiCore *core);
+
+gboolean
+pui_core_store_profile(PuiCore *core, PuiProfile *profile);
+
+gboolean
+pui_core_erase_profile(PuiCore *core, PuiProfile *profile);
+
+void
+pui_core_activate_profile(PuiCore *core, PuiProfile *profile);
+
+TpProtocol *
+pui_core_get_account_protocol(PuiCore *core, TpAccount *account);
+
+gboolean
+pui_core_account_can_change_presence(PuiCore *core, TpAccount *account);
+
+gboolean
+pui_core_account_is_not_sip(TpAccount *account);
+
+TpConnectionPresenceType
+pui_core_get_presence_type(PuiCore *core, TpAccount *account,
+                           const char *presence);
+
+gint
+pui_core_get_presence_weight(TpConnectionPresenceType presence_type,
+                             const gchar *msg);
+
+guint
+pui_core_evaluate_account(PuiCore *core, TpAccount *account,
+                          const gchar *status_message,
+                          const PuiCoreAccountState *old_state,
+                          PuiCoreAccountState *state, guint *global_status);
+
+void
+pui_core_aggregate_init(PuiCoreAggregate *aggregate);
+
+void
+pui_core_aggregate_add(PuiCoreAggregate *aggregate,
+                       TpConnectionPresenceType presence_type,
+                       gboolean can_change_presence, gboolean active);
+
+TpConnectionPresenceType
+pui_core_aggregate_get(PuiCoreAggregate *aggregate);
+
+G_END_DECLS
+
+#endif /* __PUI_CORE_H_INCLUDED__ */
@@ -19,18 +19,14 @@
 #include "config.h"
 
 #include "pui-main-view.h"
+#include "pui-wakeup.h"
 
 #include "pui-dbus.h"
 
-static PuiMainView *main_view = NULL;
-
 static gboolean
-pui_main_view_run_delayed(gpointer user_data)
+pui_main_view_open_delayed(gpointer user_data)
 {
-  PuiMainView *main_view = user_data;
-
-  pui_main_view_run(main_view);
-  gtk_widget_destroy(GTK_WIDGET(main_view));
+  pui_main_view_open(user_data);
 
   return FALSE;
 }
@@ -38,21 +34,236 @@ pui_main_view_run_delayed(gpointer user_data)
 static gboolean
 presence_ui_start_up(PuiMaster *master, GError **error)
 {
-  if (main_view)
-    return TRUE;
+  g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, pui_main_view_open_delayed,
+                  g_object_ref(master), g_object_unref);
+
+  return TRUE;
+}
 
-  main_view = pui_main_view_new(master);
+static PuiProfile *
+find_profile(PuiMaster *master, const gchar *name, GError **error)
+{
+  GList *l;
 
-  if (!main_view)
+  for (l = pui_master_get_profiles(master); l; l = l->next)
   {
-    g_set_error(error, TP_ERROR, TP_ERROR_NOT_AVAILABLE, "%s",
-                "Could not create main view");
-    return FALSE;
+    PuiProfile *profile = l->data;
+
+    if (!g_strcmp0(profile->name, name))
+      return profile;
+  }
+
+  g_set_error(error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
+              "Unknown profile '%s'", name);
+
+  return NULL;
+}
+
+static gboolean
+presence_ui_get_global_presence(PuiMaster *master, guint *presence_type,
+                                gchar **status_message, guint *status,
+                                GError **error)
+{
+  TpConnectionPresenceType type;
+  const gchar *message;
+
+  pui_master_get_global_presence(master, &type, &message, status);
+  *presence_type = type;
+  *status_message = g_strdup(message ? message : "");
+
+  return TRUE;
+}
+
+static gboolean
+presence_ui_list_accounts(PuiMaster *master, GPtrArray **accounts,
+                          GError **error)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL(pui_master_get_model(master));
+  GtkTreeIter it;
+
+  *accounts = g_ptr_array_new();
+
+  if (gtk_tree_model_get_iter_first(model, &it))
+  {
+    do
+    {
+      TpAccount *account;
+      TpConnectionPresenceType presence_type;
+      TpConnectionStatus connection_status;
+      TpConnectionStatusReason status_reason;
+      gchar *status_message;
+
+      gtk_tree_model_get(model, &it,
+                         COLUMN_ACCOUNT, &account,
+                         COLUMN_PRESENCE_TYPE, &presence_type,
+                         COLUMN_CONNECTION_STATUS, &connection_status,
+                         COLUMN_STATUS_REASON, &status_reason,
+                         COLUMN_STATUS_MESSAGE, &status_message,
+                         -1);
+
+      if (account)
+      {
+        const gchar *display_name =
+          pui_master_get_account_display_name(master, account);
+
+        g_ptr_array_add(
+          *accounts,
+          tp_value_array_build(
+            6,
+            G_TYPE_STRING, tp_account_get_path_suffix(account),
+            G_TYPE_STRING, display_name ? display_name : "",
+            G_TYPE_UINT, presence_type,
+            G_TYPE_UINT, connection_status,
+            G_TYPE_UINT, status_reason,
+            G_TYPE_STRING, status_message ? status_message : "",
+            G_TYPE_INVALID));
+        g_object_unref(account);
+      }
+
+      g_free(status_message);
+    }
+    while (gtk_tree_model_iter_next(model, &it));
   }
 
-  g_signal_connect(main_view, "destroy",
-                   G_CALLBACK(gtk_widget_destroyed), &main_view);
-  g_idle_add(pui_main_view_run_delayed, main_view);
+  return TRUE;
+}
+
+static gboolean
+presence_ui_list_profiles(PuiMaster *master, GPtrArray **profiles,
+                          gint *active, GError **error)
+{
+  GList *l = pui_master_get_profiles(master);
+
+  *profiles = g_ptr_array_new();
+  *active = g_list_index(l, pui_master_get_active_profile(master));
+
+  for (; l; l = l->next)
+  {
+    PuiProfile *profile = l->data;
+
+    g_ptr_array_add(*profiles,
+                    tp_value_array_build(
+                      3,
+                      G_TYPE_STRING, profile->name,
+                      G_TYPE_STRING, profile->icon ? profile->icon : "",
+                      G_TYPE_BOOLEAN, profile->builtin,
+                      G_TYPE_INVALID));
+  }
+
+  return TRUE;
+}
+
+static gboolean
+presence_ui_activate_profile(PuiMaster *master, const gchar *name,
+                             GError **error)
+{
+  PuiProfile *profile = find_profile(master, name, error);
+
+  if (!profile)
+    return FALSE;
+
+  pui_master_activate_profile(master, profile);
+  pui_master_save_config(master);
+
+  return TRUE;
+}
+
+static gboolean
+presence_ui_set_status_message(PuiMaster *master, const gchar *message,
+                               GError **error)
+{
+  pui_master_set_presence_message(master, message);
+  pui_master_save_config(master);
+
+  return TRUE;
+}
+
+/* both changes end up in a single presence request per account */
+static gboolean
+presence_ui_activate_profile_with_message(PuiMaster *master,
+                                          const gchar *name,
+                                          const gchar *message,
+                                          GError **error)
+{
+  PuiProfile *profile = find_profile(master, name, error);
+
+  if (!profile)
+    return FALSE;
+
+  pui_master_set_presence_message(master, message);
+  pui_master_activate_profile(master, profile);
+  pui_master_save_config(master);
+
+  return TRUE;
+}
+
+static void
+add_stat(const gchar *name, guint value, gpointer user_data)
+{
+  g_ptr_array_add(user_data,
+                  tp_value_array_build(2,
+                                       G_TYPE_STRING, name,
+                                       G_TYPE_UINT, value,
+                                       G_TYPE_INVALID));
+}
+
+static gboolean
+presence_ui_get_stats(PuiMaster *master, GPtrArray **stats, GError **error)
+{
+  *stats = g_ptr_array_new();
+  pui_master_stats_foreach(master, add_stat, *stats);
+
+  return TRUE;
+}
+
+static void
+add_latency(const gchar *kind, const gchar *protocol,
+            const PuiHistogram *histogram, gpointer user_data)
+{
+  GArray *buckets = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+                                      PUI_HISTOGRAM_BUCKETS);
+
+  g_array_append_vals(buckets, histogram->buckets, PUI_HISTOGRAM_BUCKETS);
+  g_ptr_array_add(user_data,
+                  tp_value_array_build(5,
+                                       G_TYPE_STRING, kind,
+                                       G_TYPE_STRING, protocol ? protocol : "",
+                                       G_TYPE_UINT, histogram->failures,
+                                       G_TYPE_UINT, histogram->max_ms,
+                                       DBUS_TYPE_G_UINT_ARRAY, buckets,
+                                       G_TYPE_INVALID));
+  g_array_unref(buckets);
+}
+
+static gboolean
+presence_ui_get_latencies(PuiMaster *master, GPtrArray **latencies,
+                          GError **error)
+{
+  *latencies = g_ptr_array_new();
+  pui_master_latency_foreach(master, add_latency, *latencies);
+
+  return TRUE;
+}
+
+static void
+add_wakeup(const gchar *name, guint dispatches, guint64 time_us,
+           gdouble per_minute, gpointer user_data)
+{
+  g_ptr_array_add(user_data,
+                  tp_value_array_build(4,
+                                       G_TYPE_STRING, name,
+                                       G_TYPE_UINT, dispatches,
+                                       G_TYPE_UINT64, time_us,
+                                       G_TYPE_DOUBLE, per_minute,
+                                       G_TYPE_INVALID));
+}
+
+static gboolean
+presence_ui_get_wakeups(PuiMaster *master, GPtrArray **wakeups,
+                        GError **error)
+{
+  *wakeups = g_ptr_array_new();
+  pui_wakeup_foreach(add_wakeup, *wakeups);
 
   return TRUE;
 }
@@ -0,0 +1,63 @@
+/*
+ * pui-histogram.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "pui-histogram.h"
+
+void
+pui_histogram_add(PuiHistogram *histogram, guint ms)
+{
+  guint bucket = ms ? g_bit_storage(ms) : 0;
+
+  histogram->buckets[MIN(bucket, PUI_HISTOGRAM_BUCKETS - 1)]++;
+  histogram->count++;
+
+  if (ms > histogram->max_ms)
+    histogram->max_ms = ms;
+}
+
+void
+pui_histogram_add_failure(PuiHistogram *histogram)
+{
+  histogram->failures++;
+}
+
+guint
+pui_histogram_get_percentile(const PuiHistogram *histogram, guint percent)
+{
+  guint64 target;
+  guint64 seen = 0;
+  guint i;
+
+  if (!histogram->count)
+    return 0;
+
+  target = ((guint64)histogram->count * MIN(percent, 100) + 99) / 100;
+
+  for (i = 0; i < PUI_HISTOGRAM_BUCKETS - 1; i++)
+  {
+    seen += histogram->buckets[i];
+
+    if (seen >= MAX(target, 1))
+      return 1u << i;
+  }
+
+  return histogram->max_ms;
+}
@@ -0,0 +1,57 @@
+/*
+ * pui-histogram.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PUI_HISTOGRAM_H_INCLUDED__
+#define __PUI_HISTOGRAM_H_INCLUDED__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Log-scale latency histogram. Bucket 0 counts samples below 1 ms, bucket i
+ * samples in [2^(i-1), 2^i) ms and the last bucket everything from 2^14 ms,
+ * about 16 s, up.
+ */
+
+#define PUI_HISTOGRAM_BUCKETS 16
+
+struct _PuiHistogram
+{
+  guint buckets[PUI_HISTOGRAM_BUCKETS];
+  guint count;
+  guint failures;
+  guint max_ms;
+};
+
+typedef struct _PuiHistogram PuiHistogram;
+
+void
+pui_histogram_add(PuiHistogram *histogram, guint ms);
+
+void
+pui_histogram_add_failure(PuiHistogram *histogram);
+
+/* upper bound in ms of the bucket the percentile falls in, 0 if empty */
+guint
+pui_histogram_get_percentile(const PuiHistogram *histogram, guint percent);
+
+G_END_DECLS
+
+#endif /* __PUI_HISTOGRAM_H_INCLUDED__ */
@@ -30,6 +30,8 @@
 
 #include <errno.h>
 
+#include "pui-wakeup.h"
+
 #include "pui-location.h"
 
 #ifdef ENABLE_LOCATION
@@ -51,6 +53,7 @@ struct _PuiLocationPrivate
   gboolean disposed;
   PuiLocationLevel level;
   gchar *locations[4];
+  guint geocode_requests;
 #ifdef ENABLE_LOCATION
   LocationGPSDControl *gpsd_control;
   LocationGPSDevice *gps_device;
@@ -274,6 +277,8 @@ on_iphb_event(gpointer user_data)
     priv->hb_source = NULL;
   }
 
+  priv->geocode_requests++;
+
   if (navigation_provider_location_to_address(priv->navigation, &priv->location,
                                               location_to_address_cb, self,
                                               &error))
@@ -383,6 +388,7 @@ iphb_event_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
 {
   iphb_event_source *hbs = (iphb_event_source *)source;
   GTimeVal timeval;
+  gint64 start;
 
   if (!callback)
   {
@@ -390,8 +396,13 @@ iphb_event_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
     return FALSE;
   }
 
+  start = pui_wakeup_enter();
+
   if (!callback(user_data))
+  {
+    pui_wakeup_leave("location-heartbeat", start);
     return FALSE;
+  }
 
   G_GNUC_BEGIN_IGNORE_DEPRECATIONS
   g_source_get_current_time(&hbs->source, &timeval);
@@ -411,6 +422,8 @@ iphb_event_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
     pui_heartbeat_degrade(hbs);
   }
 
+  pui_wakeup_leave("location-heartbeat", start);
+
   return TRUE;
 }
 
@@ -646,3 +659,9 @@ pui_location_reset(PuiLocation *location)
   PRIVATE(location)->gpsd_control_started = FALSE;
 #endif
 }
+
+guint
+pui_location_get_geocode_requests(PuiLocation *location)
+{
+  return PRIVATE(location)->geocode_requests;
+}
@@ -90,6 +90,10 @@ pui_location_get_location(PuiLocation *location);
 void
 pui_location_reset(PuiLocation *location);
 
+/* number of address lookups since location was created */
+guint
+pui_location_get_geocode_requests(PuiLocation *location);
+
 G_END_DECLS
 
 #endif /* __PUI_LOCATION_H_INCLUDED__ */
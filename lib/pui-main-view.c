@@ -46,6 +46,11 @@ struct _PuiMainViewPrivate
   GtkWidget *new_status_button;
   GtkWidget *edit_status_button;
   GtkWidget *vbox;
+  GtkWidget *account_view;
+  GtkWidget *pannable_area;
+  gboolean running : 1;
+  /* monotonic time pui_main_view_open() was called, 0 once it is drawn */
+  gint64 open_time;
 };
 
 typedef struct _PuiMainViewPrivate PuiMainViewPrivate;
@@ -76,6 +81,9 @@ static const char *const location_levels[] =
 
 static gboolean rc_parsed = FALSE;
 
+#define MAIN_VIEW_KEY "pui-main-view"
+#define MAIN_VIEW_IDLE_KEY "pui-main-view-idle"
+
 static void
 update_new_status_button_visibility(PuiMainViewPrivate *priv)
 {
@@ -219,9 +227,10 @@ on_screen_state_changed(PuiMaster *master, gboolean is_on, PuiMainView *view)
 
   if (priv->connecting)
   {
+    /* the view is realized while hidden between runs */
     if (is_on)
     {
-      if (!gtk_widget_get_realized(GTK_WIDGET(view)))
+      if (!gtk_widget_get_mapped(GTK_WIDGET(view)))
         return;
     }
 
@@ -523,10 +532,12 @@ pui_main_view_constructor(GType type, guint n_construct_properties,
   int idx = 0;
   int builtin_idx = 0;
   guint status;
+  gint64 start;
 
   g_return_val_if_fail(view != NULL, NULL);
 
   priv = PRIVATE(view);
+  start = pui_master_watchdog_begin(priv->master);
 
   priv->location_level = pui_master_get_location_level(priv->master);
   g_signal_connect(priv->master, "screen-state-changed",
@@ -662,6 +673,7 @@ pui_main_view_constructor(GType type, guint n_construct_properties,
   gtk_box_pack_start(GTK_BOX(priv->vbox), GTK_WIDGET(account_view),
                      FALSE, FALSE, 0);
   gtk_widget_grab_focus(GTK_WIDGET(account_view));
+  priv->account_view = GTK_WIDGET(account_view);
 
   viewport = g_object_new(GTK_TYPE_VIEWPORT, NULL);
   gtk_widget_set_size_request(priv->vbox, 1, -1);
@@ -673,6 +685,7 @@ pui_main_view_constructor(GType type, guint n_construct_properties,
                                NULL);
   gtk_container_add(GTK_CONTAINER(pannable_area), viewport);
   gtk_widget_show(pannable_area);
+  priv->pannable_area = pannable_area;
   gtk_box_pack_start(GTK_BOX(GTK_DIALOG(view)->vbox), pannable_area,
                      FALSE, FALSE, 0);
 
@@ -695,6 +708,8 @@ pui_main_view_constructor(GType type, guint n_construct_properties,
 
   gtk_window_set_resizable(GTK_WINDOW(view), FALSE);
 
+  pui_master_watchdog_end(priv->master, "pui_main_view_constructor", start);
+
   return object;
 }
 
@@ -802,6 +817,24 @@ pui_main_view_size_request(GtkWidget *widget, GtkRequisition *requisition)
     widget, requisition);
 }
 
+static gboolean
+pui_main_view_expose_event(GtkWidget *widget, GdkEventExpose *event)
+{
+  PuiMainViewPrivate *priv = PRIVATE(widget);
+
+  if (priv->open_time)
+  {
+    g_debug("Main view drawn %" G_GINT64_FORMAT " ms after open",
+            (g_get_monotonic_time() - priv->open_time) / 1000);
+    pui_master_trace_span(priv->master, PUI_SPAN_INSTANT,
+                          "main-view-first-frame", 0, NULL);
+    priv->open_time = 0;
+  }
+
+  return GTK_WIDGET_CLASS(pui_main_view_parent_class)->expose_event(
+    widget, event);
+}
+
 static void
 pui_main_view_class_init(PuiMainViewClass *klass)
 {
@@ -815,6 +848,7 @@ pui_main_view_class_init(PuiMainViewClass *klass)
   widget_class->map = pui_main_view_map;
   widget_class->realize = pui_main_view_realize;
   widget_class->size_request = pui_main_view_size_request;
+  widget_class->expose_event = pui_main_view_expose_event;
 
   g_object_class_install_property(
     object_class, PROP_MASTER,
@@ -917,14 +951,169 @@ pui_main_view_new(PuiMaster *master)
                       NULL);
 }
 
+/* brings a view kept from a previous run back to the state of master */
+static void
+pui_main_view_reset(PuiMainView *view)
+{
+  PuiMainViewPrivate *priv = PRIVATE(view);
+  const gchar *presence_message;
+  PuiProfile *profile;
+  GtkWidget *button;
+  guint status;
+
+  hildon_entry_set_placeholder(
+    HILDON_ENTRY(priv->entry),
+    pui_master_get_default_presence_message(priv->master));
+
+  presence_message = pui_master_get_presence_message(priv->master);
+
+  if (!presence_message)
+    presence_message = "";
+
+  hildon_entry_set_text(HILDON_ENTRY(priv->entry), presence_message);
+
+  priv->location_level = pui_master_get_location_level(priv->master);
+  hildon_picker_button_set_active(HILDON_PICKER_BUTTON(priv->location_picker),
+                                  priv->location_level);
+
+  profile = pui_master_get_active_profile(priv->master);
+  button = find_profile_button(view, profile);
+
+  if (button)
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), TRUE);
+
+  set_active_profile(view, profile);
+
+  pui_master_get_global_presence(priv->master, NULL, NULL, &status);
+  priv->connecting = !!(status & PUI_MASTER_STATUS_CONNECTING);
+
+  hildon_pannable_area_jump_to(HILDON_PANNABLE_AREA(priv->pannable_area),
+                               -1, 0);
+  gtk_widget_grab_focus(priv->account_view);
+}
+
 void
 pui_main_view_run(PuiMainView *main_view)
 {
   PuiMainViewPrivate *priv = PRIVATE(main_view);
 
+  if (priv->running)
+  {
+    gtk_window_present(GTK_WINDOW(main_view));
+    return;
+  }
+
+  priv->running = TRUE;
+  pui_main_view_reset(main_view);
+
   while (gtk_dialog_run(&main_view->parent) == GTK_RESPONSE_OK)
   {
     if (pui_main_view_activate_profile(main_view, priv->active_profile))
       break;
   }
+
+  gtk_widget_hide(GTK_WIDGET(main_view));
+  priv->running = FALSE;
+}
+
+static void
+main_view_destroyed(PuiMainView *view, PuiMaster *master)
+{
+  if (g_object_get_data(G_OBJECT(master), MAIN_VIEW_KEY) == view)
+    g_object_set_data(G_OBJECT(master), MAIN_VIEW_KEY, NULL);
+}
+
+PuiMainView *
+pui_main_view_get(PuiMaster *master)
+{
+  PuiMainView *view = g_object_get_data(G_OBJECT(master), MAIN_VIEW_KEY);
+
+  if (!view)
+  {
+    view = pui_main_view_new(master);
+    g_signal_connect(view, "destroy", G_CALLBACK(main_view_destroyed),
+                     master);
+    g_object_set_data(G_OBJECT(master), MAIN_VIEW_KEY, view);
+  }
+
+  return view;
+}
+
+static gboolean
+prepare_idle(gpointer user_data)
+{
+  PuiMaster *master = user_data;
+  PuiMainView *view;
+  gint64 start = g_get_monotonic_time();
+
+  g_object_set_data(G_OBJECT(master), MAIN_VIEW_IDLE_KEY, NULL);
+
+  /* lost the name meanwhile */
+  if (!pui_master_is_primary(master))
+    return FALSE;
+
+  view = pui_main_view_get(master);
+
+  /* creates the window and the accounts UI client as well */
+  gtk_widget_realize(GTK_WIDGET(view));
+
+  g_debug("Main view prepared in %" G_GINT64_FORMAT " ms",
+          (g_get_monotonic_time() - start) / 1000);
+
+  return FALSE;
+}
+
+void
+pui_main_view_prepare(PuiMaster *master)
+{
+  guint id;
+
+  if (g_object_get_data(G_OBJECT(master), MAIN_VIEW_KEY) ||
+      g_object_get_data(G_OBJECT(master), MAIN_VIEW_IDLE_KEY))
+  {
+    return;
+  }
+
+  id = g_idle_add_full(G_PRIORITY_LOW, prepare_idle, g_object_ref(master),
+                       g_object_unref);
+  g_object_set_data(G_OBJECT(master), MAIN_VIEW_IDLE_KEY,
+                    GUINT_TO_POINTER(id));
+}
+
+void
+pui_main_view_release(PuiMaster *master)
+{
+  guint id = GPOINTER_TO_UINT(
+      g_object_get_data(G_OBJECT(master), MAIN_VIEW_IDLE_KEY));
+  PuiMainView *view = g_object_get_data(G_OBJECT(master), MAIN_VIEW_KEY);
+
+  if (id)
+  {
+    g_source_remove(id);
+    g_object_set_data(G_OBJECT(master), MAIN_VIEW_IDLE_KEY, NULL);
+  }
+
+  if (view)
+    gtk_widget_destroy(GTK_WIDGET(view));
+}
+
+void
+pui_main_view_open(PuiMaster *master)
+{
+  gint64 start = g_get_monotonic_time();
+  PuiMainView *view;
+
+  pui_master_trace_span(master, PUI_SPAN_INSTANT, "main-view-open", 0, NULL);
+
+  if (!g_object_get_data(G_OBJECT(master), MAIN_VIEW_KEY))
+    g_debug("Main view not prepared, building it");
+
+  view = pui_main_view_get(master);
+
+  if (!PRIVATE(view)->running)
+    PRIVATE(view)->open_time = start;
+
+  g_object_ref(view);
+  pui_main_view_run(view);
+  g_object_unref(view);
 }
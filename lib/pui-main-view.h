@@ -70,6 +70,24 @@ pui_main_view_new(PuiMaster *master);
 void
 pui_main_view_run(PuiMainView *main_view);
 
+/* There is one main view per master. It is kept hidden between runs and
+ * reset from master on every run instead of being built again. */
+PuiMainView *
+pui_main_view_get(PuiMaster *master);
+
+/* builds the main view of master in a low priority idle, if not built yet
+ * and master is still primary by then */
+void
+pui_main_view_prepare(PuiMaster *master);
+
+/* destroys the main view of master, it keeps master alive otherwise */
+void
+pui_main_view_release(PuiMaster *master);
+
+/* runs the main view of master, or presents it if it runs already */
+void
+pui_main_view_open(PuiMaster *master);
+
 G_END_DECLS
 
 #endif /* __PUI_MAIN_VIEW_H_INCLUDED__ */
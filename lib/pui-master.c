@@ -22,55 +22,102 @@
 #include <canberra.h>
 #include <dbus/dbus-glib-lowlevel.h>
 #include <glib/gi18n-lib.h>
+#include <glib-unix.h>
 #include <libprofile.h>
 #include <mce/dbus-names.h>
 
+#include <signal.h>
 #include <time.h>
 
+#include "pui-accounts.h"
 #include "pui-dbus.h"
 #include "pui-marshal.h"
+#include "pui-snapshot.h"
+#include "pui-wakeup.h"
 
 #include "pui-master.h"
 
-#define PUI_PROFILE_HEADER "Profile "
-#define PUI_ACCOUNT_HEADER "Account-"
+#define PUI_DBUS_NAME "com.nokia.PresenceUI"
+#define PUI_DBUS_PATH "/com/nokia/PresenceUI"
+
+/* seconds before RequestName is sent again after it failed */
+#define PUI_REQUEST_NAME_RETRY 5
+
+#define PUI_NAME_OWNER_CHANGED_MATCH \
+  "type='signal',sender='" DBUS_SERVICE_DBUS "'," \
+  "path='" DBUS_PATH_DBUS "',interface='" DBUS_INTERFACE_DBUS "'," \
+  "member='NameOwnerChanged',"
+
+#define PUI_AM_MATCH_RULE \
+  PUI_NAME_OWNER_CHANGED_MATCH "arg0='" TP_ACCOUNT_MANAGER_BUS_NAME "'"
+
+#define PUI_CM_MATCH_RULE \
+  PUI_NAME_OWNER_CHANGED_MATCH \
+  "arg0namespace='org.freedesktop.Telepathy.ConnectionManager'"
+
+/* GlobalPresenceChanged is emitted at most once per this many ms */
+#define PUI_GLOBAL_PRESENCE_INTERVAL 500
+
+/* seconds between blink phase changes of connecting indicators */
+#define PUI_BLINK_INTERVAL 1
+
+/* main loop watchdog budget in ms, the watchdog is off unless set */
+#define PUI_WATCHDOG_ENV "PUI_WATCHDOG_MS"
+#define PUI_WATCHDOG_DEFAULT_BUDGET 8
 
 struct _PuiMasterPrivate
 {
-  TpAccountManager *manager;
-  gboolean accounts_added;
+  TpDBusDaemon *dbus_daemon;
+  gboolean is_primary;
+  gboolean object_registered;
   GtkWidget *parent;
-  gchar *config_filename;
-  GKeyFile *config;
+  PuiCore *core;
+  /* the accounts, the list store only shows their rows */
+  PuiAccounts *accounts;
+  guint spans_signal_id;
   GtkListStore *list_store;
-  guint presence_supported_count;
-  GList *profiles;
-  PuiProfile *active_profile;
-  time_t profile_change_time;
+  /* list store iters of the rows of accounts */
+  GHashTable *rows;
+  /* sorting is off while a sort key changed and presence was not
+   * recomputed yet */
+  gboolean sort_held;
   time_t connected_time;
   time_t disconnected_time;
-  gchar *presence_message;
   gchar *status_message;
   const gchar *default_presence_message;
-  int flags;
   TpConnectionPresenceType global_presence_type;
   guint global_status;
   GHashTable *icons_default;
   GHashTable *icons_mid;
   GHashTable *icons_small;
-  GHashTable *disconnected_accounts;
   PuiLocation *location;
   ca_context *ca_ctx;
-  guint compute_global_presence_id;
-  guint set_presence_id;
   gboolean disposed;
   DBusGProxy *mce_proxy;
-  DBusGProxy *fdo_proxy;
+  DBusConnection *fdo_connection;
   gboolean display_on;
-  gboolean has_disconnected_account;
-  GHashTable *connection_managers;
-  guint cms_list_idle_tag;
+  guint blink_id;
+  gboolean blink_phase;
+  guint blink_onset;
+  guint blink_limit;
+  gint64 connecting_since;
+  guint blink_policy_id;
+  gint64 blink_policy_deadline;
   time_t last_info_time;
+  guint request_name_id;
+  gint64 startup_times[PUI_MASTER_STARTUP_N_PHASES];
+  PuiMasterStats stats;
+  guint stats_signal_id;
+  guint watchdog_budget;
+  guint global_presence_changed_id;
+  TpConnectionPresenceType emitted_presence_type;
+  gchar *emitted_status_message;
+  guint emitted_status;
+  PuiSnapshot *snapshot;
+  PuiSnapshotData *snapshot_data;
+  /* the instance owning com.nokia.PresenceUI, while we are a thin client */
+  DBusGProxy *owner_proxy;
+  gchar *owner_status_message;
 };
 
 typedef struct _PuiMasterPrivate PuiMasterPrivate;
@@ -95,6 +142,8 @@ enum
   AVATAR_CHANGED,
   PRESENCE_SUPPORT,
   SCREEN_STATE_CHANGED,
+  GLOBAL_PRESENCE_CHANGED,
+  BLINK,
   LAST_SIGNAL
 };
 
@@ -105,124 +154,182 @@ enum
   PROP_DBUS_DAEMON = 1
 };
 
-static PuiProfile default_profiles[] =
+static void
+request_name(PuiMaster *master);
+
+static gboolean
+stats_dump_cb(gpointer user_data);
+
+static gboolean
+spans_dump_cb(gpointer user_data);
+
+static void
+watchdog_init(PuiMaster *master)
 {
-  {
-    "pres_fi_status_online",
-    "general_presence_online",
-    "statusarea_presence_online_error",
-    TRUE,
-    NULL,
-    "available"
-  },
-  {
-    "pres_fi_status_busy",
-    "general_presence_busy",
-    "statusarea_presence_busy_error",
-    TRUE,
-    NULL,
-    "busy"
-  },
-  {
-    "pres_fi_status_offline",
-    "general_presence_offline",
-    "general_presence_offline",
-    TRUE,
-    NULL,
-    "offline"
-  }
+  const gchar *budget = g_getenv(PUI_WATCHDOG_ENV);
+  guint64 ms;
+
+  if (!budget || !*budget)
+    return;
+
+  ms = g_ascii_strtoull(budget, NULL, 10);
+
+  if (!ms || (ms > G_MAXUINT))
+    ms = PUI_WATCHDOG_DEFAULT_BUDGET;
+
+  PRIVATE(master)->watchdog_budget = ms;
+  g_info("Main loop watchdog budget is %u ms", (guint)ms);
+}
+
+gint64
+pui_master_watchdog_begin(PuiMaster *master)
+{
+  g_return_val_if_fail(PUI_IS_MASTER(master), 0);
+
+  return PRIVATE(master)->watchdog_budget ? g_get_monotonic_time() : 0;
+}
+
+void
+pui_master_watchdog_end(PuiMaster *master, const gchar *name, gint64 start)
+{
+  PuiMasterPrivate *priv;
+  guint ms;
+
+  g_return_if_fail(PUI_IS_MASTER(master));
+
+  if (!start)
+    return;
+
+  priv = PRIVATE(master);
+  ms = (g_get_monotonic_time() - start) / 1000;
+
+  if (ms <= priv->watchdog_budget)
+    return;
+
+  priv->stats.slow_dispatches++;
+
+  if (ms > priv->stats.slow_dispatch_max_ms)
+    priv->stats.slow_dispatch_max_ms = ms;
+
+  g_warning("%s blocked the main loop for %u ms, budget is %u ms", name, ms,
+            priv->watchdog_budget);
+}
+
+struct _PuiWatchedCallback
+{
+  PuiMaster *master;
+  const gchar *name;
+  GSourceFunc func;
+  gint64 start;
 };
 
-static TpAccountManager *
-create_account_manager(PuiMaster *self, TpDBusDaemon *dbus);
+typedef struct _PuiWatchedCallback PuiWatchedCallback;
 
 static void
-on_account_manager_invalidate_cb (TpProxy *self, guint domain, gint code,
-                                  gchar *message, gpointer user_data);
+watched_callback_free(gpointer data, GClosure *closure)
+{
+  g_slice_free(PuiWatchedCallback, data);
+}
 
 static gboolean
-tp_account_is_not_sip(TpAccount *account)
+watched_source_dispatch(gpointer user_data)
 {
-  const gchar *protocol_name = tp_account_get_protocol_name(account);
+  PuiWatchedCallback *watched = user_data;
+  gint64 start = pui_wakeup_enter();
+  gboolean rv = watched->func(watched->master);
+
+  pui_wakeup_leave(watched->name, start);
 
-  g_return_val_if_fail(protocol_name, TRUE);
+  if (PRIVATE(watched->master)->watchdog_budget)
+    pui_master_watchdog_end(watched->master, watched->name, start);
 
-  return strcmp(protocol_name, "sip") ? TRUE : FALSE;
+  return rv;
 }
 
-static gboolean
-account_get_by_id(PuiMaster *master, const char *account_id, GtkTreeIter *iter)
+static void
+watched_source_free(gpointer data)
 {
-  PuiMasterPrivate *priv = PRIVATE(master);
-  GtkTreeIter it;
+  watched_callback_free(data, NULL);
+}
 
-  if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(priv->list_store), &it))
-  {
-    do
-    {
-      TpAccount *account;
+/* Attaches source with func(master) as callback. All main loop sources of
+ * PuiMaster go through here, so wakeup accounting and the watchdog see
+ * them. */
+static guint
+master_source_add(PuiMaster *master, GSource *source, gint priority,
+                  const gchar *name, GSourceFunc func)
+{
+  PuiWatchedCallback *watched = g_slice_new0(PuiWatchedCallback);
+  guint id;
 
-      gtk_tree_model_get(GTK_TREE_MODEL(priv->list_store), &it,
-                         COLUMN_ACCOUNT, &account,
-                         -1);
+  g_source_set_name(source, name);
+  g_source_set_priority(source, priority);
 
-      if (account)
-      {
-        if (!strcmp(tp_account_get_path_suffix(account), account_id))
-        {
-          if (iter)
-            *iter = it;
+  watched->master = master;
+  watched->name = name;
+  watched->func = func;
+  g_source_set_callback(source, watched_source_dispatch, watched,
+                        watched_source_free);
 
-          g_object_unref(account);
-          return TRUE;
-        }
+  id = g_source_attach(source, NULL);
+  g_source_unref(source);
 
-        g_object_unref(account);
-      }
-    }
-    while (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->list_store), &it));
-  }
+  return id;
+}
 
-  return FALSE;
+static guint
+master_timeout_add(PuiMaster *master, guint interval, const gchar *name,
+                   GSourceFunc func)
+{
+  return master_source_add(master, g_timeout_source_new(interval),
+                           G_PRIORITY_DEFAULT, name, func);
 }
 
-static gboolean
-account_can_change_presence(PuiMaster *master, TpAccount *account)
+static guint
+master_timeout_add_seconds(PuiMaster *master, guint interval,
+                           const gchar *name, GSourceFunc func)
 {
-  TpProtocol *protocol = pui_master_get_account_protocol(master, account);
-  GList *presences, *l;
-  gboolean rv = FALSE;
+  return master_source_add(master, g_timeout_source_new_seconds(interval),
+                           G_PRIORITY_DEFAULT, name, func);
+}
 
-  g_return_val_if_fail(protocol, FALSE);
+static void
+watched_signal_pre(gpointer data, GClosure *closure)
+{
+  PuiWatchedCallback *watched = data;
 
-  if (!tp_proxy_has_interface_by_id(protocol,
-                                    TP_IFACE_QUARK_PROTOCOL_INTERFACE_PRESENCE))
-  {
-    return FALSE;
-  }
+  watched->start = pui_master_watchdog_begin(watched->master);
+}
 
-  presences = tp_protocol_dup_presence_statuses(protocol);
+static void
+watched_signal_post(gpointer data, GClosure *closure)
+{
+  PuiWatchedCallback *watched = data;
 
-  /* assume we can if list is empty */
-  if (!presences)
-    return TRUE;
+  pui_master_watchdog_end(watched->master, watched->name, watched->start);
+}
 
-  for (l = presences; l; l = l->next)
-  {
-    TpConnectionPresenceType type =
-      tp_presence_status_spec_get_presence_type(l->data);
+/* g_signal_connect() with master as user data, timed by the watchdog */
+static gulong
+master_signal_connect(PuiMaster *master, gpointer instance,
+                      const gchar *signal, GCallback callback)
+{
+  PuiWatchedCallback *watched;
+  GClosure *closure;
 
-    if ((type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE) ||
-        (type == TP_CONNECTION_PRESENCE_TYPE_AVAILABLE))
-    {
-      rv = TRUE;
-      break;
-    }
-  }
+  if (!PRIVATE(master)->watchdog_budget)
+    return g_signal_connect(instance, signal, callback, master);
 
-  g_list_free_full(presences, (GDestroyNotify)tp_presence_status_spec_free);
+  watched = g_slice_new0(PuiWatchedCallback);
+  watched->master = master;
+  watched->name = signal;
 
-  return rv;
+  closure = g_cclosure_new(callback, master, NULL);
+  g_closure_add_marshal_guards(closure, watched, watched_signal_pre, watched,
+                               watched_signal_post);
+  g_closure_add_finalize_notifier(closure, watched, watched_callback_free);
+
+  return g_signal_connect_closure(instance, signal, closure, FALSE);
 }
 
 static void
@@ -239,417 +346,278 @@ master_presence_changed_cb(PuiMaster *master)
     pui_location_start(priv->location);
 }
 
-static void
-list_store_enable_sort(GtkTreeSortable *sortable, gboolean enable)
+static gboolean
+global_presence_changed_timeout(gpointer user_data)
 {
-  gint id;
+  PuiMaster *master = user_data;
+  PuiMasterPrivate *priv = PRIVATE(master);
+  const gchar *status_message = priv->status_message;
 
-  if (enable)
-    id = GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID;
-  else
-    id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+  priv->global_presence_changed_id = 0;
+
+  if (!status_message)
+    status_message = "";
 
-  gtk_tree_sortable_set_sort_column_id(sortable, id, GTK_SORT_ASCENDING);
+  if ((priv->emitted_presence_type != priv->global_presence_type) ||
+      (priv->emitted_status != priv->global_status) ||
+      g_strcmp0(priv->emitted_status_message, status_message))
+  {
+    priv->emitted_presence_type = priv->global_presence_type;
+    priv->emitted_status = priv->global_status;
+    g_free(priv->emitted_status_message);
+    priv->emitted_status_message = g_strdup(status_message);
+
+    g_signal_emit(master, signals[GLOBAL_PRESENCE_CHANGED], 0,
+                  priv->emitted_presence_type, priv->emitted_status_message,
+                  priv->emitted_status);
+  }
+
+  return G_SOURCE_REMOVE;
 }
 
-static const char *
-get_presence_icon(TpConnectionPresenceType type)
+static void
+on_presence_changed_coalesce(PuiMaster *master, guint presence_type,
+                             const gchar *status_message, guint status,
+                             gpointer user_data)
 {
-  if (type == TP_CONNECTION_PRESENCE_TYPE_AVAILABLE)
-    return "general_presence_online";
-
-  if (type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE)
-    return "general_presence_offline";
+  PuiMasterPrivate *priv = PRIVATE(master);
 
-  return "general_presence_busy";
+  if (!priv->global_presence_changed_id)
+  {
+    priv->global_presence_changed_id =
+      master_timeout_add(master, PUI_GLOBAL_PRESENCE_INTERVAL,
+                         "global-presence-changed",
+                         global_presence_changed_timeout);
+  }
 }
 
 static gboolean
-compute_global_presence_idle(gpointer user_data)
+blink_tick_cb(gpointer user_data)
 {
   PuiMaster *master = user_data;
   PuiMasterPrivate *priv = PRIVATE(master);
-  GtkTreeModel *tree_model = GTK_TREE_MODEL(priv->list_store);
-  gchar *presence_icon_name;
-  GdkPixbuf *presence_icon;
-  TpConnectionStatus account_connection_status;
-  const gchar *account_old_presence;
-  TpConnectionStatusReason account_status_reason;
-  GtkTreeIter iter;
-  TpConnectionStatus account_old_connection_status;
-  TpAccount *account;
-  gboolean is_changing_status;
-  TpConnectionStatusReason account_old_status_reason;
-  TpConnectionPresenceType type;
 
-  list_store_enable_sort(GTK_TREE_SORTABLE(priv->list_store), FALSE);
+  priv->blink_phase = !priv->blink_phase;
+  g_signal_emit(master, signals[BLINK], 0, priv->blink_phase);
 
-  priv->global_presence_type = TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
-  priv->global_status = PUI_MASTER_STATUS_NONE;
+  return G_SOURCE_CONTINUE;
+}
 
-  if (!gtk_tree_model_get_iter_first(tree_model, &iter))
-  {
-    master_presence_changed_cb(master);
-    g_signal_emit(master, signals[PRESENCE_CHANGED], 0,
-                  TP_CONNECTION_PRESENCE_TYPE_OFFLINE, priv->status_message, 0);
-  }
-  else
-  {
-    int active_accounts_count = 0;
-    gchar *message;
+static void
+blink_update(PuiMaster *master);
 
-    do
-    {
-      gtk_tree_model_get(
-        tree_model, &iter,
-        COLUMN_ACCOUNT, &account,
-        COLUMN_CONNECTION_STATUS, &account_old_connection_status,
-        COLUMN_STATUS_REASON, &account_old_status_reason,
-        COLUMN_IS_CHANGING_STATUS, &is_changing_status,
-        -1);
-
-      if (account)
-      {
-        gboolean status_changed = TRUE;
-        gboolean can_change_presence;
-        gchar *status_message = NULL;
+static gboolean
+blink_policy_cb(gpointer user_data)
+{
+  PuiMaster *master = user_data;
 
-        can_change_presence = account_can_change_presence(master, account);
-        account_connection_status =
-          tp_account_get_connection_status(account, &account_status_reason);
+  PRIVATE(master)->blink_policy_id = 0;
+  blink_update(master);
 
-        if (account_connection_status == TP_CONNECTION_STATUS_CONNECTING)
-        {
-          if (account_old_connection_status == TP_CONNECTION_STATUS_CONNECTED)
-            play_account_disconnected(master);
+  return G_SOURCE_REMOVE;
+}
 
-          if (account_old_connection_status == TP_CONNECTION_STATUS_CONNECTING)
-            status_changed = FALSE;
+/* wakes blink_update() up at deadline, if it is not set to already */
+static void
+blink_policy_arm(PuiMaster *master, gint64 now, gint64 deadline)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
 
-          if (can_change_presence)
-          {
-            const gchar *presence =
-              pui_profile_get_presence(priv->active_profile, account);
+  if (priv->blink_policy_id && (priv->blink_policy_deadline == deadline))
+    return;
 
-            type = pui_master_get_presence_type(master, account, presence);
-          }
-          else
-            type = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
+  if (priv->blink_policy_id)
+  {
+    g_source_remove(priv->blink_policy_id);
+    priv->blink_policy_id = 0;
+  }
 
-          priv->global_status |= PUI_MASTER_STATUS_CONNECTING;
-        }
-        else if (account_connection_status == TP_CONNECTION_STATUS_DISCONNECTED)
-        {
-          const gchar *err_msg;
-          const gchar *presence;
-
-          if (account_old_connection_status == TP_CONNECTION_STATUS_CONNECTED)
-            play_account_disconnected(master);
-
-          presence = pui_profile_get_presence(priv->active_profile,
-                                              account);
-
-          if (!(pui_master_get_presence_type(master, account, presence) ==
-                TP_CONNECTION_PRESENCE_TYPE_OFFLINE))
-          {
-            priv->global_status |= PUI_MASTER_STATUS_ERROR;
-
-            if (is_changing_status &&
-                (account_status_reason !=
-                 TP_CONNECTION_STATUS_REASON_REQUESTED))
-            {
-              priv->global_status |= PUI_MASTER_STATUS_REASON_ERROR;
-            }
-
-            switch (account_status_reason)
-            {
-              case TP_CONNECTION_STATUS_REASON_NONE_SPECIFIED:
-              case TP_CONNECTION_STATUS_REASON_NETWORK_ERROR:
-              {
-                err_msg = _("pres_li_network_error");
-                break;
-              }
-              case TP_CONNECTION_STATUS_REASON_REQUESTED:
-              {
-                err_msg = _("pres_ib_network_error");
-                break;
-              }
-              case TP_CONNECTION_STATUS_REASON_AUTHENTICATION_FAILED:
-              {
-                err_msg = _("pres_li_authentication_error");
-                break;
-              }
-              case TP_CONNECTION_STATUS_REASON_ENCRYPTION_ERROR:
-              {
-                err_msg = _("pres_li_encryption_error");
-                break;
-              }
-              case TP_CONNECTION_STATUS_REASON_NAME_IN_USE:
-              {
-                err_msg = _("pres_li_error_name_in_use");
-                break;
-              }
-              case TP_CONNECTION_STATUS_REASON_CERT_NOT_PROVIDED:
-              case TP_CONNECTION_STATUS_REASON_CERT_UNTRUSTED:
-              case TP_CONNECTION_STATUS_REASON_CERT_EXPIRED:
-              case TP_CONNECTION_STATUS_REASON_CERT_NOT_ACTIVATED:
-              case TP_CONNECTION_STATUS_REASON_CERT_HOSTNAME_MISMATCH:
-              case TP_CONNECTION_STATUS_REASON_CERT_FINGERPRINT_MISMATCH:
-              case TP_CONNECTION_STATUS_REASON_CERT_SELF_SIGNED:
-              case TP_CONNECTION_STATUS_REASON_CERT_OTHER_ERROR:
-              {
-                err_msg = _("pres_li_error_certificate");
-                break;
-              }
-              default:
-              {
-                err_msg = NULL;
-                break;
-              }
-            }
-
-#if 0
-            gtk_tree_model_get(tree_model, &iter,
-                               COLUMN_STATUS_MESSAGE, &message,
-                               -1);
-            g_free(message);
-#endif
-
-            if (err_msg)
-            {
-              const gchar *fmt = _("pres_li_account_with_error");
-
-              status_message = g_strdup_printf(fmt, err_msg);
-            }
-          }
-
-          type = TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
-        }
-        else
-        {
-          gboolean not_sip;
-          gboolean msg_diff = FALSE;
-
-          if (account_old_connection_status != TP_CONNECTION_STATUS_CONNECTED)
-            play_account_connected(master);
-          else
-            status_changed = FALSE;
-
-          type = tp_account_get_current_presence(account, NULL, &message);
-
-          if (!can_change_presence)
-            type = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
-
-          not_sip = tp_account_is_not_sip(account);
-
-          if (not_sip)
-          {
-            const char *s = priv->status_message;
-
-            priv->global_status |= PUI_MASTER_STATUS_CONNECTED;
-
-            if (!s)
-              s = "";
-
-            msg_diff = g_strcmp0(message, s);
-          }
-
-          if (not_sip && msg_diff)
-          {
-            account_status_reason = 'r';
-            status_message = message;
-            priv->global_status |= PUI_MASTER_STATUS_MESSAGE_CHANGED;
-          }
-
-          if ((!not_sip || (not_sip && msg_diff)) && can_change_presence)
-          {
-            gboolean same_presence_type = FALSE;
-            gboolean was_offline = FALSE;
-
-            account_old_presence =
-              pui_profile_get_presence(priv->active_profile, account);
-
-            if (account_old_presence)
-            {
-              if (account_can_change_presence(master, account))
-              {
-                if (pui_master_get_presence_type(master, account,
-                                                 account_old_presence) ==
-                    tp_account_get_current_presence(account, NULL, NULL))
-                {
-                  same_presence_type = TRUE;
-                }
-              }
-              else
-              {
-                TpConnectionStatus connection_status =
-                  tp_account_get_connection_status(account, NULL);
-
-                if (!strcmp(account_old_presence, "offline"))
-                {
-                  was_offline = TRUE;
-
-                  if (connection_status != TP_CONNECTION_STATUS_DISCONNECTED)
-                    priv->global_status |= PUI_MASTER_STATUS_OFFLINE;
-                }
-                else if (connection_status == TP_CONNECTION_STATUS_CONNECTED)
-                  same_presence_type = TRUE;
-              }
-
-              if (!was_offline && !same_presence_type)
-                priv->global_status |= PUI_MASTER_STATUS_OFFLINE;
-            }
-            else if (account_old_status_reason == 'r')
-              account_status_reason = TP_CONNECTION_STATUS_REASON_REQUESTED;
-          }
-        }
+  if (deadline)
+  {
+    priv->blink_policy_deadline = deadline;
+    priv->blink_policy_id =
+      master_timeout_add(master, (deadline - now + 999) / 1000,
+                         "blink-policy", blink_policy_cb);
+  }
+}
 
-        presence_icon_name = g_strdup(get_presence_icon(type));
-        presence_icon = pui_master_get_icon(master, presence_icon_name,
-                                            ICON_SIZE_MID);
+/* The one clock every connecting indicator blinks on. It runs while some
+ * row is connecting and the display is on, but only once connecting
+ * lasted blink_onset ms, so quick reconnects do not blink, and no longer
+ * than blink_limit seconds from there on, after which indicators stay in
+ * the normal phase. The alternate, offline looking, phase starts right
+ * away and the normal one is restored when the clock stops. */
+static void
+blink_update(PuiMaster *master)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
+  gboolean connecting;
+  gint64 now = g_get_monotonic_time();
+  gint64 deadline = 0;
+  gboolean run = FALSE;
 
-        g_free(presence_icon_name);
+  if (priv->is_primary)
+    connecting = pui_accounts_get_n_connecting(priv->accounts) > 0;
+  else
+    connecting = !!(priv->global_status & PUI_MASTER_STATUS_CONNECTING);
 
-        if (status_changed)
-        {
-          gtk_list_store_set(
-            priv->list_store,
-            &iter,
-            COLUMN_PRESENCE_TYPE, type,
-            COLUMN_PRESENCE_ICON, presence_icon,
-            COLUMN_CONNECTION_STATUS, account_connection_status,
-            COLUMN_STATUS_MESSAGE, status_message,
-            COLUMN_STATUS_REASON, account_status_reason,
-            COLUMN_IS_CHANGING_STATUS, FALSE,
-            -1);
-        }
-        else
-        {
-          gtk_list_store_set(
-            priv->list_store,
-            &iter,
-            COLUMN_PRESENCE_TYPE, type,
-            COLUMN_PRESENCE_ICON, presence_icon,
-            COLUMN_CONNECTION_STATUS, account_connection_status,
-            COLUMN_IS_CHANGING_STATUS, FALSE,
-            -1);
-        }
+  connecting = connecting && !priv->disposed;
 
-        g_free(status_message);
-        g_object_unref(account);
+  if (!connecting)
+    priv->connecting_since = 0;
+  else if (!priv->connecting_since)
+    priv->connecting_since = now;
 
-        if (can_change_presence)
-        {
-          if (type == TP_CONNECTION_PRESENCE_TYPE_AVAILABLE)
-            priv->global_presence_type = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
-          else if ((priv->global_presence_type !=
-                    TP_CONNECTION_PRESENCE_TYPE_AVAILABLE) &&
-                   (type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE))
-          {
-            priv->global_presence_type = TP_CONNECTION_PRESENCE_TYPE_BUSY;
-          }
-        }
-        else
-        {
-          if ((account_connection_status == TP_CONNECTION_STATUS_CONNECTED) ||
-              (account_connection_status == TP_CONNECTION_STATUS_CONNECTING))
-          {
-            active_accounts_count++;
-          }
-        }
-      }
-    }
-    while (gtk_tree_model_iter_next(tree_model, &iter));
+  if (connecting && priv->display_on)
+  {
+    gint64 onset = priv->connecting_since + priv->blink_onset * 1000ll;
+    gint64 limit = priv->blink_limit ?
+      onset + priv->blink_limit * G_USEC_PER_SEC : 0;
 
-    if ((priv->global_presence_type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE) &&
-        (active_accounts_count > 0))
+    if (now < onset)
+      deadline = onset;
+    else if (!limit || (now < limit))
     {
-      priv->global_presence_type = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
+      run = TRUE;
+      deadline = limit;
     }
+  }
+
+  blink_policy_arm(master, now, deadline);
 
-    master_presence_changed_cb(master);
+  if (run == !!priv->blink_id)
+    return;
 
-    g_signal_emit(master, signals[PRESENCE_CHANGED], 0,
-                  priv->global_presence_type, priv->status_message,
-                  priv->global_status);
+  if (run)
+  {
+    priv->blink_id = master_timeout_add_seconds(master, PUI_BLINK_INTERVAL,
+                                                "blink", blink_tick_cb);
+    priv->blink_phase = TRUE;
+    g_signal_emit(master, signals[BLINK], 0, priv->blink_phase);
+  }
+  else
+  {
+    g_source_remove(priv->blink_id);
+    priv->blink_id = 0;
 
-    if (priv->global_status & PUI_MASTER_STATUS_REASON_ERROR)
+    if (priv->blink_phase)
     {
-      if (priv->has_disconnected_account)
-      {
-        priv->has_disconnected_account = FALSE;
-
-        if (time(0) - priv->last_info_time > 59)
-        {
-          priv->last_info_time = time(NULL);
-          hildon_banner_show_information(
-            priv->parent, NULL, _("pres_ib_unable_to_connect_to_service"));
-        }
-      }
+      priv->blink_phase = FALSE;
+      g_signal_emit(master, signals[BLINK], 0, priv->blink_phase);
     }
   }
+}
+
+static void
+list_store_enable_sort(PuiMaster *master, gboolean enable)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
+  gint id;
 
-  list_store_enable_sort(GTK_TREE_SORTABLE(priv->list_store), TRUE);
-  priv->compute_global_presence_id = 0;
+  if (enable)
+  {
+    id = GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID;
+    priv->stats.resorts++;
+  }
+  else
+    id = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
 
-  return FALSE;
+  gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(priv->list_store),
+                                       id, GTK_SORT_ASCENDING);
 }
 
-static void
-compute_global_presence_delayed(PuiMaster *master)
+static const char *
+get_presence_icon(TpConnectionPresenceType type)
 {
-  PuiMasterPrivate *priv;
+  if (type == TP_CONNECTION_PRESENCE_TYPE_AVAILABLE)
+    return "general_presence_online";
 
-  g_return_if_fail(PUI_IS_MASTER(master));
+  if (type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE)
+    return "general_presence_offline";
 
-  priv = PRIVATE(master);
+  return "general_presence_busy";
+}
+
+/* Sorting is held from the first change of a sort key until presence is
+ * recomputed, which follows every such change, so the store gets sorted
+ * once per recompute rather than once per row written. */
+static void
+list_store_hold_sort(PuiMaster *master)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
 
-  if (!priv->compute_global_presence_id)
+  if (!priv->sort_held)
   {
-    priv->compute_global_presence_id =
-      g_idle_add(compute_global_presence_idle, master);
+    priv->sort_held = TRUE;
+    list_store_enable_sort(master, FALSE);
   }
 }
 
 static void
-account_remove(PuiMaster *master, GtkTreeIter *iter)
+list_store_release_sort(PuiMaster *master)
 {
   PuiMasterPrivate *priv = PRIVATE(master);
-  TpAccount *account;
-
-  gtk_tree_model_get(GTK_TREE_MODEL(priv->list_store), iter,
-                     COLUMN_ACCOUNT, &account,
-                     -1);
 
-  if (account_can_change_presence(master, account))
+  if (priv->sort_held)
   {
-    priv->presence_supported_count--;
-
-    if (priv->presence_supported_count == 0)
-      g_signal_emit(master, signals[PRESENCE_SUPPORT], 0, FALSE);
+    priv->sort_held = FALSE;
+    list_store_enable_sort(master, TRUE);
   }
+}
 
-  g_object_unref(account);
-  gtk_list_store_remove(priv->list_store, iter);
-  compute_global_presence_delayed(master);
+static void
+snapshot_add_account(PuiSnapshotData *data, const PuiAccountsRow *row)
+{
+  PuiSnapshotAccount *snapshot_account;
+
+  if (data->n_accounts >= PUI_SNAPSHOT_MAX_ACCOUNTS)
+    return;
+
+  snapshot_account = &data->accounts[data->n_accounts++];
+  g_strlcpy(snapshot_account->account_id,
+            tp_account_get_path_suffix(row->account),
+            sizeof(snapshot_account->account_id));
+  snapshot_account->presence_type = row->presence_type;
+  snapshot_account->connection_status = row->connection_status;
+  snapshot_account->status_reason = row->status_reason;
 }
 
 static void
-on_account_disabled_cb(TpAccountManager *am, TpAccount *account,
-                       PuiMaster *master)
+snapshot_commit(PuiMaster *master)
 {
-  GtkTreeIter iter;
   PuiMasterPrivate *priv = PRIVATE(master);
+  PuiSnapshotData *data = priv->snapshot_data;
+  const GList *l;
+
+  if (!priv->snapshot)
+    return;
+
+  memset(data, 0, sizeof(*data));
+  data->presence_type = priv->global_presence_type;
+  data->status = priv->global_status;
+  data->active_profile = g_list_index(priv->core->profiles,
+                                      priv->core->active_profile);
 
-  if (account_get_by_id(master, tp_account_get_path_suffix(account), &iter))
-    account_remove(master, &iter);
+  for (l = pui_accounts_get_rows(priv->accounts); l; l = l->next)
+    snapshot_add_account(data, l->data);
 
-  if (gtk_tree_model_iter_n_children(
-        GTK_TREE_MODEL(priv->list_store), NULL) == 1)
+  if (priv->status_message)
   {
-    pui_master_activate_profile(master, default_profiles);
-    pui_master_save_config(master);
+    g_strlcpy(data->status_message, priv->status_message,
+              sizeof(data->status_message));
   }
+
+  if (pui_snapshot_update(priv->snapshot, data))
+    g_debug("Presence snapshot updated");
+}
+
+static void
+startup_mark(PuiMaster *master, PuiMasterStartupPhase phase)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
+
+  if (!priv->startup_times[phase])
+    priv->startup_times[phase] = g_get_monotonic_time();
 }
 
 static GdkPixbuf *
@@ -693,80 +661,18 @@ avatar_to_pixbuf(const guchar *data, gsize len, const char *mime_type)
 }
 
 static void
-get_avatar_ready_cb(TpProxy *proxy, const GValue *out_Value,
-                    const GError *error, gpointer user_data,
-                    GObject *weak_object)
-{
-  if (error)
-  {
-    g_warning("%s: Could not get new avatar data %s", __FUNCTION__,
-              error->message);
-  }
-  else if (!G_VALUE_HOLDS(out_Value, TP_STRUCT_TYPE_AVATAR))
-  {
-    g_warning("%s: Avatar had wrong type: %s", __FUNCTION__,
-              G_VALUE_TYPE_NAME(out_Value));
-  }
-  else
-  {
-    TpAccount *account = (TpAccount *)proxy;
-    PuiMaster *master = PUI_MASTER(weak_object);
-    PuiMasterPrivate *priv = PRIVATE(master);
-    GdkPixbuf *pixbuf = NULL;
-    TpAccount *local_account;
-    GtkTreeIter it;
-    GValueArray *array = g_value_get_boxed(out_Value);
-    const GArray *avatar;
-    const gchar *mime_type;
-
-    tp_value_array_unpack(array, 2, &avatar, &mime_type);
-
-    if (avatar)
-      pixbuf = avatar_to_pixbuf((guchar *)avatar->data, avatar->len, mime_type);
-
-    if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(priv->list_store), &it))
-    {
-      do
-      {
-        gtk_tree_model_get(GTK_TREE_MODEL(priv->list_store), &it,
-                           COLUMN_ACCOUNT, &local_account, -1);
-
-        if (account == local_account)
-          gtk_list_store_set(priv->list_store, &it, COLUMN_AVATAR, pixbuf, -1);
-
-        if (local_account)
-          g_object_unref(local_account);
-      }
-      while (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->list_store), &it));
-    }
-
-    if (pixbuf)
-      g_object_unref(pixbuf);
-  }
-}
-
-static void
-avatar_changed_cb(TpAccount *account, gpointer user_data)
-{
-  tp_cli_dbus_properties_call_get(
-    account, -1, TP_IFACE_ACCOUNT_INTERFACE_AVATAR, "Avatar",
-    get_avatar_ready_cb, NULL, NULL, user_data);
-}
-
-static void
-account_add_to_store(PuiMaster *master, TpAccount *account,
-                     gboolean set_presence)
+accounts_row_inserted_cb(PuiAccounts *accounts, PuiAccountsRow *row,
+                         PuiMaster *master)
 {
   PuiMasterPrivate *priv = PRIVATE(master);
-  const gchar *icon_name;
+  const gchar *icon_name = tp_account_get_icon_name(row->account);
   GdkPixbuf *icon = NULL;
-  TpConnectionStatus connection_status;
-
-  icon_name = tp_account_get_icon_name(account);
+  GtkTreeIter iter;
 
   if (!icon_name)
   {
-    TpProtocol *protocol = pui_master_get_account_protocol(master, account);
+    TpProtocol *protocol =
+      pui_master_get_account_protocol(master, row->account);
 
     if (protocol)
       icon_name = tp_protocol_get_icon_name(protocol);
@@ -778,307 +684,193 @@ account_add_to_store(PuiMaster *master, TpAccount *account,
                                     ICON_SIZE_MID, 0, NULL);
   }
 
-  avatar_changed_cb(account, master);
-  connection_status = tp_account_get_connection_status(account, NULL);
-
+  list_store_hold_sort(master);
   gtk_list_store_insert_with_values(
-    priv->list_store, NULL, G_MAXINT32,
-    COLUMN_ACCOUNT, account,
+    priv->list_store, &iter, G_MAXINT32,
+    COLUMN_ACCOUNT, row->account,
+    COLUMN_PRESENCE_TYPE, row->presence_type,
     COLUMN_SERVICE_ICON, icon,
     COLUMN_AVATAR, NULL,
-    COLUMN_CONNECTION_STATUS, connection_status,
-    COLUMN_STATUS_REASON, TP_CONNECTION_STATUS_REASON_REQUESTED,
-    COLUMN_IS_CHANGING_STATUS, FALSE,
+    COLUMN_CONNECTION_STATUS, row->connection_status,
+    COLUMN_STATUS_REASON, row->status_reason,
+    COLUMN_IS_CHANGING_STATUS, row->is_changing_status,
     -1);
-
-  if (connection_status == TP_CONNECTION_STATUS_CONNECTED)
-    play_account_connected(master);
+  g_hash_table_insert(priv->rows, row, gtk_tree_iter_copy(&iter));
 
   if (icon)
     g_object_unref(icon);
-
-  if (account_can_change_presence(master, account))
-  {
-    priv->presence_supported_count++;
-
-    if (priv->presence_supported_count == 1)
-      g_signal_emit(master, signals[PRESENCE_SUPPORT], COLUMN_ACCOUNT);
-  }
-
-  if (set_presence)
-    pui_master_set_account_presence(master, account, TRUE, TRUE);
-
-  compute_global_presence_delayed(master);
 }
 
-static gboolean
-account_get(PuiMaster *master, TpAccount *account, GtkTreeIter *iter)
+static void
+accounts_row_deleted_cb(PuiAccounts *accounts, PuiAccountsRow *row,
+                        PuiMaster *master)
 {
   PuiMasterPrivate *priv = PRIVATE(master);
-  TpAccount *local_account;
+  GtkTreeIter *iter = g_hash_table_lookup(priv->rows, row);
 
-  if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(priv->list_store), iter))
-  {
-    do
-    {
-      gtk_tree_model_get(GTK_TREE_MODEL(priv->list_store), iter,
-                         COLUMN_ACCOUNT, &local_account,
-                         -1);
+  g_return_if_fail(iter != NULL);
 
-      if (account == local_account)
-        return TRUE;
-    }
-    while (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->list_store), iter));
-  }
-
-  return FALSE;
+  gtk_list_store_remove(priv->list_store, iter);
+  g_hash_table_remove(priv->rows, row);
 }
 
 static void
-presence_changed_cb(TpAccount *account, guint presence, gchar *status,
-                    gchar *status_message, PuiMaster *master)
+accounts_row_changed_cb(PuiAccounts *accounts, PuiAccountsRow *row,
+                        guint changed, PuiMaster *master)
 {
   PuiMasterPrivate *priv = PRIVATE(master);
-  GtkTreeIter iter;
+  GtkTreeIter *iter = g_hash_table_lookup(priv->rows, row);
+  GValue values[7];
+  gint columns[7];
+  gint n = 0;
+  gint i;
 
-  if (account_get(master, account, &iter))
-  {
-    gtk_list_store_set(priv->list_store, &iter,
-                       COLUMN_IS_CHANGING_STATUS, TRUE,
-                       -1);
-  }
+  g_return_if_fail(iter != NULL);
 
-  compute_global_presence_delayed(master);
-}
+  memset(values, 0, sizeof(values));
 
-static void
-on_requested_presence_changed_cb(TpAccount *account, GParamSpec *pspec,
-                                 PuiMaster *master)
-{
-  GtkTreeIter iter;
+  /* presence type and status message are sort keys */
+  if (changed & (PUI_ACCOUNTS_ROW_PRESENCE | PUI_ACCOUNTS_ROW_MESSAGE))
+    list_store_hold_sort(master);
 
-  if (tp_account_get_connection_status(account, NULL) ==
-      TP_CONNECTION_STATUS_CONNECTING)
+  if (changed & PUI_ACCOUNTS_ROW_PRESENCE)
   {
-    PuiMasterPrivate *priv = PRIVATE(master);
-
-    if (account_get(master, account, &iter))
-    {
-      gtk_list_store_set(priv->list_store, &iter,
-                         COLUMN_IS_CHANGING_STATUS, TRUE,
-                         -1);
-    }
-
-    compute_global_presence_delayed(master);
+    columns[n] = COLUMN_PRESENCE_TYPE;
+    g_value_init(&values[n], G_TYPE_UINT);
+    g_value_set_uint(&values[n++], row->presence_type);
+    columns[n] = COLUMN_PRESENCE_ICON;
+    g_value_init(&values[n], GDK_TYPE_PIXBUF);
+    g_value_set_object(&values[n++], pui_master_get_icon(
+                         master, get_presence_icon(row->presence_type),
+                         ICON_SIZE_MID));
   }
-}
-
-static void
-status_changed_cb(TpAccount *account, guint old_status, guint new_status,
-                  guint reason, gchar *dbus_error_name, GHashTable *details,
-                  PuiMaster *master)
-{
-  PuiMasterPrivate *priv = PRIVATE(master);
-  GtkTreeIter it;
-
-  if (!account_get(master, account, &it))
-    return;
 
-  gtk_list_store_set(priv->list_store, &it,
-                     COLUMN_IS_CHANGING_STATUS, TRUE,
-                     -1);
+  if (changed & PUI_ACCOUNTS_ROW_STATUS)
+  {
+    columns[n] = COLUMN_CONNECTION_STATUS;
+    g_value_init(&values[n], G_TYPE_UINT);
+    g_value_set_uint(&values[n++], row->connection_status);
+  }
 
-  if ((reason != TP_CONNECTION_STATUS_REASON_REQUESTED) &&
-      (new_status == TP_CONNECTION_STATUS_DISCONNECTED))
+  if (changed & PUI_ACCOUNTS_ROW_MESSAGE)
   {
-    const gchar *id = tp_account_get_path_suffix(account);
+    columns[n] = COLUMN_STATUS_MESSAGE;
+    g_value_init(&values[n], G_TYPE_STRING);
+    g_value_set_string(&values[n++], row->status_message);
+    columns[n] = COLUMN_STATUS_REASON;
+    g_value_init(&values[n], G_TYPE_UINT);
+    g_value_set_uint(&values[n++], row->status_reason);
+  }
 
-    if (!g_hash_table_lookup(priv->disconnected_accounts, id))
-    {
-      g_hash_table_insert(priv->disconnected_accounts, g_strdup(id),
-                          GINT_TO_POINTER(1));
-      priv->has_disconnected_account = TRUE;
-    }
+  if (changed & PUI_ACCOUNTS_ROW_CHANGING)
+  {
+    columns[n] = COLUMN_IS_CHANGING_STATUS;
+    g_value_init(&values[n], G_TYPE_BOOLEAN);
+    g_value_set_boolean(&values[n++], row->is_changing_status);
   }
 
-  if ((reason == TP_CONNECTION_STATUS_REASON_REQUESTED) &&
-      (new_status == TP_CONNECTION_STATUS_DISCONNECTED))
+  if (changed & PUI_ACCOUNTS_ROW_CONNECT_TIME)
   {
-    g_hash_table_remove_all(priv->disconnected_accounts);
+    columns[n] = COLUMN_CONNECT_TIME;
+    g_value_init(&values[n], G_TYPE_UINT);
+    g_value_set_uint(&values[n++], row->connect_time);
   }
 
-  compute_global_presence_delayed(master);
+  /* a single row-changed for views, however many columns changed */
+  priv->stats.model_writes++;
+  gtk_list_store_set_valuesv(priv->list_store, iter, columns, values, n);
+
+  for (i = 0; i < n; i++)
+    g_value_unset(&values[i]);
 }
 
 static void
-on_property_changed(TpAccount *account, GParamSpec *pspec,
-                    PuiMaster *master)
+accounts_avatar_changed_cb(PuiAccounts *accounts, PuiAccountsRow *row,
+                           const GArray *avatar, const gchar *mime_type,
+                           PuiMaster *master)
 {
-  GtkTreeIter it;
-  gboolean found;
+  PuiMasterPrivate *priv = PRIVATE(master);
+  GtkTreeIter *iter = g_hash_table_lookup(priv->rows, row);
+  GdkPixbuf *pixbuf = NULL;
 
-  found = account_get_by_id(master, tp_account_get_path_suffix(account), &it);
+  g_return_if_fail(iter != NULL);
 
-  if (tp_account_is_valid(account) &&
-      tp_account_is_enabled(account) &&
-      tp_account_get_has_been_online(account))
+  if (avatar)
   {
-    if (!found)
-      account_add_to_store(master, account, TRUE);
+    gint64 start = pui_master_watchdog_begin(master);
+
+    priv->stats.avatar_decodes++;
+    pixbuf = avatar_to_pixbuf((guchar *)avatar->data, avatar->len, mime_type);
+    pui_master_watchdog_end(master, "avatar_to_pixbuf", start);
   }
-  else if (found)
-    account_remove(master, &it);
-}
 
-static void
-account_append(PuiMaster *master, TpAccount *account, gboolean set_presence)
-{
-  if (!strcmp(tp_account_get_protocol_name(account), "tel"))
-    return;
+  gtk_list_store_set(priv->list_store, iter, COLUMN_AVATAR, pixbuf, -1);
 
-  g_debug("adding account %s", tp_account_get_path_suffix(account));
-
-  g_signal_connect(account, "presence-changed",
-                   G_CALLBACK(presence_changed_cb), master);
-  g_signal_connect(account, "notify::valid",
-                   G_CALLBACK(on_requested_presence_changed_cb), master);
-  g_signal_connect(account, "status-changed",
-                   G_CALLBACK(status_changed_cb), master);
-  g_signal_connect(account, "avatar-changed",
-                   G_CALLBACK(avatar_changed_cb), master);
-  g_signal_connect(account, "notify::valid",
-                   G_CALLBACK(on_property_changed), master);
-  g_signal_connect(account, "notify::enabled",
-                   G_CALLBACK(on_property_changed), master);
-  g_signal_connect(account, "notify::has-been-online",
-                   G_CALLBACK(on_property_changed), master);
-
-  if (tp_account_is_valid(account) &&
-      tp_account_is_enabled(account) &&
-      tp_account_get_has_been_online(account))
-  {
-    account_add_to_store(master, account, set_presence);
-  }
+  if (pixbuf)
+    g_object_unref(pixbuf);
 }
 
 static void
-on_account_enabled_cb(TpAccountManager *am, TpAccount *account,
-                      PuiMaster *master)
+accounts_presence_changed_cb(PuiAccounts *accounts, guint presence_type,
+                             const gchar *status_message, guint status,
+                             PuiMaster *master)
 {
-  if (!account_get_by_id(master, tp_account_get_path_suffix(account), NULL))
-  {
-    account_append(master, account, TRUE);
-    compute_global_presence_delayed(master);
-  }
+  PuiMasterPrivate *priv = PRIVATE(master);
+
+  priv->global_presence_type = presence_type;
+  priv->global_status = status;
 
+  list_store_release_sort(master);
+  snapshot_commit(master);
+  g_signal_emit(master, signals[PRESENCE_CHANGED], 0, presence_type,
+                priv->status_message, status);
+  blink_update(master);
 }
 
 static void
-on_account_validity_changed_cb(TpAccountManager *am, TpAccount *account,
-                               gboolean valid, PuiMaster *master)
+accounts_presence_support_cb(PuiAccounts *accounts, gboolean supported,
+                             PuiMaster *master)
 {
-  if (valid)
-    on_account_enabled_cb(am, account, master);
-  else
-    on_account_disabled_cb(am, account, master);
+  g_signal_emit(master, signals[PRESENCE_SUPPORT], 0, supported);
 }
 
 static void
-on_list_cms_ready_cb(GObject *object, GAsyncResult *res, gpointer user_data)
+accounts_account_connected_cb(PuiAccounts *accounts, PuiMaster *master)
 {
-  PuiMaster *master = PUI_MASTER(user_data);
-  PuiMasterPrivate *priv = PRIVATE(master);
-  GError *error = NULL;
-  GList *cms = tp_list_connection_managers_finish(res, &error);
-  GList *l;
-
-  if (error != NULL)
-  {
-    g_warning("Error getting list of CMs: %s", error->message);
-    g_error_free(error);
-  }
-  else if (!cms)
-    g_warning("No Telepathy connection managers found");
-
-  for (l = cms; l; l = l->next)
-  {
-    const char *cm_name = tp_connection_manager_get_name(l->data);
-
-    g_debug("Adding cm %s", cm_name);
-    g_hash_table_insert(priv->connection_managers, g_strdup(cm_name), l->data);
-  }
-
-  g_list_free(cms);
-
-  if (!priv->accounts_added)
-  {
-    GList *accounts = tp_account_manager_dup_valid_accounts(priv->manager);
-    GList *l;
-
-    for (l = accounts; l; l = l->next)
-      account_append(master, l->data, FALSE);
-
-    g_list_free_full(accounts, g_object_unref);
-
-    priv->accounts_added = TRUE;
-  }
+  play_account_connected(master);
 }
 
-static gboolean
-cms_list_idle(gpointer user_data)
+static void
+accounts_account_disconnected_cb(PuiAccounts *accounts, PuiMaster *master)
 {
-  PuiMasterPrivate *priv = PRIVATE(user_data);
-
-  priv->cms_list_idle_tag = 0;
-
-  g_debug("Getting connecton managers...");
-
-  tp_list_connection_managers_async(tp_proxy_get_dbus_daemon(priv->manager),
-                                    on_list_cms_ready_cb, user_data);
-
-  return G_SOURCE_REMOVE;
+  play_account_disconnected(master);
 }
 
 static void
-on_manager_ready(GObject *object, GAsyncResult *res, gpointer user_data)
+accounts_account_disabled_cb(PuiAccounts *accounts, TpAccount *account,
+                             PuiMaster *master)
 {
-  PuiMaster *master = user_data;
   PuiMasterPrivate *priv = PRIVATE(master);
-  GError *error = NULL;
 
-  if (!tp_proxy_prepare_finish(object, res, &error))
-  {
-    g_warning("Error preparing AM: %s\n", error->message);
-    g_error_free(error);
-  }
-  else
+  if (!pui_accounts_get_rows(accounts))
   {
-    g_debug("Account manager ready");
-
-    priv->cms_list_idle_tag = g_idle_add(cms_list_idle, master);
+    pui_master_activate_profile(master,
+                                pui_core_get_default_profile(priv->core));
+    pui_master_save_config(master);
   }
 }
 
 static void
-register_dbus(PuiMaster *self, DBusGConnection *gconnection)
+accounts_connection_error_cb(PuiAccounts *accounts, PuiMaster *master)
 {
-  DBusConnection *connection;
-  DBusError error;
-
-  dbus_error_init(&error);
-  connection = dbus_g_connection_get_connection(gconnection);
-  dbus_bus_request_name(connection, "com.nokia.PresenceUI", 0, &error);
+  PuiMasterPrivate *priv = PRIVATE(master);
 
-  if (dbus_error_is_set(&error))
+  if (time(0) - priv->last_info_time > 59)
   {
-    g_error("Error registering 'com.nokia.PresenceUI': %s", error.message);
-
-    while (1)
-      sleep(1);
+    priv->last_info_time = time(NULL);
+    hildon_banner_show_information(
+      priv->parent, NULL, _("pres_ib_unable_to_connect_to_service"));
   }
-
-  dbus_g_connection_register_g_object(gconnection, "/com/nokia/PresenceUI",
-                                      G_OBJECT(self));
 }
 
 static void
@@ -1093,8 +885,8 @@ compute_presence_message(PuiMaster *master)
 
   priv = PRIVATE(master);
 
-  if (priv->presence_message && *priv->presence_message)
-    presence_message = priv->presence_message;
+  if (priv->core->presence_message && *priv->core->presence_message)
+    presence_message = priv->core->presence_message;
 
   location = pui_location_get_location(priv->location);
 
@@ -1112,9 +904,9 @@ compute_presence_message(PuiMaster *master)
   {
     g_free(priv->status_message);
     priv->status_message = status_message;
-    priv->flags |= 1;
-    pui_master_set_presence(master);
-    compute_global_presence_delayed(master);
+    pui_accounts_set_status_message(priv->accounts, status_message);
+    pui_accounts_request_presence(priv->accounts, FALSE, TRUE);
+    pui_accounts_recompute(priv->accounts);
     return;
   }
   else
@@ -1122,150 +914,358 @@ compute_presence_message(PuiMaster *master)
 }
 
 static void
-pui_master_tp_init(PuiMaster *master)
+snapshot_close(PuiMaster *master)
 {
   PuiMasterPrivate *priv = PRIVATE(master);
 
-  g_signal_connect(priv->manager, "account-validity-changed",
-                   G_CALLBACK(on_account_validity_changed_cb), master);
-  g_signal_connect(priv->manager, "account-removed",
-                   G_CALLBACK(on_account_disabled_cb), master);
-  g_signal_connect(priv->manager, "account-enabled",
-                   G_CALLBACK(on_account_enabled_cb), master);
-  g_signal_connect(priv->manager, "account-disabled",
-                   G_CALLBACK(on_account_disabled_cb), master);
+  pui_snapshot_close(priv->snapshot);
+  priv->snapshot = NULL;
+  g_free(priv->snapshot_data);
+  priv->snapshot_data = NULL;
+}
+
+static void
+owner_presence_set(PuiMaster *master, TpConnectionPresenceType presence_type,
+                   const gchar *status_message, guint status)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
 
-  g_debug("Waiting for account manager to become ready.");
+  priv->global_presence_type = presence_type;
+  priv->global_status = status;
+  g_free(priv->owner_status_message);
+  priv->owner_status_message = g_strdup(status_message);
 
-  tp_proxy_prepare_async(priv->manager, NULL, on_manager_ready, master);
+  g_signal_emit(master, signals[PRESENCE_CHANGED], 0, presence_type,
+                priv->owner_status_message, status);
+  blink_update(master);
+}
 
-  master_presence_changed_cb(master);
-  compute_presence_message(master);
+static void
+on_owner_presence_changed(DBusGProxy *proxy, guint presence_type,
+                          const gchar *status_message, guint status,
+                          gpointer user_data)
+{
+  PuiMaster *master = user_data;
+
+  if (!PRIVATE(master)->is_primary)
+    owner_presence_set(master, presence_type, status_message, status);
 }
 
 static void
-pui_master_clear(PuiMaster *master)
+get_global_presence_cb(DBusGProxy *proxy, DBusGProxyCall *call_id,
+                       gpointer user_data)
 {
+  PuiMaster *master = user_data;
   PuiMasterPrivate *priv = PRIVATE(master);
+  GError *error = NULL;
+  guint presence_type;
+  gchar *status_message;
+  guint status;
+
+  if (!dbus_g_proxy_end_call(proxy, call_id, &error,
+                             G_TYPE_UINT, &presence_type,
+                             G_TYPE_STRING, &status_message,
+                             G_TYPE_UINT, &status,
+                             G_TYPE_INVALID))
+  {
+    /* it signals GlobalPresenceChanged once it is up */
+    g_debug("Error getting presence of '%s' owner: %s", PUI_DBUS_NAME,
+            error->message);
+    g_error_free(error);
+    return;
+  }
+
+  if (!priv->disposed && !priv->is_primary)
+    owner_presence_set(master, presence_type, status_message, status);
 
-  g_hash_table_remove_all(priv->disconnected_accounts);
-  g_hash_table_remove_all(priv->connection_managers);
+  g_free(status_message);
+}
 
-  priv->accounts_added = FALSE;
+/* Another instance owns com.nokia.PresenceUI, follow its global presence */
+static void
+owner_watch_start(PuiMaster *master)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
 
-  if (priv->cms_list_idle_tag)
+  if (!priv->owner_proxy)
   {
-    g_source_remove(priv->cms_list_idle_tag);
-    priv->cms_list_idle_tag = 0;
+    dbus_g_object_register_marshaller(
+      pui_signal_marshal_VOID__UINT_STRING_UINT, G_TYPE_NONE,
+      G_TYPE_UINT, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_INVALID);
+
+    priv->owner_proxy = dbus_g_proxy_new_for_name(
+        tp_proxy_get_dbus_connection(priv->dbus_daemon), PUI_DBUS_NAME,
+        PUI_DBUS_PATH, PUI_DBUS_NAME);
+    dbus_g_proxy_add_signal(priv->owner_proxy, "GlobalPresenceChanged",
+                            G_TYPE_UINT, G_TYPE_STRING, G_TYPE_UINT,
+                            G_TYPE_INVALID);
+    dbus_g_proxy_connect_signal(priv->owner_proxy, "GlobalPresenceChanged",
+                                G_CALLBACK(on_owner_presence_changed), master,
+                                NULL);
   }
 
-  if (priv->compute_global_presence_id)
+  dbus_g_proxy_begin_call(priv->owner_proxy, "GetGlobalPresence",
+                          get_global_presence_cb, g_object_ref(master),
+                          g_object_unref, G_TYPE_INVALID);
+}
+
+static void
+owner_watch_stop(PuiMaster *master)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
+
+  if (priv->owner_proxy)
   {
-    g_source_remove(priv->compute_global_presence_id);
-    priv->compute_global_presence_id = 0;
+    dbus_g_proxy_disconnect_signal(priv->owner_proxy, "GlobalPresenceChanged",
+                                   G_CALLBACK(on_owner_presence_changed),
+                                   master);
+    g_object_unref(priv->owner_proxy);
+    priv->owner_proxy = NULL;
   }
 
-  if (priv->set_presence_id)
+  g_free(priv->owner_status_message);
+  priv->owner_status_message = NULL;
+}
+
+/* We own com.nokia.PresenceUI, track accounts */
+static void
+on_name_acquired(PuiMaster *master)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
+
+  if (priv->is_primary)
+    return;
+
+  g_debug("Acquired '%s'", PUI_DBUS_NAME);
+
+  priv->is_primary = TRUE;
+  owner_watch_stop(master);
+
+  /* only the owner publishes presence snapshot */
+  priv->snapshot = pui_snapshot_create();
+
+  if (priv->snapshot)
+    priv->snapshot_data = g_new0(PuiSnapshotData, 1);
+
+  if (!priv->object_registered)
   {
-    g_source_remove(priv->set_presence_id);
-    priv->set_presence_id = 0;
+    dbus_g_connection_register_g_object(
+      tp_proxy_get_dbus_connection(priv->dbus_daemon), PUI_DBUS_PATH,
+      G_OBJECT(master));
+    priv->object_registered = TRUE;
   }
 
-  if (priv->list_store)
-    gtk_list_store_clear(priv->list_store);
+  pui_accounts_set_status_message(priv->accounts, priv->status_message);
+  pui_accounts_start(priv->accounts);
+  master_presence_changed_cb(master);
+  compute_presence_message(master);
+}
+
+static void
+object_unregister(PuiMaster *master)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
 
-  if (priv->manager)
+  if (priv->object_registered)
   {
-    g_signal_handlers_disconnect_by_func(
-          priv->manager, on_account_manager_invalidate_cb, master);
-    g_object_unref(priv->manager);
-    priv->manager = NULL;
+    dbus_g_connection_unregister_g_object(
+      tp_proxy_get_dbus_connection(priv->dbus_daemon), G_OBJECT(master));
+    priv->object_registered = FALSE;
   }
 }
 
+/* Another instance owns com.nokia.PresenceUI and tracks accounts, drop our
+ * telepathy state and act as a thin client of the owner */
 static void
-pui_master_account_manager_restart(PuiMaster *master)
+on_name_lost(PuiMaster *master)
 {
   PuiMasterPrivate *priv = PRIVATE(master);
-  TpDBusDaemon *dbus = g_object_ref(tp_proxy_get_dbus_daemon(priv->manager));
 
-  pui_master_clear(master);
-  priv->manager = create_account_manager(master, dbus);
+  if (!priv->is_primary)
+    return;
+
+  g_info("Lost '%s', another instance took over", PUI_DBUS_NAME);
 
-  pui_master_tp_init(master);
-  g_object_unref(dbus);
+  priv->is_primary = FALSE;
+  /* callers must reach the owner, not our empty model */
+  object_unregister(master);
+  snapshot_close(master);
+  pui_accounts_stop(priv->accounts);
+  owner_watch_start(master);
 }
 
-static void
-on_account_manager_invalidate_cb (TpProxy *self, guint domain, gint code,
-                                  gchar *message, gpointer user_data)
+static gboolean
+request_name_retry_cb(gpointer user_data)
 {
-  g_warning("Account manager invalid: %s", message);
+  PuiMaster *master = user_data;
+
+  PRIVATE(master)->request_name_id = 0;
+  request_name(master);
 
-  pui_master_account_manager_restart(PUI_MASTER(user_data));
+  return G_SOURCE_REMOVE;
 }
 
-static TpAccountManager *
-create_account_manager(PuiMaster *self, TpDBusDaemon *dbus)
+static void
+request_name_cb(DBusGProxy *proxy, DBusGProxyCall *call_id,
+                gpointer user_data)
 {
-  TpAccountManager *manager = tp_account_manager_new(dbus);
+  PuiMaster *master = user_data;
+  GError *error = NULL;
+  guint ret;
+
+  if (!dbus_g_proxy_end_call(proxy, call_id, &error,
+                             G_TYPE_UINT, &ret,
+                             G_TYPE_INVALID))
+  {
+    g_warning("Error requesting '%s': %s", PUI_DBUS_NAME, error->message);
+    g_error_free(error);
 
-  g_signal_connect(manager, "invalidated",
-                   G_CALLBACK(on_account_manager_invalidate_cb), self);
+    /* show what the owner, if any, has meanwhile */
+    if (!PRIVATE(master)->disposed)
+    {
+      owner_watch_start(master);
+      PRIVATE(master)->request_name_id = master_timeout_add_seconds(
+          master, PUI_REQUEST_NAME_RETRY, "request-name",
+          request_name_retry_cb);
+    }
+  }
+  else if (!PRIVATE(master)->disposed)
+  {
+    if ((ret == DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) ||
+        (ret == DBUS_REQUEST_NAME_REPLY_ALREADY_OWNER))
+    {
+      on_name_acquired(master);
+    }
+    else
+    {
+      g_info("'%s' is owned by another instance, waiting in queue",
+             PUI_DBUS_NAME);
+      owner_watch_start(master);
+    }
+  }
 
-  return manager;
+  g_object_unref(proxy);
 }
 
+/* All instances queue for com.nokia.PresenceUI and allow replacement,
+ * PUI_REPLACE in the environment makes us replace the current owner */
 static void
-on_name_owner_changed(DBusGProxy *proxy,
-                      const char *name,
-                      const char *old_owner,
-                      const char *new_owner,
-                      gpointer user_data)
+request_name(PuiMaster *master)
+{
+  PuiMasterPrivate *priv = PRIVATE(master);
+  guint flags = DBUS_NAME_FLAG_ALLOW_REPLACEMENT;
+  DBusGProxy *proxy;
+
+  if (g_getenv("PUI_REPLACE"))
+    flags |= DBUS_NAME_FLAG_REPLACE_EXISTING;
+
+  proxy = dbus_g_proxy_new_for_name(
+      tp_proxy_get_dbus_connection(priv->dbus_daemon), DBUS_SERVICE_DBUS,
+      DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS);
+
+  dbus_g_proxy_begin_call(proxy, "RequestName", request_name_cb,
+                          g_object_ref(master), g_object_unref,
+                          G_TYPE_STRING, PUI_DBUS_NAME,
+                          G_TYPE_UINT, flags,
+                          G_TYPE_INVALID);
+}
+
+static gboolean
+is_own_name_message(DBusMessage *message)
+{
+  const char *name;
+
+  return dbus_message_get_args(message, NULL,
+                               DBUS_TYPE_STRING, &name,
+                               DBUS_TYPE_INVALID) &&
+         !g_strcmp0(name, PUI_DBUS_NAME);
+}
+
+static DBusHandlerResult
+fdo_dbus_filter(DBusConnection *connection, DBusMessage *message,
+                void *user_data)
 {
-  PuiMasterPrivate *priv = PRIVATE(user_data);
+  PuiMaster *master = user_data;
+  PuiMasterPrivate *priv = PRIVATE(master);
+  const char *name;
+  const char *old_owner;
+  const char *new_owner;
+
+  if (!dbus_message_has_sender(message, DBUS_SERVICE_DBUS))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  if (dbus_message_is_signal(message, DBUS_INTERFACE_DBUS, "NameAcquired"))
+  {
+    if (is_own_name_message(message))
+      on_name_acquired(master);
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
 
-  /* did we lose account manager */
-  if (!g_strcmp0(name, TP_ACCOUNT_MANAGER_BUS_NAME) && !*new_owner &&
-      priv->manager)
+  if (dbus_message_is_signal(message, DBUS_INTERFACE_DBUS, "NameLost"))
   {
-    g_warning("Account manager disappeared.");
-    pui_master_account_manager_restart(PUI_MASTER(user_data));
+    if (is_own_name_message(message))
+      on_name_lost(master);
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
   }
-  /* if changed or is acquired */
-  else if (g_str_has_prefix(name, TP_CM_BUS_NAME_BASE) &&
-           (!*old_owner || (*old_owner && *new_owner)) &&
-           priv->accounts_added)
+
+  if (!dbus_message_is_signal(message, DBUS_INTERFACE_DBUS,
+                              "NameOwnerChanged"))
   {
-    g_info("%s changed.", name);
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
 
-    if (priv->cms_list_idle_tag)
-      g_source_remove(priv->cms_list_idle_tag);
+  priv->stats.name_owner_received++;
 
-    priv->cms_list_idle_tag = g_idle_add(cms_list_idle, user_data);
+  if (dbus_message_get_args(message, NULL,
+                            DBUS_TYPE_STRING, &name,
+                            DBUS_TYPE_STRING, &old_owner,
+                            DBUS_TYPE_STRING, &new_owner,
+                            DBUS_TYPE_INVALID))
+  {
+    pui_accounts_name_owner_changed(priv->accounts, name, old_owner,
+                                    new_owner);
   }
+
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
+/* Only subscribe for AM and CMs owner changes, so we are not woken up by
+ * every client connecting to the session bus */
 static void
 fdo_dbus_connect(PuiMaster *self, DBusGConnection *dbus)
 {
   PuiMasterPrivate *priv = PRIVATE(self);
+  DBusConnection *connection = dbus_g_connection_get_connection(dbus);
+
+  g_return_if_fail(connection != NULL);
+
+  if (!dbus_connection_add_filter(connection, fdo_dbus_filter, self, NULL))
+  {
+    g_warning("Unable to add NameOwnerChanged filter");
+    return;
+  }
 
-  priv->fdo_proxy = dbus_g_proxy_new_for_name(dbus,
-                                              DBUS_SERVICE_DBUS,
-                                              DBUS_PATH_DBUS,
-                                              DBUS_INTERFACE_DBUS);
+  priv->fdo_connection = dbus_connection_ref(connection);
+  dbus_bus_add_match(connection, PUI_AM_MATCH_RULE, NULL);
+  dbus_bus_add_match(connection, PUI_CM_MATCH_RULE, NULL);
+}
 
-  g_return_if_fail(priv->fdo_proxy != NULL);
+static void
+fdo_dbus_disconnect(PuiMaster *self)
+{
+  PuiMasterPrivate *priv = PRIVATE(self);
 
-  dbus_g_proxy_add_signal(priv->fdo_proxy,
-                          "NameOwnerChanged",
-                          G_TYPE_STRING,
-                          G_TYPE_STRING,
-                          G_TYPE_STRING,
-                          G_TYPE_INVALID);
-  dbus_g_proxy_connect_signal(priv->fdo_proxy, "NameOwnerChanged",
-                              G_CALLBACK(on_name_owner_changed), self, NULL);
+  if (priv->fdo_connection)
+  {
+    dbus_bus_remove_match(priv->fdo_connection, PUI_AM_MATCH_RULE, NULL);
+    dbus_bus_remove_match(priv->fdo_connection, PUI_CM_MATCH_RULE, NULL);
+    dbus_connection_remove_filter(priv->fdo_connection, fdo_dbus_filter,
+                                  self);
+    dbus_connection_unref(priv->fdo_connection);
+    priv->fdo_connection = NULL;
+  }
 }
 
 static GObject *
@@ -1286,14 +1286,47 @@ pui_master_constructor(GType type, guint n_construct_properties,
 
   master = PUI_MASTER(object);
   priv = PRIVATE(master);
-  dbus = tp_proxy_get_dbus_connection(priv->manager);
-  priv->accounts_added = FALSE;
+  dbus = tp_proxy_get_dbus_connection(priv->dbus_daemon);
+
+  priv->accounts = pui_accounts_new(priv->dbus_daemon, priv->core);
+
+  if (priv->watchdog_budget)
+  {
+    pui_accounts_set_watchdog(
+      priv->accounts, (PuiAccountsWatchdogBeginFunc)pui_master_watchdog_begin,
+      (PuiAccountsWatchdogEndFunc)pui_master_watchdog_end, master);
+  }
+
+  if (pui_accounts_get_spans(priv->accounts))
+    priv->spans_signal_id = g_unix_signal_add(SIGUSR2, spans_dump_cb, master);
+
+  master_signal_connect(master, priv->accounts, "row-inserted",
+                        G_CALLBACK(accounts_row_inserted_cb));
+  master_signal_connect(master, priv->accounts, "row-deleted",
+                        G_CALLBACK(accounts_row_deleted_cb));
+  master_signal_connect(master, priv->accounts, "row-changed",
+                        G_CALLBACK(accounts_row_changed_cb));
+  master_signal_connect(master, priv->accounts, "avatar-changed",
+                        G_CALLBACK(accounts_avatar_changed_cb));
+  master_signal_connect(master, priv->accounts, "presence-changed",
+                        G_CALLBACK(accounts_presence_changed_cb));
+  master_signal_connect(master, priv->accounts, "presence-support",
+                        G_CALLBACK(accounts_presence_support_cb));
+  master_signal_connect(master, priv->accounts, "account-connected",
+                        G_CALLBACK(accounts_account_connected_cb));
+  master_signal_connect(master, priv->accounts, "account-disconnected",
+                        G_CALLBACK(accounts_account_disconnected_cb));
+  master_signal_connect(master, priv->accounts, "account-disabled",
+                        G_CALLBACK(accounts_account_disabled_cb));
+  master_signal_connect(master, priv->accounts, "connection-error",
+                        G_CALLBACK(accounts_connection_error_cb));
 
   g_signal_connect(master, "presence-changed",
                    G_CALLBACK(master_presence_changed_cb), master);
+  g_signal_connect(master, "presence-changed",
+                   G_CALLBACK(on_presence_changed_coalesce), NULL);
 
   fdo_dbus_connect(master, dbus);
-  pui_master_tp_init(master);
 
   priv->ca_ctx = NULL;
   res = ca_context_create(&c);
@@ -1308,7 +1341,8 @@ pui_master_constructor(GType type, guint n_construct_properties,
   else
     priv->ca_ctx = c;
 
-  register_dbus(master, dbus);
+  /* telepathy state is built once we know we are the only instance */
+  request_name(master);
 
   return object;
 }
@@ -1321,15 +1355,10 @@ pui_master_finalize(GObject *object)
   if (priv->ca_ctx)
     ca_context_destroy(priv->ca_ctx);
 
-  if (priv->config)
-    g_key_file_free(priv->config);
-
-  g_free(priv->config_filename);
-
-  g_list_free_full(priv->profiles, (GDestroyNotify)pui_profile_free);
-
-  g_free(priv->presence_message);
+  pui_core_free(priv->core);
   g_free(priv->status_message);
+  g_free(priv->emitted_status_message);
+  g_hash_table_destroy(priv->rows);
 
   G_OBJECT_CLASS(pui_master_parent_class)->finalize(object);
 }
@@ -1338,16 +1367,15 @@ static void
 pui_master_set_property(GObject *object, guint property_id, const GValue *value,
                         GParamSpec *pspec)
 {
-  PuiMaster *master = PUI_MASTER(object);
   switch (property_id)
   {
     case PROP_DBUS_DAEMON:
     {
       PuiMasterPrivate *priv = PRIVATE(object);
 
-      g_assert(priv->manager == NULL);
+      g_assert(priv->dbus_daemon == NULL);
 
-      priv->manager = create_account_manager(master, g_value_get_object(value));
+      priv->dbus_daemon = g_value_dup_object(value);
       break;
     }
     default:
@@ -1371,7 +1399,17 @@ pui_master_dispose(GObject *object)
     g_hash_table_destroy(priv->icons_mid);
     g_hash_table_destroy(priv->icons_small);
 
-    pui_master_clear(PUI_MASTER(object));
+    if (priv->accounts)
+    {
+      pui_accounts_stop(priv->accounts);
+
+      if (pui_accounts_get_spans(priv->accounts))
+        spans_dump_cb(object);
+
+      g_signal_handlers_disconnect_by_data(priv->accounts, object);
+      g_object_unref(priv->accounts);
+      priv->accounts = NULL;
+    }
 
     if (priv->location)
     {
@@ -1385,10 +1423,50 @@ pui_master_dispose(GObject *object)
       priv->mce_proxy = NULL;
     }
 
-    if (priv->fdo_proxy)
+    fdo_dbus_disconnect(PUI_MASTER(object));
+    snapshot_close(PUI_MASTER(object));
+    owner_watch_stop(PUI_MASTER(object));
+
+    if (priv->global_presence_changed_id)
+    {
+      g_source_remove(priv->global_presence_changed_id);
+      priv->global_presence_changed_id = 0;
+    }
+
+    if (priv->request_name_id)
+    {
+      g_source_remove(priv->request_name_id);
+      priv->request_name_id = 0;
+    }
+
+    if (priv->blink_id)
+    {
+      g_source_remove(priv->blink_id);
+      priv->blink_id = 0;
+    }
+
+    if (priv->blink_policy_id)
+    {
+      g_source_remove(priv->blink_policy_id);
+      priv->blink_policy_id = 0;
+    }
+
+    if (priv->stats_signal_id)
+    {
+      g_source_remove(priv->stats_signal_id);
+      priv->stats_signal_id = 0;
+    }
+
+    if (priv->spans_signal_id)
+    {
+      g_source_remove(priv->spans_signal_id);
+      priv->spans_signal_id = 0;
+    }
+
+    if (priv->dbus_daemon)
     {
-      g_object_unref(priv->fdo_proxy);
-      priv->fdo_proxy = NULL;
+      g_object_unref(priv->dbus_daemon);
+      priv->dbus_daemon = NULL;
     }
   }
 
@@ -1440,6 +1518,16 @@ pui_master_class_init(PuiMasterClass *klass)
       "screen-state-changed", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0,
       NULL, NULL, g_cclosure_marshal_VOID__BOOLEAN, G_TYPE_NONE, TRUE,
       G_TYPE_BOOLEAN);
+  /* coalesced presence-changed, exported on D-Bus */
+  signals[GLOBAL_PRESENCE_CHANGED] = g_signal_new(
+      "global-presence-changed", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+      0, NULL, NULL, pui_signal_marshal_VOID__UINT_STRING_UINT, G_TYPE_NONE,
+      3, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_UINT);
+  /* shared blink clock of connecting indicators, TRUE is the alternate,
+   * offline looking, phase */
+  signals[BLINK] = g_signal_new(
+      "blink", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+      g_cclosure_marshal_VOID__BOOLEAN, G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
 
   pui_dbus_init(G_TYPE_FROM_CLASS(klass));
 }
@@ -1452,6 +1540,7 @@ mc_display_status_ind_cb(DBusGProxy *proxy, const char *status,
 
   priv->display_on = g_strcmp0(status, "off") ? TRUE : FALSE;
   g_signal_emit(master, signals[SCREEN_STATE_CHANGED], 0, priv->display_on);
+  blink_update(master);
 }
 
 static void
@@ -1469,6 +1558,7 @@ mce_get_display_status_cb(DBusGProxy *proxy, DBusGProxyCall *call_id,
   {
     priv->display_on = g_strcmp0(status, "off") ? TRUE : FALSE;
     g_signal_emit(master, signals[SCREEN_STATE_CHANGED], 0, priv->display_on);
+    blink_update(master);
     g_free(status);
   }
   else
@@ -1512,128 +1602,17 @@ mce_dbus_init(PuiMaster *master)
 }
 
 static void
-load_profiles(PuiMaster *master)
+location_error_cb(PuiLocation *location, guint error, PuiMaster *master)
 {
-  PuiMasterPrivate *priv = PRIVATE(master);
-  int i;
-
-  gchar **groups;
-  gchar **group;
-
-  for (i = 0; i < G_N_ELEMENTS(default_profiles); i++)
-    priv->profiles = g_list_append(priv->profiles, &default_profiles[i]);
-
-  groups = g_key_file_get_groups(priv->config, NULL);
-
-  for (group = groups; group && *group; group++)
-  {
-    PuiProfile *profile;
-    gchar **keys;
-    gchar **key;
-
-    if (strncmp(*group, PUI_PROFILE_HEADER, strlen(PUI_PROFILE_HEADER)))
-      continue;
-
-    profile = g_slice_new0(PuiProfile);
-    profile->name = g_strdup(*group + strlen(PUI_PROFILE_HEADER));
-    profile->icon = g_key_file_get_string(priv->config, *group, "Icon", NULL);
-    profile->icon_error = g_strconcat(profile->icon, "_error", NULL);
-    profile->default_presence = g_key_file_get_string(priv->config, *group,
-                                                      "DefaultPresence", NULL);
-    profile->accounts = NULL;
-    keys = g_key_file_get_keys(priv->config, *group, NULL, NULL);
-
-    for (key = keys; key && *key; key++)
-    {
-      PuiAccount *account;
-
-      if (strncmp(*key, PUI_ACCOUNT_HEADER, strlen(PUI_ACCOUNT_HEADER)))
-        continue;
-
-      account = g_slice_new(PuiAccount);
-
-      account->account_id = g_strdup(*key + strlen(PUI_ACCOUNT_HEADER));
-      account->presence =
-        g_key_file_get_string(priv->config, *group, *key, NULL);
-      profile->accounts = g_slist_prepend(profile->accounts, account);
-    }
-
-    g_strfreev(keys);
-    priv->profiles = g_list_append(priv->profiles, profile);
-  }
-
-  g_strfreev(groups);
-
-  priv->active_profile = g_list_nth_data(
-      priv->profiles,
-      g_key_file_get_integer(priv->config, "General", "ActiveProfile", NULL));
-
-  if (!priv->active_profile)
-    priv->active_profile = priv->profiles->data;
+  pui_master_set_location_level(master, PUI_LOCATION_LEVEL_NONE);
+  pui_master_save_config(master);
 }
 
 static void
-load_config(PuiMaster *master)
+location_address_changed_cb(PuiLocation *location, PuiMaster *master)
 {
-  PuiMasterPrivate *priv = PRIVATE(master);
-  GError *error = NULL;
-
-  priv->config_filename = g_build_filename(g_get_home_dir(), ".osso",
-                                           ".rtcom-presence-ui.cfg", NULL);
-  priv->config = g_key_file_new();
-  g_key_file_load_from_file(priv->config, priv->config_filename,
-                            G_KEY_FILE_KEEP_COMMENTS, &error);
-
-  if (error)
-  {
-    g_warning("%s error loading %s: %s", __FUNCTION__, priv->config_filename,
-              error->message);
-    g_error_free(error);
-  }
-  else
-  {
-    pui_location_set_level(
-      priv->location,
-      g_key_file_get_integer(priv->config,
-                             "General", "LocationLevel", &error));
-
-    if (error)
-    {
-      g_clear_error(&error);
-      pui_location_set_level(priv->location, PUI_LOCATION_LEVEL_NONE);
-    }
-
-    priv->presence_message = g_key_file_get_string(
-        priv->config, "General", "StatusMessage", NULL);
-  }
-
-  load_profiles(master);
-}
-
-static void
-location_error_cb(PuiLocation *location, guint error, PuiMaster *master)
-{
-  pui_master_set_location_level(master, PUI_LOCATION_LEVEL_NONE);
-  pui_master_save_config(master);
-}
-
-static void
-location_address_changed_cb(PuiLocation *location, PuiMaster *master)
-{
-  compute_presence_message(master);
-}
-
-static gint
-get_presence_weight(TpConnectionPresenceType presence_type, gchar *msg)
-{
-  if (presence_type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE)
-    return presence_type != TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
-
-  if (msg)
-    return 2;
-
-  return 3;
-}
+  compute_presence_message(master);
+}
 
 static gint
 accounts_sort_cmp(GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b,
@@ -1670,8 +1649,8 @@ accounts_sort_cmp(GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b,
     return -1;
   }
 
-  rv = get_presence_weight(presence_type1, msg1) -
-    get_presence_weight(presence_type2, msg2);
+  rv = pui_core_get_presence_weight(presence_type1, msg1) -
+    pui_core_get_presence_weight(presence_type2, msg2);
 
   if (!rv)
   {
@@ -1708,17 +1687,19 @@ pui_master_init(PuiMaster *master)
 
   priv->global_presence_type = TP_CONNECTION_PRESENCE_TYPE_UNSET;
 
-  priv->list_store = gtk_list_store_new(9, TP_TYPE_ACCOUNT, G_TYPE_UINT,
+  priv->list_store = gtk_list_store_new(10, TP_TYPE_ACCOUNT, G_TYPE_UINT,
                                         GDK_TYPE_PIXBUF, GDK_TYPE_PIXBUF,
                                         G_TYPE_STRING, GDK_TYPE_PIXBUF,
                                         G_TYPE_UINT, G_TYPE_UINT,
-                                        G_TYPE_BOOLEAN);
+                                        G_TYPE_BOOLEAN, G_TYPE_UINT);
 
   gtk_tree_sortable_set_default_sort_func(GTK_TREE_SORTABLE(priv->list_store),
                                           accounts_sort_cmp, master, NULL);
-  list_store_enable_sort(GTK_TREE_SORTABLE(priv->list_store), TRUE);
+  list_store_enable_sort(master, TRUE);
   gtk_list_store_insert_with_values(priv->list_store, NULL, G_MAXINT32,
                                     COLUMN_ACCOUNT, NULL, -1);
+  priv->rows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                     (GDestroyNotify)gtk_tree_iter_free);
 
   priv->icons_default = g_hash_table_new_full((GHashFunc)g_str_hash,
                                               (GEqualFunc)g_str_equal,
@@ -1732,14 +1713,9 @@ pui_master_init(PuiMaster *master)
                                             (GEqualFunc)g_str_equal,
                                             (GDestroyNotify)g_free,
                                             (GDestroyNotify)g_object_unref);
-  priv->flags |= 3;
   priv->default_presence_message = _("pres_fi_status_message_default_text");
 
   priv->location = g_object_new(PUI_TYPE_LOCATION, NULL);
-  priv->disconnected_accounts = g_hash_table_new_full((GHashFunc)g_str_hash,
-                                                      (GEqualFunc)g_str_equal,
-                                                      (GDestroyNotify)g_free,
-                                                      NULL);
 
   g_signal_connect(priv->location, "error",
                    G_CALLBACK(location_error_cb), master);
@@ -1747,14 +1723,17 @@ pui_master_init(PuiMaster *master)
                    G_CALLBACK(location_address_changed_cb), master);
   pui_location_set_level(priv->location, PUI_LOCATION_LEVEL_NONE);
 
-  load_config(master);
-  mce_dbus_init(master);
+  watchdog_init(master);
 
-  priv->connection_managers =
-    g_hash_table_new_full((GHashFunc)g_str_hash,
-                          (GEqualFunc)g_str_equal,
-                          (GDestroyNotify)g_free,
-                          (GDestroyNotify)g_object_unref);
+  priv->core = pui_core_new(NULL);
+  pui_core_load_config(priv->core);
+  pui_core_get_blink_policy(priv->core, &priv->blink_onset,
+                            &priv->blink_limit);
+  startup_mark(master, PUI_MASTER_STARTUP_CONFIG_LOADED);
+  pui_location_set_level(priv->location,
+                         pui_core_get_location_level(priv->core));
+  mce_dbus_init(master);
+  priv->stats_signal_id = g_unix_signal_add(SIGUSR1, stats_dump_cb, master);
 }
 
 PuiMaster *
@@ -1767,43 +1746,9 @@ TpConnectionPresenceType
 pui_master_get_presence_type(PuiMaster *master, TpAccount *account,
                              const char *presence)
 {
-  TpConnectionPresenceType presence_type = TP_CONNECTION_PRESENCE_TYPE_BUSY;
-  TpProtocol *protocol;
-
-  if (!strcmp(presence, "offline"))
-    return TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
-
-  if (!strcmp(presence, "available"))
-    return TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
-
-  protocol = pui_master_get_account_protocol(master, account);
-
-  if (protocol)
-  {
-    GList *presence_statuses;
-    GList *l;
-
-    presence_statuses = tp_protocol_dup_presence_statuses(protocol);
-
-    for (l = presence_statuses; l; l = l->next)
-    {
-      if (!strcmp(tp_presence_status_spec_get_name(l->data), presence))
-        break;
-    }
-
-    if (l)
-    {
-      presence_type = tp_presence_status_spec_get_presence_type(l->data);
-
-      if (presence_type == TP_CONNECTION_PRESENCE_TYPE_UNSET)
-        presence_type = TP_CONNECTION_PRESENCE_TYPE_BUSY;
-    }
+  g_return_val_if_fail(PUI_IS_MASTER(master), TP_CONNECTION_PRESENCE_TYPE_BUSY);
 
-    g_list_free_full(presence_statuses,
-                     (GDestroyNotify)tp_presence_status_spec_free);
-  }
-
-  return presence_type;
+  return pui_core_get_presence_type(PRIVATE(master)->core, account, presence);
 }
 
 const gchar *
@@ -1811,7 +1756,7 @@ pui_master_get_presence_message(PuiMaster *master)
 {
   g_return_val_if_fail(PUI_IS_MASTER(master), NULL);
 
-  return PRIVATE(master)->presence_message;
+  return PRIVATE(master)->core->presence_message;
 }
 
 const gchar *
@@ -1827,7 +1772,7 @@ pui_master_get_active_profile(PuiMaster *master)
 {
   g_return_val_if_fail(PUI_IS_MASTER(master), NULL);
 
-  return PRIVATE(master)->active_profile;
+  return PRIVATE(master)->core->active_profile;
 }
 
 GKeyFile *
@@ -1835,7 +1780,7 @@ pui_master_get_config(PuiMaster *master)
 {
   g_return_val_if_fail(PUI_IS_MASTER(master), NULL);
 
-  return PRIVATE(master)->config;
+  return PRIVATE(master)->core->config;
 }
 
 gboolean
@@ -1867,7 +1812,7 @@ pui_master_get_profiles(PuiMaster *master)
 {
   g_return_val_if_fail(PUI_IS_MASTER(master), NULL);
 
-  return PRIVATE(master)->profiles;
+  return PRIVATE(master)->core->profiles;
 }
 
 gboolean
@@ -1875,7 +1820,7 @@ pui_master_is_presence_supported(PuiMaster *master)
 {
   g_return_val_if_fail(PUI_IS_MASTER(master), FALSE);
 
-  return PRIVATE(master)->presence_supported_count > 0;
+  return pui_accounts_is_presence_supported(PRIVATE(master)->accounts);
 }
 
 static time_t
@@ -1970,13 +1915,13 @@ pui_master_set_presence_message(PuiMaster *master, const gchar *message)
   g_return_if_fail(PUI_IS_MASTER(master));
 
   priv = PRIVATE(master);
-  g_free(priv->presence_message);
-  priv->presence_message = g_strdup(message);
+  g_free(priv->core->presence_message);
+  priv->core->presence_message = g_strdup(message);
 
   if (priv->default_presence_message == message)
     message = NULL;
 
-  g_key_file_set_string(priv->config,
+  g_key_file_set_string(priv->core->config,
                         "General", "StatusMessage", message);
   compute_presence_message(master);
 }
@@ -1984,91 +1929,37 @@ pui_master_set_presence_message(PuiMaster *master, const gchar *message)
 void
 pui_master_save_profile(PuiMaster *master, PuiProfile *profile)
 {
-  PuiMasterPrivate *priv;
-  GSList *l;
-  gchar *key;
-
   g_return_if_fail(PUI_IS_MASTER(master));
 
-  priv = PRIVATE(master);
+  pui_accounts_invalidate_profile_scans(PRIVATE(master)->accounts);
 
-  if (!g_list_find(priv->profiles, profile))
-  {
-    priv->profiles = g_list_append(priv->profiles, profile);
+  if (pui_core_store_profile(PRIVATE(master)->core, profile))
     g_signal_emit(master, signals[PROFILE_CREATED], 0, profile);
-  }
   else
     g_signal_emit(master, signals[PROFILE_CHANGED], 0, profile);
 
-  key = g_strdup_printf("%s %s", "Profile", profile->name);
-
-  g_key_file_set_string(priv->config,
-                        key, "Icon", profile->icon);
-  g_key_file_set_string(priv->config,
-                        key, "DefaultPresence", profile->default_presence);
-
-  for (l = profile->accounts; l; l = l->next)
-  {
-    PuiAccount *account = l->data;
-    gchar *string = g_strdup_printf("%s%s", "Account-", account->account_id);
-
-    g_key_file_set_string(priv->config,
-                          key, string, account->presence);
-
-    g_free(string);
-  }
-
-  g_free(key);
   pui_master_save_config(master);
 }
 
 void
 pui_master_save_config(PuiMaster *master)
 {
-  PuiMasterPrivate *priv;
-  GError *error = NULL;
-  gchar *data;
-  gsize length;
+  gint64 start;
 
   g_return_if_fail(PUI_IS_MASTER(master));
 
-  priv = PRIVATE(master);
-  data = g_key_file_to_data(priv->config, &length, &error);
-
-  if (error)
-  {
-    g_warning("%s error: %s", __FUNCTION__, error->message);
-    g_error_free(error);
-  }
-  else
-  {
-    g_file_set_contents(priv->config_filename, data, length, &error);
-    g_free(data);
-
-    if (error)
-    {
-      g_warning("%s error writing %s: %s", __FUNCTION__,
-                priv->config_filename, error->message);
-      g_error_free(error);
-    }
-  }
+  start = pui_master_watchdog_begin(master);
+  PRIVATE(master)->stats.config_writes++;
+  pui_core_save_config(PRIVATE(master)->core);
+  pui_master_watchdog_end(master, "pui_master_save_config", start);
 }
 
 gboolean
 pui_master_erase_profile(PuiMaster *master, PuiProfile *profile)
 {
-  gboolean rv;
-  PuiMasterPrivate *priv;
-  gchar *group_name;
-
   g_return_val_if_fail(PUI_IS_MASTER(master), FALSE);
 
-  priv = PRIVATE(master);
-  group_name = g_strdup_printf("%s%s", "Profile ", profile->name);
-  rv = g_key_file_remove_group(priv->config, group_name, NULL);
-  g_free(group_name);
-
-  return rv;
+  return pui_core_erase_profile(PRIVATE(master)->core, profile);
 }
 
 void
@@ -2080,15 +1971,17 @@ pui_master_delete_profile(PuiMaster *master, PuiProfile *profile)
 
   priv = PRIVATE(master);
 
-  if (priv->active_profile == profile)
+  if (priv->core->active_profile == profile)
   {
-    priv->active_profile = NULL;
-    pui_master_activate_profile(master, &default_profiles[0]);
+    priv->core->active_profile = NULL;
+    pui_master_activate_profile(master,
+                                pui_core_get_default_profile(priv->core));
   }
 
   g_signal_emit(master, signals[PROFILE_DELETED], 0, profile);
   pui_master_erase_profile(master, profile);
-  priv->profiles = g_list_remove(priv->profiles, profile);
+  priv->core->profiles = g_list_remove(priv->core->profiles, profile);
+  pui_accounts_invalidate_profile_scans(priv->accounts);
   pui_master_save_config(master);
   pui_profile_free(profile);
 }
@@ -2105,7 +1998,7 @@ pui_master_set_location_level(PuiMaster *master, PuiLocationLevel level)
   g_return_if_fail(level < PUI_LOCATION_LEVEL_LAST);
 
   pui_location_reset(priv->location);
-  g_key_file_set_integer(priv->config,
+  g_key_file_set_integer(priv->core->config,
                          "General", "LocationLevel", level);
 
   if ((level != PUI_LOCATION_LEVEL_NONE) &&
@@ -2123,25 +2016,9 @@ pui_master_set_location_level(PuiMaster *master, PuiLocationLevel level)
 TpProtocol *
 pui_master_get_account_protocol(PuiMaster *master, TpAccount *account)
 {
-  PuiMasterPrivate *priv;
-  const gchar *cm_name;
-  const gchar *protocol_name;
-  TpConnectionManager *cm;
-
   g_return_val_if_fail(PUI_IS_MASTER(master), NULL);
 
-  priv = PRIVATE(master);
-
-  cm_name = tp_account_get_cm_name(account);
-  g_return_val_if_fail(cm_name != NULL, NULL);
-
-  cm = g_hash_table_lookup(priv->connection_managers, cm_name);
-  g_return_val_if_fail(cm, NULL);
-
-  protocol_name = tp_account_get_protocol_name(account);
-  g_return_val_if_fail(protocol_name, NULL);
-
-  return tp_connection_manager_get_protocol_object(cm, protocol_name);
+  return pui_core_get_account_protocol(PRIVATE(master)->core, account);
 }
 
 const gchar *
@@ -2184,128 +2061,39 @@ pui_master_get_account_display_name(PuiMaster *master, TpAccount *account)
   return display_name;
 }
 
-void
-pui_master_scan_profile(PuiMaster *master, PuiProfile *profile,
-                        gboolean *no_sip_in_profile,
-                        TpConnectionPresenceType *aggregate_presence)
+const PuiMasterProfileScan *
+pui_master_scan_profiles(PuiMaster *master, guint *n_profiles)
 {
-  TpConnectionPresenceType presence = TP_CONNECTION_PRESENCE_TYPE_OFFLINE;
-  PuiMasterPrivate *priv;
-  GtkTreeIter it;
-
-  g_return_if_fail(PUI_IS_MASTER(master));
-
-  priv = PRIVATE(master);
-
-  if (no_sip_in_profile)
-    *no_sip_in_profile = FALSE;
-
-  if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(priv->list_store), &it))
-  {
-    int cannot_change_presence = 0;
-
-    do
-    {
-      TpAccount *account;
-
-      gtk_tree_model_get(GTK_TREE_MODEL(priv->list_store), &it,
-                         COLUMN_ACCOUNT, &account, -1);
-
-      if (account)
-      {
-        TpConnectionPresenceType presence_type;
-
-        presence_type = pui_master_get_presence_type(
-            master, account, pui_profile_get_presence(profile, account));
-
-        if (presence_type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE)
-        {
-          if (tp_account_is_not_sip(account))
-            *no_sip_in_profile = TRUE;
-
-          if (!account_can_change_presence(master, account))
-            cannot_change_presence++;
-        }
-
-        if (account_can_change_presence(master, account))
-        {
-          if (presence_type == TP_CONNECTION_PRESENCE_TYPE_AVAILABLE)
-            presence = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
-          else if ((presence != TP_CONNECTION_PRESENCE_TYPE_AVAILABLE) &&
-                   (presence_type != TP_CONNECTION_PRESENCE_TYPE_OFFLINE))
-          {
-            presence = TP_CONNECTION_PRESENCE_TYPE_BUSY;
-          }
-        }
-
-        g_object_unref(account);
-      }
-    }
-    while (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->list_store), &it));
-
-    if ((presence == TP_CONNECTION_PRESENCE_TYPE_OFFLINE) &&
-        (cannot_change_presence > 0))
-    {
-      presence = TP_CONNECTION_PRESENCE_TYPE_AVAILABLE;
-    }
-  }
+  g_return_val_if_fail(PUI_IS_MASTER(master), NULL);
 
-  if (aggregate_presence)
-    *aggregate_presence = presence;
+  return pui_accounts_scan_profiles(PRIVATE(master)->accounts, n_profiles);
 }
 
-static gboolean
-pui_master_set_presence_idle(gpointer user_data)
+void
+_pui_master_invalidate_profile_scans(PuiMaster *master)
 {
-  PuiMaster *master = user_data;
-  PuiMasterPrivate *priv = PRIVATE(master);
-  gboolean presence_set = FALSE;
-  GtkTreeIter it;
-
-  if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(priv->list_store), &it))
-  {
-    do
-    {
-      TpAccount *account;
-
-      gtk_tree_model_get(GTK_TREE_MODEL(priv->list_store), &it,
-                         COLUMN_ACCOUNT, &account, -1);
-
-      if (account)
-      {
-        if (pui_master_set_account_presence(master, account,
-                                            priv->flags & 2, priv->flags & 1))
-        {
-          presence_set = TRUE;
-        }
-
-        g_object_unref(account);
-      }
-    }
-    while (gtk_tree_model_iter_next(GTK_TREE_MODEL(priv->list_store), &it));
-  }
-
-  priv->flags &= ~3u;
+  g_return_if_fail(PUI_IS_MASTER(master));
 
-  if (!presence_set)
-    compute_global_presence_delayed(master);
+  pui_accounts_invalidate_profile_scans(PRIVATE(master)->accounts);
+}
 
-  priv->set_presence_id = 0;
+void
+pui_master_scan_profile(PuiMaster *master, PuiProfile *profile,
+                        gboolean *no_sip_in_profile,
+                        TpConnectionPresenceType *aggregate_presence)
+{
+  g_return_if_fail(PUI_IS_MASTER(master));
 
-  return FALSE;
+  pui_accounts_scan_profile(PRIVATE(master)->accounts, profile,
+                            no_sip_in_profile, aggregate_presence);
 }
 
 void
 pui_master_set_presence(PuiMaster *master)
 {
-  PuiMasterPrivate *priv;
-
   g_return_if_fail(PUI_IS_MASTER(master));
 
-  priv = PRIVATE(master);
-
-  if (!priv->set_presence_id)
-    priv->set_presence_id = g_idle_add(pui_master_set_presence_idle, master);
+  pui_accounts_request_presence(PRIVATE(master)->accounts, FALSE, FALSE);
 }
 
 gboolean
@@ -2313,38 +2101,9 @@ pui_master_set_account_presence(PuiMaster *master, TpAccount *account,
                                 gboolean flag1, gboolean flag2)
 {
   g_return_val_if_fail(PUI_IS_MASTER(master), FALSE);
-  g_return_val_if_fail(TP_IS_ACCOUNT(account), FALSE);
-
-  if (flag2 || flag1)
-  {
-    PuiMasterPrivate *priv = PRIVATE(master);
-    const gchar *status =
-      pui_profile_get_presence(priv->active_profile, account);
-    TpConnectionPresenceType type =
-      pui_master_get_presence_type(master, account, status);
-
-    tp_account_request_presence_async(account, type, status,
-                                      priv->status_message, NULL, NULL);
-
-    if ((type == TP_CONNECTION_PRESENCE_TYPE_UNSET) ||
-        (type == TP_CONNECTION_PRESENCE_TYPE_OFFLINE))
-    {
-      if (tp_account_get_connect_automatically(account))
-        tp_account_set_connect_automatically_async(account, FALSE, NULL, NULL);
-    }
-    else
-    {
-      tp_account_set_automatic_presence_async(account, type, status,
-                                              priv->status_message, NULL, NULL);
-
-      if (!tp_account_get_connect_automatically(account))
-        tp_account_set_connect_automatically_async(account, TRUE, NULL, NULL);
-    }
 
-    return TRUE;
-  }
-
-  return FALSE;
+  return pui_accounts_set_account_presence(PRIVATE(master)->accounts, account,
+                                           flag1, flag2);
 }
 
 void
@@ -2356,14 +2115,11 @@ pui_master_activate_profile(PuiMaster *master, PuiProfile *profile)
 
   priv = PRIVATE(master);
 
-  priv->active_profile = profile;
-  priv->profile_change_time = now();
-  g_key_file_set_integer(priv->config, "General", "ActiveProfile",
-                         g_list_index(priv->profiles, profile));
-  g_signal_emit(master, signals[PROFILE_ACTIVATED], 0, priv->active_profile);
-  priv->flags |= 2;
-  pui_master_set_presence(master);
-  compute_global_presence_delayed(master);
+  pui_core_activate_profile(priv->core, profile);
+  pui_accounts_profile_activated(priv->accounts);
+  g_signal_emit(master, signals[PROFILE_ACTIVATED], 0, profile);
+  pui_accounts_request_presence(priv->accounts, TRUE, FALSE);
+  pui_accounts_recompute(priv->accounts);
 }
 
 GdkPixbuf *
@@ -2393,8 +2149,11 @@ pui_master_get_icon(PuiMaster *master, const gchar *icon_name, gint icon_size)
 
   icon = g_hash_table_lookup(icons, icon_name);
 
-  if (!icon)
+  if (icon)
+    priv->stats.icon_cache_hits++;
+  else
   {
+    priv->stats.icon_cache_misses++;
     icon = gtk_icon_theme_load_icon(gtk_icon_theme_get_default(), icon_name,
                                     icon_size, 0, NULL);
 
@@ -2411,6 +2170,234 @@ pui_master_get_profile_icon(PuiMaster *master, PuiProfile *profile)
   return pui_master_get_icon(master, profile->icon, ICON_SIZE_DEFAULT);
 }
 
+gboolean
+pui_master_get_blink_phase(PuiMaster *master)
+{
+  g_return_val_if_fail(PUI_IS_MASTER(master), FALSE);
+
+  return PRIVATE(master)->blink_phase;
+}
+
+gboolean
+pui_master_is_blinking(PuiMaster *master)
+{
+  g_return_val_if_fail(PUI_IS_MASTER(master), FALSE);
+
+  return PRIVATE(master)->blink_id != 0;
+}
+
+struct _PuiForeachConnecting
+{
+  PuiMaster *master;
+  PuiMasterRowFunc func;
+  gpointer user_data;
+};
+
+typedef struct _PuiForeachConnecting PuiForeachConnecting;
+
+static void
+foreach_connecting_cb(PuiAccountsRow *row, gpointer user_data)
+{
+  PuiForeachConnecting *data = user_data;
+  GtkTreeIter *iter = g_hash_table_lookup(PRIVATE(data->master)->rows, row);
+
+  if (iter)
+    data->func(data->master, iter, data->user_data);
+}
+
+void
+pui_master_foreach_connecting(PuiMaster *master, PuiMasterRowFunc func,
+                              gpointer user_data)
+{
+  PuiForeachConnecting data;
+
+  g_return_if_fail(PUI_IS_MASTER(master));
+
+  data.master = master;
+  data.func = func;
+  data.user_data = user_data;
+  pui_accounts_foreach_connecting(PRIVATE(master)->accounts,
+                                  foreach_connecting_cb, &data);
+}
+
+gboolean
+pui_master_is_primary(PuiMaster *master)
+{
+  g_return_val_if_fail(PUI_IS_MASTER(master), FALSE);
+
+  return PRIVATE(master)->is_primary;
+}
+
+#define STAT(name) { #name, G_STRUCT_OFFSET(PuiMasterStats, name) }
+
+static const struct
+{
+  const gchar *name;
+  glong offset;
+}
+stats_fields[] =
+{
+  STAT(recomputes),
+  STAT(rows_evaluated),
+  STAT(model_writes),
+  STAT(model_writes_skipped),
+  STAT(resorts),
+  STAT(presence_requests),
+  STAT(avatar_fetches),
+  STAT(avatar_decodes),
+  STAT(icon_cache_hits),
+  STAT(icon_cache_misses),
+  STAT(config_writes),
+  STAT(geocode_requests),
+  STAT(profile_scans),
+  STAT(name_owner_received),
+  STAT(name_owner_handled),
+  STAT(slow_dispatches),
+  STAT(slow_dispatch_max_ms)
+};
+
+#undef STAT
+
+void
+pui_master_get_stats(PuiMaster *master, PuiMasterStats *stats)
+{
+  PuiMasterPrivate *priv;
+
+  g_return_if_fail(PUI_IS_MASTER(master));
+
+  priv = PRIVATE(master);
+
+  *stats = priv->stats;
+
+  /* the work of accounts is counted there */
+  if (priv->accounts)
+  {
+    PuiAccountsStats accounts_stats;
+
+    pui_accounts_get_stats(priv->accounts, &accounts_stats);
+    stats->recomputes = accounts_stats.recomputes;
+    stats->rows_evaluated = accounts_stats.rows_evaluated;
+    stats->model_writes_skipped = accounts_stats.rows_unchanged;
+    stats->presence_requests = accounts_stats.presence_requests;
+    stats->avatar_fetches = accounts_stats.avatar_fetches;
+    stats->profile_scans = accounts_stats.profile_scans;
+    stats->name_owner_handled = accounts_stats.name_owner_handled;
+  }
+
+  if (priv->location)
+    stats->geocode_requests =
+      pui_location_get_geocode_requests(priv->location);
+}
+
+void
+pui_master_stats_foreach(PuiMaster *master, PuiMasterStatsFunc func,
+                         gpointer user_data)
+{
+  PuiMasterStats stats;
+  guint i;
+
+  g_return_if_fail(PUI_IS_MASTER(master));
+
+  pui_master_get_stats(master, &stats);
+
+  for (i = 0; i < G_N_ELEMENTS(stats_fields); i++)
+  {
+    func(stats_fields[i].name,
+         G_STRUCT_MEMBER(guint, &stats, stats_fields[i].offset), user_data);
+  }
+}
+
+void
+pui_master_latency_foreach(PuiMaster *master, PuiMasterLatencyFunc func,
+                           gpointer user_data)
+{
+  g_return_if_fail(PUI_IS_MASTER(master));
+
+  pui_accounts_latency_foreach(PRIVATE(master)->accounts,
+                               (PuiAccountsLatencyFunc)func, user_data);
+}
+
+static void
+stats_dump_one(const gchar *name, guint value, gpointer user_data)
+{
+  g_message("stats: %s %u", name, value);
+}
+
+static void
+latency_dump_one(const gchar *kind, const gchar *protocol,
+                 const PuiHistogram *histogram, gpointer user_data)
+{
+  if (!histogram->count && !histogram->failures)
+    return;
+
+  g_message("latency: %s %s count %u failures %u p50 <%ums p90 <%ums "
+            "max %ums", kind, protocol ? protocol : "-", histogram->count,
+            histogram->failures, pui_histogram_get_percentile(histogram, 50),
+            pui_histogram_get_percentile(histogram, 90), histogram->max_ms);
+}
+
+static void
+wakeup_dump_one(const gchar *name, guint dispatches, guint64 time_us,
+                gdouble per_minute, gpointer user_data)
+{
+  g_message("wakeups: %7.2f/min %8.3f ms total %6u %s", per_minute,
+            time_us / 1000.0, dispatches, name);
+}
+
+static gboolean
+stats_dump_cb(gpointer user_data)
+{
+  pui_master_stats_foreach(user_data, stats_dump_one, NULL);
+  pui_master_latency_foreach(user_data, latency_dump_one, NULL);
+  pui_wakeup_foreach(wakeup_dump_one, NULL);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+spans_dump_cb(gpointer user_data)
+{
+  GError *error = NULL;
+
+  if (!pui_spans_dump(pui_accounts_get_spans(PRIVATE(user_data)->accounts),
+                      &error))
+  {
+    g_warning("Unable to write spans: %s", error->message);
+    g_error_free(error);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+void
+pui_master_trace_span(PuiMaster *master, PuiSpanPhase phase,
+                      const gchar *name, guint64 id, const gchar *account)
+{
+  g_return_if_fail(PUI_IS_MASTER(master));
+
+  if (PRIVATE(master)->accounts)
+  {
+    pui_spans_record(pui_accounts_get_spans(PRIVATE(master)->accounts), phase,
+                     name, id, account);
+  }
+}
+
+void
+pui_master_remote_start_up(PuiMaster *master)
+{
+  PuiMasterPrivate *priv;
+  DBusGProxy *proxy;
+
+  g_return_if_fail(PUI_IS_MASTER(master));
+
+  priv = PRIVATE(master);
+  proxy = dbus_g_proxy_new_for_name(
+      tp_proxy_get_dbus_connection(priv->dbus_daemon), PUI_DBUS_NAME,
+      PUI_DBUS_PATH, PUI_DBUS_NAME);
+  dbus_g_proxy_call_no_reply(proxy, "StartUp", G_TYPE_INVALID);
+  g_object_unref(proxy);
+}
+
 void
 pui_master_get_global_presence(PuiMaster *master,
                                TpConnectionPresenceType *presence_type,
@@ -2422,8 +2409,209 @@ pui_master_get_global_presence(PuiMaster *master,
     *presence_type = priv->global_presence_type;
 
   if (status_message)
-    *status_message = priv->status_message;
+  {
+    if (priv->is_primary)
+      *status_message = priv->status_message;
+    else
+      *status_message = priv->owner_status_message;
+  }
 
   if (status)
     *status = priv->global_status;
 }
+
+gboolean
+pui_master_has_accounts(PuiMaster *master)
+{
+  PuiMasterPrivate *priv;
+
+  g_return_val_if_fail(PUI_IS_MASTER(master), FALSE);
+
+  priv = PRIVATE(master);
+
+  if (!priv->is_primary)
+    return !!(priv->global_status & PUI_MASTER_STATUS_ACCOUNTS);
+
+  return pui_accounts_get_rows(priv->accounts) != NULL;
+}
+
+void
+_pui_master_compute_global_presence(PuiMaster *master)
+{
+  g_return_if_fail(PUI_IS_MASTER(master));
+
+  _pui_accounts_compute_global_presence(PRIVATE(master)->accounts);
+}
+
+gint
+_pui_master_accounts_sort_cmp(PuiMaster *master, GtkTreeIter *a,
+                              GtkTreeIter *b)
+{
+  g_return_val_if_fail(PUI_IS_MASTER(master), 0);
+
+  return accounts_sort_cmp(GTK_TREE_MODEL(PRIVATE(master)->list_store), a, b,
+                           master);
+}
+
+const gint64 *
+_pui_master_get_startup_times(PuiMaster *master)
+{
+  PuiMasterPrivate *priv;
+  const gint64 *times;
+  gint phase;
+
+  g_return_val_if_fail(PUI_IS_MASTER(master), NULL);
+
+  priv = PRIVATE(master);
+  times = _pui_accounts_get_startup_times(priv->accounts);
+
+  /* all but loading the config are phases of accounts */
+  for (phase = PUI_ACCOUNTS_STARTUP_AM_READY;
+       phase < PUI_ACCOUNTS_STARTUP_N_PHASES; phase++)
+  {
+    priv->startup_times[PUI_MASTER_STARTUP_AM_READY + phase] = times[phase];
+  }
+
+  return priv->startup_times;
+}
+
+static gsize
+string_size(const gchar *s)
+{
+  return s ? strlen(s) + 1 : 0;
+}
+
+static gsize
+type_size(GType type)
+{
+  GTypeQuery query;
+
+  g_type_query(type, &query);
+
+  return query.instance_size;
+}
+
+/* returns 0 for pixbufs already counted */
+static gsize
+pixbuf_size(GHashTable *seen, GdkPixbuf *pixbuf)
+{
+  if (!pixbuf || g_hash_table_contains(seen, pixbuf))
+    return 0;
+
+  g_hash_table_add(seen, pixbuf);
+
+  return type_size(GDK_TYPE_PIXBUF) +
+         gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+}
+
+static void
+icon_cache_size(GHashTable *cache, GHashTable *seen, PuiMasterMemory *memory)
+{
+  GHashTableIter iter;
+  gpointer name;
+  gpointer pixbuf;
+
+  g_hash_table_iter_init(&iter, cache);
+
+  while (g_hash_table_iter_next(&iter, &name, &pixbuf))
+  {
+    memory->icons += string_size(name) + pixbuf_size(seen, pixbuf);
+    memory->n_icons++;
+  }
+}
+
+void
+_pui_master_get_memory(PuiMaster *master, PuiMasterMemory *memory)
+{
+  PuiMasterPrivate *priv;
+  PuiAccountsMemory accounts_memory;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  GHashTable *seen;
+  GList *l;
+
+  g_return_if_fail(PUI_IS_MASTER(master));
+
+  priv = PRIVATE(master);
+  model = GTK_TREE_MODEL(priv->list_store);
+  seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+  memset(memory, 0, sizeof(*memory));
+
+  icon_cache_size(priv->icons_default, seen, memory);
+  icon_cache_size(priv->icons_mid, seen, memory);
+  icon_cache_size(priv->icons_small, seen, memory);
+
+  for (l = priv->core->profiles; l; l = l->next)
+  {
+    PuiProfile *profile = l->data;
+    GSList *a;
+
+    memory->profiles += sizeof(GList) + sizeof(PuiProfile) +
+      string_size(profile->name) + string_size(profile->icon) +
+      string_size(profile->icon_error) +
+      string_size(profile->default_presence);
+
+    for (a = profile->accounts; a; a = a->next)
+    {
+      PuiAccount *account = a->data;
+
+      memory->profiles += sizeof(GSList) + sizeof(PuiAccount) +
+        string_size(account->account_id) + string_size(account->presence);
+    }
+
+    memory->n_profiles++;
+  }
+
+  if (gtk_tree_model_get_iter_first(model, &iter))
+  {
+    do
+    {
+      GdkPixbuf *service_icon;
+      GdkPixbuf *avatar;
+      gchar *status_message;
+
+      gtk_tree_model_get(model, &iter,
+                         COLUMN_SERVICE_ICON, &service_icon,
+                         COLUMN_AVATAR, &avatar,
+                         COLUMN_STATUS_MESSAGE, &status_message,
+                         -1);
+
+      /* a sequence node and one data cell per column */
+      memory->model_rows += 64 +
+        gtk_tree_model_get_n_columns(model) * 2 * sizeof(gpointer) +
+        string_size(status_message);
+      memory->n_rows++;
+
+      if (service_icon)
+      {
+        memory->icons += pixbuf_size(seen, service_icon);
+        memory->n_icons++;
+        g_object_unref(service_icon);
+      }
+
+      if (avatar)
+      {
+        memory->avatars += pixbuf_size(seen, avatar);
+        memory->n_avatars++;
+        g_object_unref(avatar);
+      }
+
+      g_free(status_message);
+    }
+    while (gtk_tree_model_iter_next(model, &iter));
+  }
+
+  g_hash_table_destroy(seen);
+
+  _pui_accounts_get_memory(priv->accounts, &accounts_memory);
+  memory->tp_proxies = accounts_memory.tp_proxies;
+  memory->n_tp_proxies = accounts_memory.n_tp_proxies;
+  memory->signal_handlers = accounts_memory.signal_handlers;
+  memory->n_bindings = accounts_memory.n_bindings;
+}
+
+guint
+_pui_master_get_live_bindings(void)
+{
+  return _pui_accounts_get_live_bindings();
+}
@@ -22,8 +22,7 @@
 
 #include <hildon/hildon.h>
 
-#include "pui-location.h"
-#include "pui-profile.h"
+#include "pui-accounts.h"
 
 G_BEGIN_DECLS
 
@@ -76,18 +75,9 @@ enum
   COLUMN_AVATAR,
   COLUMN_CONNECTION_STATUS,
   COLUMN_STATUS_REASON,
-  COLUMN_IS_CHANGING_STATUS
-};
-
-enum
-{
-  PUI_MASTER_STATUS_NONE = 0,
-  PUI_MASTER_STATUS_ERROR = 1 << 0,
-  PUI_MASTER_STATUS_CONNECTING = 1 << 2,
-  PUI_MASTER_STATUS_MESSAGE_CHANGED = 1 << 3,
-  PUI_MASTER_STATUS_CONNECTED = 1 << 4,
-  PUI_MASTER_STATUS_OFFLINE = 1 << 5,
-  PUI_MASTER_STATUS_REASON_ERROR = 1 << 6
+  COLUMN_IS_CHANGING_STATUS,
+  /* ms the last presence request took to complete, 0 if none did */
+  COLUMN_CONNECT_TIME
 };
 
 GType
@@ -169,6 +159,14 @@ pui_master_scan_profile(PuiMaster *master, PuiProfile *profile,
                         gboolean *no_sip_in_profile,
                         TpConnectionPresenceType *aggregate_presence);
 
+/* What pui_master_scan_profile() returns for a profile */
+typedef PuiAccountsProfileScan PuiMasterProfileScan;
+
+/* See pui_accounts_scan_profiles(), profiles are in pui_master_get_profiles()
+ * order */
+const PuiMasterProfileScan *
+pui_master_scan_profiles(PuiMaster *master, guint *n_profiles);
+
 gboolean
 pui_master_set_account_presence(PuiMaster *master, TpAccount *account,
                                 gboolean flag1, gboolean flag2);
@@ -187,6 +185,163 @@ pui_master_get_global_presence(PuiMaster *master,
                                TpConnectionPresenceType *presence_type,
                                const gchar **status_message, guint *status);
 
+/* TRUE while connecting indicators should show the alternate, offline
+ * looking, icon. Changes are signalled with "blink". */
+gboolean
+pui_master_get_blink_phase(PuiMaster *master);
+
+gboolean
+pui_master_is_blinking(PuiMaster *master);
+
+typedef void (*PuiMasterRowFunc)(PuiMaster *master, GtkTreeIter *iter,
+                                 gpointer user_data);
+
+/* calls func for every row in TP_CONNECTION_STATUS_CONNECTING, the set is
+ * updated on recompute and the blink clock runs exactly while it is not
+ * empty */
+void
+pui_master_foreach_connecting(PuiMaster *master, PuiMasterRowFunc func,
+                              gpointer user_data);
+
+gboolean
+pui_master_is_primary(PuiMaster *master);
+
+/* TRUE if there is an account to show presence of. A thin client, see
+ * pui_master_is_primary(), takes it from the owner's global presence. */
+gboolean
+pui_master_has_accounts(PuiMaster *master);
+
+/* Counters of the work PuiMaster did since it was created. Always on, get
+ * them with GetStats over D-Bus or dump them to the log with SIGUSR1. */
+struct _PuiMasterStats
+{
+  guint recomputes;
+  guint rows_evaluated;
+  guint model_writes;
+  guint model_writes_skipped;
+  guint resorts;
+  guint presence_requests;
+  guint avatar_fetches;
+  guint avatar_decodes;
+  guint icon_cache_hits;
+  guint icon_cache_misses;
+  guint config_writes;
+  guint geocode_requests;
+  /* evaluations of all profiles against all accounts */
+  guint profile_scans;
+  /* NameOwnerChanged signals the match rules let through, and the ones for
+   * the AM or a CM */
+  guint name_owner_received;
+  guint name_owner_handled;
+  /* callbacks over the PUI_WATCHDOG_MS budget, zero if it is not set */
+  guint slow_dispatches;
+  guint slow_dispatch_max_ms;
+};
+
+typedef struct _PuiMasterStats PuiMasterStats;
+
+typedef void (*PuiMasterStatsFunc)(const gchar *name, guint value,
+                                   gpointer user_data);
+
+void
+pui_master_get_stats(PuiMaster *master, PuiMasterStats *stats);
+
+/* calls func for every counter, with its D-Bus name */
+void
+pui_master_stats_foreach(PuiMaster *master, PuiMasterStatsFunc func,
+                         gpointer user_data);
+
+/* Latency histograms, kept per protocol, except "settle", for which protocol
+ * is NULL:
+ *   "request" - presence request until the account reaches the requested
+ *               presence or CONNECTED
+ *   "activation" - profile activation until the same, for the requests
+ *                  activation caused
+ *   "settle" - profile activation until all those requests completed
+ * Requests that end with an unrequested disconnect or an error are counted
+ * as failures. */
+typedef void (*PuiMasterLatencyFunc)(const gchar *kind, const gchar *protocol,
+                                     const PuiHistogram *histogram,
+                                     gpointer user_data);
+
+void
+pui_master_latency_foreach(PuiMaster *master, PuiMasterLatencyFunc func,
+                           gpointer user_data);
+
+/* Times a callback against the PUI_WATCHDOG_MS budget, callbacks over it
+ * are logged and counted in the stats. begin returns 0 and end does nothing
+ * if the watchdog is off. PuiMaster main loop sources and signal handlers
+ * are timed already. */
+gint64
+pui_master_watchdog_begin(PuiMaster *master);
+
+void
+pui_master_watchdog_end(PuiMaster *master, const gchar *name, gint64 start);
+
+/* adds a marker to the span trace, does nothing unless PUI_SPANS is set */
+void
+pui_master_trace_span(PuiMaster *master, PuiSpanPhase phase,
+                      const gchar *name, guint64 id, const gchar *account);
+
+void
+pui_master_remote_start_up(PuiMaster *master);
+
+/* synchronous entry points to internal hot paths, for benchmarks only */
+void
+_pui_master_compute_global_presence(PuiMaster *master);
+
+gint
+_pui_master_accounts_sort_cmp(PuiMaster *master, GtkTreeIter *a,
+                              GtkTreeIter *b);
+
+void
+_pui_master_invalidate_profile_scans(PuiMaster *master);
+
+typedef enum
+{
+  PUI_MASTER_STARTUP_CONFIG_LOADED,
+  PUI_MASTER_STARTUP_AM_READY,
+  PUI_MASTER_STARTUP_CMS_LISTED,
+  PUI_MASTER_STARTUP_ACCOUNTS_APPENDED,
+  PUI_MASTER_STARTUP_FIRST_RECOMPUTE,
+  PUI_MASTER_STARTUP_N_PHASES
+} PuiMasterStartupPhase;
+
+/* monotonic time at which each startup phase finished, 0 if it did not
+ * finish yet, for benchmarks only */
+const gint64 *
+_pui_master_get_startup_times(PuiMaster *master);
+
+/* Approximate heap held by each subsystem, in bytes. Pixbufs shared between
+ * caches and rows are counted once, Telepathy proxies are the accounts and
+ * connection managers PuiMaster references and signal handlers are the ones
+ * PuiMaster has on those accounts. */
+struct _PuiMasterMemory
+{
+  gsize icons;
+  guint n_icons;
+  gsize avatars;
+  guint n_avatars;
+  gsize profiles;
+  guint n_profiles;
+  gsize model_rows;
+  guint n_rows;
+  gsize tp_proxies;
+  guint n_tp_proxies;
+  guint signal_handlers;
+  guint n_bindings;
+};
+
+typedef struct _PuiMasterMemory PuiMasterMemory;
+
+/* for benchmarks only */
+void
+_pui_master_get_memory(PuiMaster *master, PuiMasterMemory *memory);
+
+/* account bindings alive in all PuiAccounts instances, for benchmarks only */
+guint
+_pui_master_get_live_bindings(void);
+
 G_END_DECLS
 
 #endif /* __PUI_MASTER_H_INCLUDED__ */
@@ -68,10 +68,8 @@ struct _PuiMenuItemPrivate
   GtkWidget *status_label;
   GdkPixbuf *status_area_icon;
   GdkPixbuf *icon;
-  guint update_icons_id;
   GtkWidget *status_area;
   gboolean is_connecting : 1;
-  gboolean show_presence_icon : 1;
 };
 
 typedef struct _PuiMenuItemPrivate PuiMenuItemPrivate;
@@ -93,14 +91,12 @@ enum
 };
 
 static void
-on_row_deleted(PuiMenuItem *item)
+update_visibility(PuiMenuItem *item)
 {
-  PuiMenuItemPrivate *priv = PRIVATE(item);
-
-  if (gtk_tree_model_iter_n_children(GTK_TREE_MODEL(priv->model), 0) <= 1)
-    gtk_widget_hide(GTK_WIDGET(item));
-  else
+  if (pui_master_has_accounts(PRIVATE(item)->master))
     gtk_widget_show(GTK_WIDGET(item));
+  else
+    gtk_widget_hide(GTK_WIDGET(item));
 }
 
 static TpConnectionPresenceType
@@ -185,21 +181,24 @@ pui_menu_item_update_icon(PuiMenuItem *item, PuiProfile *profile, guint status)
   update_icon(item, icon_name);
 }
 
-static gboolean
-update_icons(PuiMenuItem *item)
+static void
+on_blink(PuiMaster *master, gboolean phase, PuiMenuItem *item)
 {
   PuiMenuItemPrivate *priv = PRIVATE(item);
   const gchar *status_icon_name;
   const gchar *icon_name;
 
-  priv->show_presence_icon = !priv->show_presence_icon;
+  if (!priv->is_connecting)
+    return;
+
+  pui_master_trace_span(master, PUI_SPAN_BEGIN, "menu-item-blink", 0, NULL);
 
-  if (priv->show_presence_icon)
+  if (!phase)
   {
-    PuiProfile *profile = pui_master_get_active_profile(priv->master);
+    PuiProfile *profile = pui_master_get_active_profile(master);
     TpConnectionPresenceType presence_type;
 
-    pui_master_get_global_presence(priv->master, &presence_type, NULL, NULL);
+    pui_master_get_global_presence(master, &presence_type, NULL, NULL);
     presence_type = get_profile_presence_type(presence_type, profile);
     status_icon_name = get_status_icon_name(item, presence_type, 0);
 
@@ -216,8 +215,7 @@ update_icons(PuiMenuItem *item)
 
   update_icon(item, icon_name);
   update_status_area_icon(item, status_icon_name);
-
-  return TRUE;
+  pui_master_trace_span(master, PUI_SPAN_END, "menu-item-blink", 0, NULL);
 }
 
 static void
@@ -229,7 +227,8 @@ set_status_message(PuiMaster *master, PuiProfile *profile, PuiMenuItem *item)
 
   pui_master_scan_profile(master, profile, &no_sip_in_profile, NULL);
 
-  if (no_sip_in_profile)
+  /* a thin client has no accounts to scan, show what the owner has */
+  if (no_sip_in_profile || !pui_master_is_primary(master))
     pui_master_get_global_presence(master, NULL, &status_message, NULL);
 
   gtk_label_set_text(GTK_LABEL(priv->status_label), status_message);
@@ -242,21 +241,11 @@ on_presence_changed(PuiMenuItem *item, TpConnectionPresenceType presence_type,
 {
   PuiMenuItemPrivate *priv = PRIVATE(item);
 
+  pui_master_trace_span(master, PUI_SPAN_BEGIN, "menu-item-update", 0, NULL);
+
+  /* icons blink on the master clock, which starts after this returns */
   if (status & PUI_MASTER_STATUS_CONNECTING)
-  {
-    if (!priv->update_icons_id)
-    {
-      priv->is_connecting = TRUE;
-      priv->show_presence_icon = TRUE;
-
-      if (pui_master_get_display_on(priv->master))
-      {
-        priv->update_icons_id =
-          g_timeout_add_seconds(1, (GSourceFunc)update_icons, item);
-        update_icons(item);
-      }
-    }
-  }
+    priv->is_connecting = TRUE;
   else
   {
     PuiProfile *profile;
@@ -264,13 +253,6 @@ on_presence_changed(PuiMenuItem *item, TpConnectionPresenceType presence_type,
     const gchar *status_icon_name;
 
     priv->is_connecting = FALSE;
-
-    if (priv->update_icons_id)
-    {
-      g_source_remove(priv->update_icons_id);
-      priv->update_icons_id = 0;
-    }
-
     profile = pui_master_get_active_profile(priv->master);
     type = get_profile_presence_type(presence_type, profile);
     status_icon_name = get_status_icon_name(
@@ -280,6 +262,14 @@ on_presence_changed(PuiMenuItem *item, TpConnectionPresenceType presence_type,
   }
 
   set_status_message(master, pui_master_get_active_profile(master), item);
+  update_visibility(item);
+
+  /* so the first tap does not have to build it. Primary is known only after
+   * the name request returns, a thin client does not keep a view around */
+  if (pui_master_is_primary(master))
+    pui_main_view_prepare(master);
+
+  pui_master_trace_span(master, PUI_SPAN_END, "menu-item-update", 0, NULL);
 }
 
 static void
@@ -305,7 +295,7 @@ on_profile_changed(PuiMenuItem *item, PuiProfile *profile, PuiMaster *master)
   {
     pui_master_get_global_presence(master, &type, NULL, &status);
 
-    if (!priv->update_icons_id)
+    if (!pui_master_is_blinking(master))
     {
       const gchar *icon;
 
@@ -321,30 +311,6 @@ on_profile_changed(PuiMenuItem *item, PuiProfile *profile, PuiMaster *master)
   }
 }
 
-static void
-on_screen_state_changed(PuiMaster *master, gboolean is_on, PuiMenuItem *item)
-{
-  PuiMenuItemPrivate *priv = PRIVATE(item);
-
-  if (!priv->is_connecting)
-    return;
-
-  if (is_on)
-  {
-    if (!priv->update_icons_id)
-    {
-      priv->update_icons_id =
-        g_timeout_add_seconds(1, (GSourceFunc)update_icons, item);
-      update_icons(item);
-    }
-  }
-  else if (priv->update_icons_id)
-  {
-    g_source_remove(priv->update_icons_id);
-    priv->update_icons_id = 0;
-  }
-}
-
 static void
 pui_menu_item_constructed(GObject *object)
 {
@@ -395,14 +361,13 @@ pui_menu_item_constructed(GObject *object)
 
     priv->model = pui_master_get_model(priv->master);
     g_object_ref(priv->model);
-    on_row_deleted(item);
+    update_visibility(item);
     g_signal_connect_swapped(priv->model, "row-deleted",
-                             G_CALLBACK(on_row_deleted), item);
+                             G_CALLBACK(update_visibility), item);
     g_signal_connect_swapped(priv->model, "row-inserted",
-                             G_CALLBACK(gtk_widget_show), item);
+                             G_CALLBACK(update_visibility), item);
 
-    g_signal_connect(priv->master, "screen-state-changed",
-                     G_CALLBACK(on_screen_state_changed), item);
+    g_signal_connect(priv->master, "blink", G_CALLBACK(on_blink), item);
   }
 
   if (object_class->constructed)
@@ -414,20 +379,11 @@ pui_menu_item_dispose(GObject *object)
 {
   PuiMenuItemPrivate *priv = PRIVATE(object);
 
-  if (priv->update_icons_id)
-  {
-    g_source_remove(priv->update_icons_id);
-    priv->update_icons_id = 0;
-  }
-
   if (priv->model)
   {
     g_signal_handlers_disconnect_matched(
       priv->model, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
-      on_row_deleted, object);
-    g_signal_handlers_disconnect_matched(
-      priv->model, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
-      gtk_widget_show, object);
+      update_visibility, object);
     g_object_unref(priv->model);
     priv->model = NULL;
   }
@@ -445,7 +401,8 @@ pui_menu_item_dispose(GObject *object)
       on_profile_changed, object);
     g_signal_handlers_disconnect_matched(
       priv->master, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
-      on_screen_state_changed, object);
+      on_blink, object);
+    pui_main_view_release(priv->master);
     g_object_unref(priv->master);
     priv->master = NULL;
   }
@@ -528,11 +485,14 @@ static void
 button_clicked_cb(GtkWidget *button, PuiMenuItem *item)
 {
   PuiMenuItemPrivate *priv = PRIVATE(item);
-  PuiMainView *view = pui_main_view_new(priv->master);
 
-  pui_main_view_run(view);
+  if (!pui_master_is_primary(priv->master))
+  {
+    pui_master_remote_start_up(priv->master);
+    return;
+  }
 
-  gtk_widget_destroy(GTK_WIDGET(view));
+  pui_main_view_open(priv->master);
 }
 
 static void
@@ -545,7 +505,6 @@ pui_menu_item_init(PuiMenuItem *item)
   GtkWidget *button;
   GtkWidget *align;
 
-  priv->update_icons_id = 0;
   button = hildon_button_new(HILDON_SIZE_FINGER_HEIGHT,
                              HILDON_BUTTON_ARRANGEMENT_VERTICAL);
   gtk_container_add(GTK_CONTAINER(item), button);
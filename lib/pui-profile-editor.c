@@ -161,6 +161,7 @@ pui_profile_editor_constructor(GType type, guint n_construct_properties,
   GList *l;
   GList *accounts = NULL;
   GtkTreeIter iter;
+  gint64 start;
 
   object = G_OBJECT_CLASS(pui_profile_editor_parent_class)->constructor(
       type, n_construct_properties, construct_properties);
@@ -169,6 +170,7 @@ pui_profile_editor_constructor(GType type, guint n_construct_properties,
 
   editor = PUI_PROFILE_EDITOR(object);
   priv = PRIVATE(editor);
+  start = pui_master_watchdog_begin(priv->master);
   profile = priv->profile;
 
   if (profile)
@@ -352,6 +354,9 @@ pui_profile_editor_constructor(GType type, guint n_construct_properties,
     "gtk-cancel", GTK_RESPONSE_CANCEL,
     NULL);
 
+  pui_master_watchdog_end(priv->master, "pui_profile_editor_constructor",
+                          start);
+
   return object;
 }
 
@@ -0,0 +1,223 @@
+/*
+ * pui-snapshot.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pui-snapshot.h"
+
+/* everything after the sequence counter */
+#define PAYLOAD_OFFSET (offsetof(PuiSnapshotData, sequence) + sizeof(gint))
+#define PAYLOAD_SIZE (sizeof(PuiSnapshotData) - PAYLOAD_OFFSET)
+#define PAYLOAD(data) ((guint8 *)(data) + PAYLOAD_OFFSET)
+
+#define READ_RETRIES 100
+
+struct _PuiSnapshot
+{
+  int fd;
+  gboolean writable;
+  PuiSnapshotData *data;
+};
+
+static PuiSnapshot *
+snapshot_map(gboolean writable)
+{
+  PuiSnapshot *snapshot;
+  gchar *filename;
+  int fd;
+  void *data;
+
+  filename = g_build_filename(g_get_user_runtime_dir(), PUI_SNAPSHOT_FILENAME,
+                              NULL);
+
+  if (writable)
+    fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  else
+    fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+  {
+    if (writable || (errno != ENOENT))
+      g_warning("%s: open %s failed: %s", __FUNCTION__, filename,
+                g_strerror(errno));
+
+    g_free(filename);
+    return NULL;
+  }
+
+  if (writable && ftruncate(fd, sizeof(PuiSnapshotData)))
+  {
+    g_warning("%s: truncate %s failed: %s", __FUNCTION__, filename,
+              g_strerror(errno));
+    close(fd);
+    g_free(filename);
+    return NULL;
+  }
+
+  /* the writer is yet to truncate it, or it is from another version. Past
+   * the end of the file the mapping would SIGBUS. */
+  if (!writable)
+  {
+    struct stat st;
+
+    if (fstat(fd, &st) || (st.st_size < (off_t)sizeof(PuiSnapshotData)))
+    {
+      g_debug("%s: %s is too short", __FUNCTION__, filename);
+      close(fd);
+      g_free(filename);
+      return NULL;
+    }
+  }
+
+  data = mmap(NULL, sizeof(PuiSnapshotData),
+              writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+  if (data == MAP_FAILED)
+  {
+    g_warning("%s: mmap %s failed: %s", __FUNCTION__, filename,
+              g_strerror(errno));
+    close(fd);
+    g_free(filename);
+    return NULL;
+  }
+
+  g_free(filename);
+
+  snapshot = g_slice_new(PuiSnapshot);
+  snapshot->fd = fd;
+  snapshot->writable = writable;
+  snapshot->data = data;
+
+  return snapshot;
+}
+
+PuiSnapshot *
+pui_snapshot_open(void)
+{
+  return snapshot_map(FALSE);
+}
+
+gboolean
+pui_snapshot_read(PuiSnapshot *snapshot, PuiSnapshotData *data)
+{
+  int i;
+
+  g_return_val_if_fail(snapshot != NULL, FALSE);
+  g_return_val_if_fail(data != NULL, FALSE);
+
+  for (i = 0; i < READ_RETRIES; i++)
+  {
+    gint seq = g_atomic_int_get(&snapshot->data->sequence);
+
+    if (seq & 1)
+      continue;
+
+    memcpy(data, snapshot->data, sizeof(*data));
+
+    if (g_atomic_int_get(&snapshot->data->sequence) == seq)
+    {
+      data->sequence = seq;
+
+      if ((data->magic != PUI_SNAPSHOT_MAGIC) ||
+          (data->version != PUI_SNAPSHOT_VERSION) || (data->writer_pid <= 0))
+      {
+        return FALSE;
+      }
+
+      /* the writer died without clearing magic */
+      if (kill(data->writer_pid, 0) && (errno == ESRCH))
+        return FALSE;
+
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+void
+pui_snapshot_close(PuiSnapshot *snapshot)
+{
+  if (!snapshot)
+    return;
+
+  /* stop readers from taking the last state as current, unless another
+   * instance took the file over already */
+  if (snapshot->writable && (snapshot->data->writer_pid == getpid()))
+  {
+    g_atomic_int_inc(&snapshot->data->sequence);
+    snapshot->data->magic = 0;
+    snapshot->data->writer_pid = 0;
+    g_atomic_int_inc(&snapshot->data->sequence);
+  }
+
+  munmap(snapshot->data, sizeof(PuiSnapshotData));
+  close(snapshot->fd);
+  g_slice_free(PuiSnapshot, snapshot);
+}
+
+PuiSnapshot *
+pui_snapshot_create(void)
+{
+  PuiSnapshot *snapshot = snapshot_map(TRUE);
+
+  if (snapshot)
+  {
+    PuiSnapshotData *data = snapshot->data;
+
+    /* previous instance might have crashed in the middle of an update */
+    if (g_atomic_int_get(&data->sequence) & 1)
+      g_atomic_int_inc(&data->sequence);
+
+    g_atomic_int_inc(&data->sequence);
+    data->magic = PUI_SNAPSHOT_MAGIC;
+    data->version = PUI_SNAPSHOT_VERSION;
+    data->writer_pid = getpid();
+    g_atomic_int_inc(&data->sequence);
+  }
+
+  return snapshot;
+}
+
+/* Returns TRUE if anything changed and data was written */
+gboolean
+pui_snapshot_update(PuiSnapshot *snapshot, const PuiSnapshotData *data)
+{
+  g_return_val_if_fail(snapshot != NULL, FALSE);
+  g_return_val_if_fail(data != NULL, FALSE);
+
+  if (!memcmp(PAYLOAD(snapshot->data), PAYLOAD(data), PAYLOAD_SIZE))
+    return FALSE;
+
+  g_atomic_int_inc(&snapshot->data->sequence);
+  memcpy(PAYLOAD(snapshot->data), PAYLOAD(data), PAYLOAD_SIZE);
+  g_atomic_int_inc(&snapshot->data->sequence);
+
+  return TRUE;
+}
@@ -0,0 +1,91 @@
+/*
+ * pui-snapshot.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PUI_SNAPSHOT_H_INCLUDED__
+#define __PUI_SNAPSHOT_H_INCLUDED__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Presence snapshot PuiMaster publishes in $XDG_RUNTIME_DIR, for readers that
+ * need global presence without D-Bus round-trips. Data is protected by a
+ * sequence counter, which is odd while the writer updates it, use
+ * pui_snapshot_read() to get a consistent copy. The writer clears magic when
+ * it stops publishing, and readers reject the data when the writer_pid
+ * process is gone, so the state of an instance that crashed is not taken as
+ * current.
+ */
+
+#define PUI_SNAPSHOT_FILENAME "rtcom-presence-ui.snapshot"
+#define PUI_SNAPSHOT_MAGIC 0x53495550 /* PUIS */
+#define PUI_SNAPSHOT_VERSION 2
+
+#define PUI_SNAPSHOT_MAX_ACCOUNTS 64
+#define PUI_SNAPSHOT_ACCOUNT_ID_LEN 128
+#define PUI_SNAPSHOT_MESSAGE_LEN 256
+
+struct _PuiSnapshotAccount
+{
+  gchar account_id[PUI_SNAPSHOT_ACCOUNT_ID_LEN];
+  guint32 presence_type;
+  guint32 connection_status;
+  guint32 status_reason;
+};
+
+typedef struct _PuiSnapshotAccount PuiSnapshotAccount;
+
+struct _PuiSnapshotData
+{
+  guint32 magic;
+  guint32 version;
+  gint32 writer_pid;
+  gint sequence;
+  guint32 presence_type;
+  guint32 status;
+  gint32 active_profile;
+  gchar status_message[PUI_SNAPSHOT_MESSAGE_LEN];
+  guint32 n_accounts;
+  PuiSnapshotAccount accounts[PUI_SNAPSHOT_MAX_ACCOUNTS];
+};
+
+typedef struct _PuiSnapshotData PuiSnapshotData;
+
+typedef struct _PuiSnapshot PuiSnapshot;
+
+PuiSnapshot *
+pui_snapshot_open(void);
+
+gboolean
+pui_snapshot_read(PuiSnapshot *snapshot, PuiSnapshotData *data);
+
+void
+pui_snapshot_close(PuiSnapshot *snapshot);
+
+/* writer side, used by PuiMaster */
+PuiSnapshot *
+pui_snapshot_create(void);
+
+gboolean
+pui_snapshot_update(PuiSnapshot *snapshot, const PuiSnapshotData *data);
+
+G_END_DECLS
+
+#endif /* __PUI_SNAPSHOT_H_INCLUDED__ */
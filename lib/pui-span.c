@@ -0,0 +1,173 @@
+/*
+ * pui-span.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <unistd.h>
+
+#include "pui-span.h"
+
+struct _PuiSpanEvent
+{
+  gint64 timestamp;
+  const gchar *name;
+  const gchar *account;
+  guint64 id;
+  PuiSpanPhase phase;
+};
+
+typedef struct _PuiSpanEvent PuiSpanEvent;
+
+struct _PuiSpans
+{
+  gchar *filename;
+  PuiSpanEvent *events;
+  guint capacity;
+  guint next;
+  gboolean wrapped;
+  guint64 last_id;
+};
+
+PuiSpans *
+pui_spans_new(const gchar *filename, guint capacity)
+{
+  PuiSpans *spans;
+
+  g_return_val_if_fail(filename != NULL, NULL);
+  g_return_val_if_fail(capacity > 0, NULL);
+
+  spans = g_slice_new0(PuiSpans);
+  spans->filename = g_strdup(filename);
+  spans->events = g_new0(PuiSpanEvent, capacity);
+  spans->capacity = capacity;
+
+  return spans;
+}
+
+PuiSpans *
+pui_spans_new_from_env(void)
+{
+  const gchar *filename = g_getenv(PUI_SPANS_ENV);
+
+  if (!filename || !*filename)
+    return NULL;
+
+  g_info("Recording spans, kill -USR2 %d writes them to %s", getpid(),
+         filename);
+
+  return pui_spans_new(filename, PUI_SPANS_CAPACITY);
+}
+
+void
+pui_spans_record(PuiSpans *spans, PuiSpanPhase phase, const gchar *name,
+                 guint64 id, const gchar *account)
+{
+  PuiSpanEvent *event;
+
+  if (!spans)
+    return;
+
+  event = &spans->events[spans->next];
+  event->timestamp = g_get_monotonic_time();
+  event->name = name;
+  /* accounts repeat, so interning them keeps recording allocation free */
+  event->account = account ? g_intern_string(account) : NULL;
+  event->id = id;
+  event->phase = phase;
+
+  if (++spans->next == spans->capacity)
+  {
+    spans->next = 0;
+    spans->wrapped = TRUE;
+  }
+}
+
+guint64
+pui_spans_next_id(PuiSpans *spans)
+{
+  return spans ? ++spans->last_id : 0;
+}
+
+static void
+append_event(GString *json, const PuiSpanEvent *event, gint pid)
+{
+  g_string_append_printf(json,
+                         "{\"name\":\"%s\",\"cat\":\"pui\",\"ph\":\"%c\","
+                         "\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d",
+                         event->name, event->phase, event->timestamp, pid,
+                         pid);
+
+  if ((event->phase == PUI_SPAN_ASYNC_BEGIN) ||
+      (event->phase == PUI_SPAN_ASYNC_END))
+  {
+    g_string_append_printf(json, ",\"id\":\"0x%" G_GINT64_MODIFIER "x\"",
+                           event->id);
+  }
+  else if (event->phase == PUI_SPAN_INSTANT)
+    g_string_append(json, ",\"s\":\"t\"");
+
+  if (event->account)
+  {
+    gchar *account = g_strescape(event->account, NULL);
+
+    g_string_append_printf(json, ",\"args\":{\"account\":\"%s\"}", account);
+    g_free(account);
+  }
+
+  g_string_append_c(json, '}');
+}
+
+gboolean
+pui_spans_dump(PuiSpans *spans, GError **error)
+{
+  guint n = spans->wrapped ? spans->capacity : spans->next;
+  guint first = spans->wrapped ? spans->next : 0;
+  gint pid = getpid();
+  GString *json;
+  gboolean rv;
+  guint i;
+
+  json = g_string_sized_new(128 * (n + 1));
+  g_string_append(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  for (i = 0; i < n; i++)
+  {
+    if (i)
+      g_string_append(json, ",\n");
+
+    append_event(json, &spans->events[(first + i) % spans->capacity], pid);
+  }
+
+  g_string_append(json, "]}\n");
+  rv = g_file_set_contents(spans->filename, json->str, json->len, error);
+  g_string_free(json, TRUE);
+
+  return rv;
+}
+
+void
+pui_spans_free(PuiSpans *spans)
+{
+  if (!spans)
+    return;
+
+  g_free(spans->events);
+  g_free(spans->filename);
+  g_slice_free(PuiSpans, spans);
+}
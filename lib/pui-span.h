@@ -0,0 +1,75 @@
+/*
+ * pui-span.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PUI_SPAN_H_INCLUDED__
+#define __PUI_SPAN_H_INCLUDED__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Ring buffer of span markers, written out in Chrome trace-event JSON, which
+ * chrome://tracing and Perfetto show as a timeline. Recording is enabled by
+ * setting PUI_SPANS to the file to write, the buffer is written on SIGUSR2
+ * and on exit. */
+
+#define PUI_SPANS_ENV "PUI_SPANS"
+
+/* events kept, older ones are overwritten */
+#define PUI_SPANS_CAPACITY 8192
+
+/* values are the trace-event "ph" field */
+typedef enum
+{
+  /* synchronous section, must nest */
+  PUI_SPAN_BEGIN = 'B',
+  PUI_SPAN_END = 'E',
+  /* asynchronous hop, begin and end are matched by name and id */
+  PUI_SPAN_ASYNC_BEGIN = 'b',
+  PUI_SPAN_ASYNC_END = 'e',
+  PUI_SPAN_INSTANT = 'i'
+} PuiSpanPhase;
+
+typedef struct _PuiSpans PuiSpans;
+
+PuiSpans *
+pui_spans_new(const gchar *filename, guint capacity);
+
+/* NULL if PUI_SPANS is not set */
+PuiSpans *
+pui_spans_new_from_env(void);
+
+/* name must be a static string, account may be NULL */
+void
+pui_spans_record(PuiSpans *spans, PuiSpanPhase phase, const gchar *name,
+                 guint64 id, const gchar *account);
+
+/* an id to correlate the ends of an asynchronous hop */
+guint64
+pui_spans_next_id(PuiSpans *spans);
+
+gboolean
+pui_spans_dump(PuiSpans *spans, GError **error);
+
+void
+pui_spans_free(PuiSpans *spans);
+
+G_END_DECLS
+
+#endif /* __PUI_SPAN_H_INCLUDED__ */
@@ -0,0 +1,347 @@
+/*
+ * pui-trace.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pui-trace.h"
+
+/*
+ * File format: PUI_TRACE_MAGIC followed by records of
+ *
+ *   type, time since previous record in us, name, arg0, arg1, arg2, str1,
+ *   str2
+ *
+ * Numbers are LEB128 varints. Strings are interned: 0 is NULL, n refers to
+ * the n-th string seen so far, and the next unused number is followed by
+ * length and bytes of a new string. Accounts, statuses and properties
+ * repeat all the time, so most records fit in 8-10 bytes.
+ */
+
+#define PUI_TRACE_MAGIC "PUITRAC1"
+
+/* seconds a record may stay buffered, a trace is usually collected by
+ * killing the process */
+#define PUI_TRACE_FLUSH_INTERVAL 1
+
+struct _PuiTrace
+{
+  FILE *fp;
+  GHashTable *strings;
+  guint n_strings;
+  gint64 start;
+  gint64 last;
+  guint flush_id;
+};
+
+struct _PuiTraceReader
+{
+  gchar *data;
+  gsize len;
+  gsize pos;
+  GPtrArray *strings;
+  gint64 timestamp;
+};
+
+PuiTrace *
+pui_trace_new(const gchar *filename, GError **error)
+{
+  PuiTrace *trace;
+  FILE *fp = g_fopen(filename, "wb");
+
+  if (!fp)
+  {
+    int errsv = errno;
+
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errsv),
+                "Unable to create %s: %s", filename, g_strerror(errsv));
+    return NULL;
+  }
+
+  fwrite(PUI_TRACE_MAGIC, 1, strlen(PUI_TRACE_MAGIC), fp);
+
+  trace = g_slice_new0(PuiTrace);
+  trace->fp = fp;
+  trace->strings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         NULL);
+  trace->start = g_get_monotonic_time();
+  trace->last = trace->start;
+
+  return trace;
+}
+
+PuiTrace *
+pui_trace_new_from_env(void)
+{
+  const gchar *filename = g_getenv(PUI_TRACE_ENV);
+  GError *error = NULL;
+  PuiTrace *trace;
+
+  if (!filename || !*filename)
+    return NULL;
+
+  trace = pui_trace_new(filename, &error);
+
+  if (trace)
+    g_info("Recording telepathy events to %s", filename);
+  else
+  {
+    g_warning("%s", error->message);
+    g_error_free(error);
+  }
+
+  return trace;
+}
+
+static void
+write_uint(PuiTrace *trace, guint64 v)
+{
+  guchar buf[10];
+  int len = 0;
+
+  do
+  {
+    buf[len] = v & 0x7f;
+    v >>= 7;
+
+    if (v)
+      buf[len] |= 0x80;
+
+    len++;
+  }
+  while (v);
+
+  fwrite(buf, 1, len, trace->fp);
+}
+
+static void
+write_string(PuiTrace *trace, const gchar *s)
+{
+  gpointer id;
+  size_t len;
+
+  if (!s)
+  {
+    write_uint(trace, 0);
+    return;
+  }
+
+  if (g_hash_table_lookup_extended(trace->strings, s, NULL, &id))
+  {
+    write_uint(trace, GPOINTER_TO_UINT(id));
+    return;
+  }
+
+  trace->n_strings++;
+  g_hash_table_insert(trace->strings, g_strdup(s),
+                      GUINT_TO_POINTER(trace->n_strings));
+
+  len = strlen(s);
+  write_uint(trace, trace->n_strings);
+  write_uint(trace, len);
+  fwrite(s, 1, len, trace->fp);
+}
+
+static gboolean
+flush_cb(gpointer user_data)
+{
+  PuiTrace *trace = user_data;
+
+  fflush(trace->fp);
+  trace->flush_id = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+pui_trace_record(PuiTrace *trace, PuiTraceEventType type, const gchar *name,
+                 guint arg0, guint arg1, guint arg2, const gchar *str1,
+                 const gchar *str2)
+{
+  gint64 now;
+
+  if (!trace)
+    return;
+
+  now = g_get_monotonic_time();
+
+  write_uint(trace, type);
+  write_uint(trace, now - trace->last);
+  write_string(trace, name);
+  write_uint(trace, arg0);
+  write_uint(trace, arg1);
+  write_uint(trace, arg2);
+  write_string(trace, str1);
+  write_string(trace, str2);
+
+  trace->last = now;
+
+  /* flush the last burst too, even if nothing is recorded after it */
+  if (!trace->flush_id)
+  {
+    trace->flush_id = g_timeout_add_seconds(PUI_TRACE_FLUSH_INTERVAL,
+                                            flush_cb, trace);
+  }
+}
+
+void
+pui_trace_close(PuiTrace *trace)
+{
+  if (!trace)
+    return;
+
+  if (trace->flush_id)
+    g_source_remove(trace->flush_id);
+
+  fflush(trace->fp);
+  fclose(trace->fp);
+  g_hash_table_destroy(trace->strings);
+  g_slice_free(PuiTrace, trace);
+}
+
+PuiTraceReader *
+pui_trace_reader_new(const gchar *filename, GError **error)
+{
+  PuiTraceReader *reader;
+  gchar *data;
+  gsize len;
+
+  if (!g_file_get_contents(filename, &data, &len, error))
+    return NULL;
+
+  if ((len < strlen(PUI_TRACE_MAGIC)) ||
+      memcmp(data, PUI_TRACE_MAGIC, strlen(PUI_TRACE_MAGIC)))
+  {
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "%s is not a presence trace", filename);
+    g_free(data);
+    return NULL;
+  }
+
+  reader = g_slice_new0(PuiTraceReader);
+  reader->data = data;
+  reader->len = len;
+  reader->pos = strlen(PUI_TRACE_MAGIC);
+  reader->strings = g_ptr_array_new_with_free_func(g_free);
+
+  return reader;
+}
+
+static gboolean
+read_uint(PuiTraceReader *reader, guint64 *v)
+{
+  int shift = 0;
+
+  *v = 0;
+
+  while ((reader->pos < reader->len) && (shift < 64))
+  {
+    guchar c = reader->data[reader->pos++];
+
+    *v |= (guint64)(c & 0x7f) << shift;
+
+    if (!(c & 0x80))
+      return TRUE;
+
+    shift += 7;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+read_string(PuiTraceReader *reader, const gchar **s)
+{
+  guint64 id;
+  guint64 len;
+
+  if (!read_uint(reader, &id))
+    return FALSE;
+
+  if (!id)
+  {
+    *s = NULL;
+    return TRUE;
+  }
+
+  if (id == reader->strings->len + 1)
+  {
+    if (!read_uint(reader, &len) || (len > reader->len - reader->pos))
+      return FALSE;
+
+    g_ptr_array_add(reader->strings,
+                    g_strndup(reader->data + reader->pos, len));
+    reader->pos += len;
+  }
+  else if (id > reader->strings->len)
+    return FALSE;
+
+  *s = g_ptr_array_index(reader->strings, id - 1);
+
+  return TRUE;
+}
+
+gboolean
+pui_trace_reader_next(PuiTraceReader *reader, PuiTraceEvent *event,
+                      GError **error)
+{
+  guint64 type;
+  guint64 delta;
+  guint64 args[3];
+
+  if (reader->pos >= reader->len)
+    return FALSE;
+
+  if (!read_uint(reader, &type) || !read_uint(reader, &delta) ||
+      !read_string(reader, &event->name) ||
+      !read_uint(reader, &args[0]) || !read_uint(reader, &args[1]) ||
+      !read_uint(reader, &args[2]) || !read_string(reader, &event->str1) ||
+      !read_string(reader, &event->str2))
+  {
+    /* a trace cut by a crash ends with a partial record */
+    g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                "Truncated or corrupt trace record at offset %" G_GSIZE_FORMAT,
+                reader->pos);
+    reader->pos = reader->len;
+    return FALSE;
+  }
+
+  reader->timestamp += delta;
+
+  event->type = type;
+  event->timestamp = reader->timestamp;
+  event->args[0] = args[0];
+  event->args[1] = args[1];
+  event->args[2] = args[2];
+
+  return TRUE;
+}
+
+void
+pui_trace_reader_free(PuiTraceReader *reader)
+{
+  g_ptr_array_unref(reader->strings);
+  g_free(reader->data);
+  g_slice_free(PuiTraceReader, reader);
+}
@@ -0,0 +1,93 @@
+/*
+ * pui-trace.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PUI_TRACE_H_INCLUDED__
+#define __PUI_TRACE_H_INCLUDED__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Binary trace of the telepathy events PuiMaster receives. Recording is
+ * enabled by setting PUI_TRACE to the file to write. */
+
+#define PUI_TRACE_ENV "PUI_TRACE"
+
+typedef enum
+{
+  /* name: account, args: presence type, str1: status, str2: message */
+  PUI_TRACE_PRESENCE_CHANGED = 1,
+  /* name: account, args: old status, new status, reason, str1: error */
+  PUI_TRACE_STATUS_CHANGED,
+  /* name: account, args: new value, str1: property */
+  PUI_TRACE_NOTIFY,
+  /* name: account */
+  PUI_TRACE_AVATAR_CHANGED,
+  /* name: bus name, args: had old owner, has new owner */
+  PUI_TRACE_AM_OWNER_CHANGED,
+  PUI_TRACE_CM_OWNER_CHANGED
+} PuiTraceEventType;
+
+struct _PuiTraceEvent
+{
+  PuiTraceEventType type;
+  /* microseconds since start of the trace */
+  gint64 timestamp;
+  const gchar *name;
+  guint args[3];
+  const gchar *str1;
+  const gchar *str2;
+};
+
+typedef struct _PuiTraceEvent PuiTraceEvent;
+
+typedef struct _PuiTrace PuiTrace;
+
+typedef struct _PuiTraceReader PuiTraceReader;
+
+PuiTrace *
+pui_trace_new(const gchar *filename, GError **error);
+
+/* NULL if PUI_TRACE is not set or the file cannot be created */
+PuiTrace *
+pui_trace_new_from_env(void);
+
+void
+pui_trace_record(PuiTrace *trace, PuiTraceEventType type, const gchar *name,
+                 guint arg0, guint arg1, guint arg2, const gchar *str1,
+                 const gchar *str2);
+
+void
+pui_trace_close(PuiTrace *trace);
+
+PuiTraceReader *
+pui_trace_reader_new(const gchar *filename, GError **error);
+
+/* Strings in event stay valid until reader is freed. Returns FALSE at the
+ * end of the trace or on error. */
+gboolean
+pui_trace_reader_next(PuiTraceReader *reader, PuiTraceEvent *event,
+                      GError **error);
+
+void
+pui_trace_reader_free(PuiTraceReader *reader);
+
+G_END_DECLS
+
+#endif /* __PUI_TRACE_H_INCLUDED__ */
@@ -0,0 +1,159 @@
+/*
+ * pui-wakeup.c
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "pui-wakeup.h"
+
+/* the rate is taken over this many seconds, one bucket per second */
+#define PUI_WAKEUP_WINDOW 60
+
+struct _PuiWakeupSource
+{
+  const gchar *name;
+  guint dispatches;
+  guint64 time_us;
+  /* second of the last dispatch, buckets after it are stale */
+  gint64 last_second;
+  guint buckets[PUI_WAKEUP_WINDOW];
+};
+
+typedef struct _PuiWakeupSource PuiWakeupSource;
+
+/* a handful of sources, a linear scan beats hashing */
+static GArray *sources = NULL;
+static gint64 accounting_start = 0;
+
+gint64
+pui_wakeup_enter(void)
+{
+  gint64 now = g_get_monotonic_time();
+
+  if (G_UNLIKELY(!sources))
+  {
+    sources = g_array_new(FALSE, TRUE, sizeof(PuiWakeupSource));
+    accounting_start = now;
+  }
+
+  return now;
+}
+
+/* clears the buckets of the seconds source had no dispatch in */
+static void
+source_advance(PuiWakeupSource *source, gint64 second)
+{
+  gint64 s;
+
+  if (second - source->last_second >= PUI_WAKEUP_WINDOW)
+    memset(source->buckets, 0, sizeof(source->buckets));
+  else
+  {
+    for (s = source->last_second + 1; s <= second; s++)
+      source->buckets[s % PUI_WAKEUP_WINDOW] = 0;
+  }
+
+  source->last_second = second;
+}
+
+void
+pui_wakeup_leave(const gchar *name, gint64 start)
+{
+  gint64 now = g_get_monotonic_time();
+  gint64 second = now / G_USEC_PER_SEC;
+  PuiWakeupSource *source = NULL;
+  guint i;
+
+  g_return_if_fail(sources != NULL);
+
+  for (i = 0; i < sources->len; i++)
+  {
+    PuiWakeupSource *s = &g_array_index(sources, PuiWakeupSource, i);
+
+    if ((s->name == name) || !strcmp(s->name, name))
+    {
+      source = s;
+      break;
+    }
+  }
+
+  if (!source)
+  {
+    g_array_set_size(sources, sources->len + 1);
+    source = &g_array_index(sources, PuiWakeupSource, sources->len - 1);
+    source->name = name;
+    source->last_second = second;
+  }
+
+  source_advance(source, second);
+  source->buckets[second % PUI_WAKEUP_WINDOW]++;
+  source->dispatches++;
+  source->time_us += now - start;
+}
+
+static gint
+source_cmp(gconstpointer a, gconstpointer b)
+{
+  const PuiWakeupSource *s1 = a;
+  const PuiWakeupSource *s2 = b;
+
+  if (s1->dispatches != s2->dispatches)
+    return s1->dispatches > s2->dispatches ? -1 : 1;
+
+  return strcmp(s1->name, s2->name);
+}
+
+void
+pui_wakeup_foreach(PuiWakeupFunc func, gpointer user_data)
+{
+  gint64 now = g_get_monotonic_time();
+  gdouble minutes;
+  GArray *sorted;
+  guint i;
+
+  if (!sources)
+    return;
+
+  /* a process younger than the window has its rate taken over its life */
+  minutes = (gdouble)MIN(now - accounting_start,
+                         PUI_WAKEUP_WINDOW * G_USEC_PER_SEC) /
+            (60 * G_USEC_PER_SEC);
+  sorted = g_array_sized_new(FALSE, FALSE, sizeof(PuiWakeupSource),
+                             sources->len);
+  g_array_append_vals(sorted, sources->data, sources->len);
+  g_array_sort(sorted, source_cmp);
+
+  for (i = 0; i < sorted->len; i++)
+  {
+    PuiWakeupSource *s = &g_array_index(sorted, PuiWakeupSource, i);
+    guint recent = 0;
+    guint j;
+
+    source_advance(s, now / G_USEC_PER_SEC);
+
+    for (j = 0; j < PUI_WAKEUP_WINDOW; j++)
+      recent += s->buckets[j];
+
+    func(s->name, s->dispatches, s->time_us,
+         minutes > 0 ? recent / minutes : 0, user_data);
+  }
+
+  g_array_unref(sorted);
+}
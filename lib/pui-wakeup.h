@@ -0,0 +1,49 @@
+/*
+ * pui-wakeup.h
+ *
+ * Copyright (C) 2022 Ivaylo Dimitrov <ivo.g.dimitrov.75@gmail.com>
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __PUI_WAKEUP_H_INCLUDED__
+#define __PUI_WAKEUP_H_INCLUDED__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Process wide count of main loop source dispatches and the time spent in
+ * them, per source name. Main thread only. */
+
+/* returns start to pass to pui_wakeup_leave() */
+gint64
+pui_wakeup_enter(void);
+
+/* name must be a static string */
+void
+pui_wakeup_leave(const gchar *name, gint64 start);
+
+typedef void (*PuiWakeupFunc)(const gchar *name, guint dispatches,
+                              guint64 time_us, gdouble per_minute,
+                              gpointer user_data);
+
+/* calls func for every source, busiest first. dispatches and time_us are
+ * totals, per_minute is the rate over the last minute only. */
+void
+pui_wakeup_foreach(PuiWakeupFunc func, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __PUI_WAKEUP_H_INCLUDED__ */